@@ -0,0 +1,17 @@
+/* Hash used by the builtin registry's perfect hash table. Shared by the
+   table generator (tools/gen_builtin_hash.c) and builtin_lookup so both
+   agree on every slot. */
+#ifndef BUILTIN_HASH_H
+#define BUILTIN_HASH_H
+
+static inline unsigned builtin_hash(const char* name, unsigned seed)
+{
+    unsigned h = seed;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+#endif
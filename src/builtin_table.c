@@ -0,0 +1,92 @@
+#include "my_shell.h"
+#include "builtin_hash.h"
+#include "builtin_hash_table.h"
+
+/* Adapters giving every builtin the registry's handler signature. */
+static int builtin_cd(char** args, char*** env)       { return command_cd(args, env); }
+static int builtin_pushd(char** args, char*** env)    { return command_pushd(args, env); }
+static int builtin_popd(char** args, char*** env)     { return command_popd(args, env); }
+static int builtin_z(char** args, char*** env)        { return command_z(args, env); }
+static int builtin_source(char** args, char*** env)   { return command_source(args, env); }
+static int builtin_limit(char** args, char*** env)    { return command_limit(args, env); }
+static int builtin_pwd(char** args, char*** env)      { (void)args; (void)env; return command_pwd(); }
+static int builtin_run(char** args, char*** env)      { return command_run(args, *env); }
+static int builtin_echo(char** args, char*** env)     { return command_echo(args, *env); }
+static int builtin_env(char** args, char*** env)      { (void)args; return command_env(*env); }
+static int builtin_which(char** args, char*** env)    { return command_which(args, *env); }
+static int builtin_help(char** args, char*** env)     { return command_help(args, *env); }
+static int builtin_ls(char** args, char*** env)       { return command_ls(args, *env); }
+static int builtin_cat(char** args, char*** env)      { return command_cat(args, *env); }
+static int builtin_cp(char** args, char*** env)       { return command_cp(args, *env); }
+static int builtin_mv(char** args, char*** env)       { return command_mv(args, *env); }
+static int builtin_rm(char** args, char*** env)       { return command_rm(args, *env); }
+static int builtin_du(char** args, char*** env)       { return command_du(args, *env); }
+static int builtin_procs(char** args, char*** env)    { (void)env; return command_procs(args); }
+static int builtin_last(char** args, char*** env)     { (void)env; return command_last(args); }
+static int builtin_mem(char** args, char*** env)      { (void)env; return command_mem(args); }
+static int builtin_exit(char** args, char*** env)     { (void)args; (void)env; return -1; }
+
+static int builtin_list_help(char** args, char*** env)
+{
+    (void)args;
+    (void)env;
+    display_help();
+    return 0;
+}
+
+/* setenv and unsetenv return the unchanged environment when they fail */
+static int builtin_setenv(char** args, char*** env)
+{
+    char** old_env = *env;
+    *env = command_setenv(args, old_env);
+    return *env == old_env ? 1 : 0;
+}
+
+static int builtin_unsetenv(char** args, char*** env)
+{
+    char** old_env = *env;
+    *env = command_unsetenv(args, old_env);
+    return *env == old_env ? 1 : 0;
+}
+
+const builtin builtin_table[] = {
+#define BUILTIN(name, handler, capture, flags, usage, summary, help) \
+    { name, handler, capture, flags, usage, summary, help },
+#include "builtins.def"
+#undef BUILTIN
+};
+
+const size_t builtin_count = sizeof(builtin_table) / sizeof(builtin_table[0]);
+
+/* O(1) lookup through the perfect hash generated from builtins.def:
+   one hash of the name and a single string compare. */
+const builtin* builtin_lookup(const char* name)
+{
+    if (!name) return NULL;
+
+    unsigned slot = builtin_hash(name, BUILTIN_HASH_SEED) & ((1u << BUILTIN_HASH_BITS) - 1);
+    int index = builtin_hash_slots[slot];
+    if (index < 0 || my_strcmp(builtin_table[index].name, name) != 0) return NULL;
+    return &builtin_table[index];
+}
+
+// Runs a builtin whose only effect is its output, appending that output to out
+// and its exit status to *status. Returns 1 if args named such a builtin, 0 if
+// it must be run normally.
+int builtin_capture(char** args, strbuf* out, int* status)
+{
+    const builtin* b = builtin_lookup(args[0]);
+    if (!b || !(b->flags & BUILTIN_CAPTURABLE)) return 0;
+    *status = b->capture(args, out) == -1 ? 1 : 0;
+    return 1;
+}
+
+void display_help(void)
+{
+    printf("Available commands:\n");
+    for (size_t i = 0; i < builtin_count; i++) {
+        const builtin* b = &builtin_table[i];
+        if (b->flags & BUILTIN_UNLISTED) continue;
+        printf("\t%-20s- %s\n", b->usage, b->summary);
+    }
+}
@@ -6,69 +6,25 @@
 #include <string.h>
 #include <sys/wait.h>   // <--- added
 
-// cd, cd [path], cd - (previous dir), cd ~ (home dir), cd .., handle non exsiting dirs, permission issues
-int command_cd(char** args, char* init_dir)
-{
-    (void)init_dir;
-
-    /* If no argument, climb to the highest reachable level by repeatedly chdir("..")
-       until getcwd() stops changing or chdir fails. */
-    if (args[1] == NULL) {
-        char *prev = getcwd(NULL, 0);
-        if (!prev) {
-            perror("getcwd");
-            return 1;
-        }
-
-        while (1) {
-            if (chdir("..") != 0) {
-                /* Can't go up further (permission or other error) */
-                break;
-            }
-            char *cwd = getcwd(NULL, 0);
-            if (!cwd) {
-                perror("getcwd");
-                break;
-            }
-            /* If path didn't change, we've reached the top */
-            if (strcmp(prev, cwd) == 0) {
-                free(cwd);
-                break;
-            }
-            free(prev);
-            prev = cwd;
-        }
+// cd, pushd, popd and z live in src/dirs.c
 
-        free(prev);
-        return 0;
-    }
-
-    /* Otherwise behave like normal cd <path> */
-    if (chdir(args[1]) == 0) {
-        return 0;
-    } else {
-        perror("cd");
-        return 1;
-    }
-}
-
-int command_pwd()
+/* pwd and echo write through these so $(pwd) and $(echo ...) can be
+   captured in-process (see builtin_capture) instead of forking. */
+int capture_pwd(char** args, strbuf* out)
 {
-    char* cwd = NULL;
-
-    // Use dynamic allocation
-    cwd = getcwd(NULL, 0);
-    if (cwd != NULL) {
-        printf("%s\n", cwd);
-        free(cwd);
-    } else {
+    (void)args;
+    // The logical directory kept by cd (dirs.c), so no getcwd
+    const char* cwd = dirs_pwd();
+    if (cwd == NULL) {
         perror("getcwd");
+        return -1;
     }
-    return 0;
+    int r = sb_append(out, cwd, my_strlen(cwd));
+    if (r == 0) r = sb_putc(out, '\n');
+    return r;
 }
 
-// echo Hello World, echo -n Hello, echo $PATH
-int command_echo(char** args, char** env)
+int capture_echo(char** args, strbuf* out)
 {
     int new_line = 1;
     size_t i = 1;
@@ -79,24 +35,43 @@ int command_echo(char** args, char** env)
     }
 
     for (; args[i]; i++) {
-        if (args[i][0] == '$') {
-            char* value = my_getenv(args[i] + 1, env);
-            if (value) {
-                printf("%s", value);
-            }
-        } else {
-            printf("%s", args[i]);
-        }
+        if (sb_append(out, args[i], my_strlen(args[i])) == -1) return -1;
         if (args[i + 1] != NULL) {
-            printf(" ");
+            if (sb_putc(out, ' ') == -1) return -1;
         }
     }
     if (new_line) {
-        printf("\n");
+        return sb_putc(out, '\n');
     }
     return 0;
 }
 
+static int print_formatted(int r, strbuf* out)
+{
+    if (r == 0 && out->len > 0) {
+        fwrite(out->data, 1, out->len, stdout);
+    }
+    sb_free(out);
+    return r == 0 ? 0 : 1;
+}
+
+int command_pwd()
+{
+    strbuf out = {0};
+    return print_formatted(capture_pwd(NULL, &out), &out);
+}
+
+// echo Hello World, echo -n Hello, echo $PATH
+// Variables are already substituted by expand_args.
+int command_echo(char** args, char** env)
+{
+    (void)env;
+    strbuf out = {0};
+    return print_formatted(capture_echo(args, &out), &out);
+}
+
+// ls lives in src/ls.c
+
 int command_env(char** env)
 {
     size_t index = 0;
@@ -117,20 +92,18 @@ int command_which(char** args, char** env)
         return 1;
     }
 
-    // List of the built-ins
-    const char* built_in_commands[] = {"cd", "pwd", "echo", "env", "setenv", "unsetenv", "which", "exit", NULL};
-    for (size_t i = 0; built_in_commands[i]; i++) {
-        if (my_strcmp(args[1], built_in_commands[i]) == 0) {
-            printf("%s: shell built-in command\n", args[1]);
-            return 0;
-        }
+    // Built-ins from the registry
+    const builtin* b = builtin_lookup(args[1]);
+    if (b) {
+        printf("%s: shell built-in command\n", args[1]);
+        return 0;
     }
 
     // Check external commands
     char* full_path = find_command_in_path(args[1], env);
     if (full_path != NULL) {
         printf("%s\n", full_path);
-        free(full_path);
+        mem_free(full_path);
         return 0;
     } else {
         printf("which: %s command not found\n", args[1]);
@@ -141,173 +114,17 @@ int command_which(char** args, char** env)
 // ---------------------- new help command ----------------------
 // command_help implementation moved to src/help.c to reduce file size and improve organization
 
-// ---------------------- new run command ----------------------
-int command_run(char** args, char** env)
-{
-    if (!args[1]) {
-        printf("Usage: run <file> [args...]\n");
-        return 1;
-    }
-
-    const char* file = args[1];
-    const char* extp = strrchr(file, '.');
-    if (!extp || extp[1] == '\0') {
-        printf("run: unknown file type for '%s'\n", file);
-        return 1;
-    }
-    const char* ext = extp + 1;
-
-    /* helper to count extra args after the filename (args[2..]) */
-    int extra = 0;
-    while (args[2 + extra]) extra++;
-
-    if (my_strcmp(ext, "c") == 0 || my_strcmp(ext, "cpp") == 0 ||
-        my_strcmp(ext, "cc") == 0 || my_strcmp(ext, "cxx") == 0)
-    {
-        /* choose compiler */
-        const char* compiler = my_strcmp(ext, "c") == 0 ? "gcc" : "g++";
-
-        /* compile to a temp executable in /tmp */
-        char outpath[PATH_MAX];
-        snprintf(outpath, sizeof(outpath), "/tmp/edox_run_%d", (int)getpid());
-
-        char* compile_cmd[] = { (char*)compiler, (char*)file, "-o", outpath, NULL };
-        executor(compile_cmd, env);
-
-        if (access(outpath, X_OK) != 0) {
-            printf("run: compilation failed for '%s'\n", file);
-            return 1;
-        }
-
-        /* build argv for the compiled program: outpath, then any extra args */
-        int run_argc = 1 + extra;
-        char** run_argv = malloc((run_argc + 1) * sizeof(char*));
-        if (!run_argv) { perror("malloc"); unlink(outpath); return 1; }
-        run_argv[0] = strdup(outpath);
-        for (int i = 0; i < extra; ++i) {
-            run_argv[1 + i] = strdup(args[2 + i]);
-        }
-        run_argv[run_argc] = NULL;
-
-        /* fork and execve the absolute path to avoid executor path searching */
-        pid_t pid = fork();
-        if (pid == -1) {
-            perror("fork");
-            for (int i = 0; i < run_argc; ++i) free(run_argv[i]);
-            free(run_argv);
-            unlink(outpath);
-            return 1;
-        }
-        if (pid == 0) {
-            execve(outpath, run_argv, env);
-            perror("execve");
-            _exit(EXIT_FAILURE);
-        } else {
-            int status = 0;
-            waitpid(pid, &status, 0);
-            /* cleanup */
-            for (int i = 0; i < run_argc; ++i) free(run_argv[i]);
-            free(run_argv);
-            unlink(outpath);
-            return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
-        }
-    }
-    else if (my_strcmp(ext, "py") == 0) {
-        /* run with python3, pass through extra args */
-        char** cmd = malloc((2 + extra + 1) * sizeof(char*));
-        if (!cmd) { perror("malloc"); return 1; }
-        cmd[0] = my_strdup("python3");
-        cmd[1] = my_strdup(file);
-        for (int i = 0; i < extra; ++i) {
-            cmd[2 + i] = my_strdup(args[2 + i]);
-        }
-        cmd[2 + extra] = NULL;
-        int ret = executor(cmd, env);
-        for (int i = 0; i < 2 + extra; ++i) free(cmd[i]);
-        free(cmd);
-        return ret;
-    }
-    else if (my_strcmp(ext, "java") == 0) {
-        /* javac file.java && java -cp dir ClassName */
-        char* javac_args[] = { "javac", (char*)file, NULL };
-        executor(javac_args, env);
-
-        const char* slash = strrchr(file, '/');
-        const char* fname = slash ? slash + 1 : file;
-        size_t flen = strlen(fname);
-        char class_name[NAME_MAX];
-        if (flen > 5 && strcmp(fname + flen - 5, ".java") == 0) {
-            memcpy(class_name, fname, flen - 5);
-            class_name[flen - 5] = '\0';
-        } else {
-            printf("run: unexpected java filename '%s'\n", file);
-            return 1;
-        }
-
-        char class_dir[PATH_MAX];
-        if (slash) {
-            snprintf(class_dir, sizeof(class_dir), "%.*s", (int)(slash - file), file);
-        } else {
-            snprintf(class_dir, sizeof(class_dir), ".");
-        }
-
-        /* build java argv (no extra arg forwarding for now) */
-        char* java_args[] = { "java", "-cp", class_dir, class_name, NULL };
-        return executor(java_args, env);
-    } else {
-        printf("run: unsupported extension '.%s'\n", ext);
-        return 1;
-    }
-}
+// ---------------------- run command ----------------------
+// command_run and the runner registry live in src/runner.c
 
 // Function to search for the command in PATH
 char* find_command_in_path(const char* command, char** env)
 {
-    char* path_env = NULL; // Store the PATH value
-    char* path = NULL; // Duplicate of PATH
-    char* token = NULL; // Tokenize dirs from the PATH
-    char full_path[1024]; // BUffer to construct full paths
-
-    // Locate the PATH
-    for (size_t i = 0; env[i]; i++) {
-        if (my_strncmp(env[i], "PATH=", 5) == 0) {
-            path_env = env[i] + 5; // Skip PATH= prefix
-            break;
-        }
-    }    
-    if (path_env == NULL) {
-        return NULL; // No path
-    } 
-
-    // Dupliacte the PATH avoiding modifying the original
-    path = my_strdup(path_env);
-    if(path == NULL) {
-        perror("my_strdup");
-        return NULL;
-    }
-
-    // Split PATH into individual dirs using ':' delimiter
-    token = my_strtok(path, ":");
-    while (token != NULL) {
-        // Constract full path, check for '/'
-        size_t len = my_strlen(token);
-        if (token[len - 1] != '/') {
-            snprintf(full_path, sizeof(full_path), "%s%s%s", token, "/", command);
-        } else {
-            snprintf(full_path, sizeof(full_path), "%s%s", token, command);
-        }
-
-        // Check if the command exists as executable
-        if (access(full_path, X_OK) == 0) {
-            free(path);
-            return my_strdup(full_path); // found commands path
-        }
-
-        token = my_strtok(NULL, ":"); // move to the next dir
+    char full_path[PATH_MAX];
+    if (path_cache_resolve(command, env, full_path, sizeof(full_path)) == -1) {
+        return NULL; // No path, or not found
     }
-
-    free(path);
-    return NULL;
+    return mem_strdup(MEM_EXECUTOR, full_path); // found commands path
 }
 
 // Helper function to count env vars
@@ -320,65 +137,104 @@ int count_env_vars(char** env) {
     return count;
 }
 
-// Function to set an environement variable
-char** command_setenv(char** args, char** env)
+/* The process environment is not ours to free. The first setenv or unsetenv
+   copies it (tagged MEM_ENV); from then on the shell owns the array and
+   every string in it, and each change releases the array it replaces. */
+static char** owned_env = NULL;
+
+/* An owned copy of env with room for extra more entries. Strings are moved
+   when env is already owned and duplicated otherwise. */
+static char** adopt_env(char** env, int extra)
 {
-    if (args[1] == NULL) {
-        printf("Usage:  setenv VAR=value\nor\tsetenv <variable> <value>\n");
-        return env;
-    }
-    
     int env_count = count_env_vars(env);
-    char** new_env = malloc((env_count + 2) * sizeof(char*));
-    if(!new_env) {
+    char** new_env = mem_alloc(MEM_ENV, (env_count + extra + 1) * sizeof(char*));
+    if (!new_env) {
         perror("malloc");
-        return env;
+        return NULL;
     }
 
-    // Copy existing environment variables
-    for (int i = 0; i < env_count; i++)
-    {
-        new_env[i] = my_strdup(env[i]);
+    for (int i = 0; i < env_count; i++) {
+        new_env[i] = env == owned_env ? env[i] : mem_strdup(MEM_ENV, env[i]);
         if (!new_env[i]) {
             perror("strdup");
             for (int j = 0; j < i; j++) {
-                free(new_env[j]);
+                mem_free(new_env[j]);
             }
-            free(new_env);
-            return env;            
+            mem_free(new_env);
+            return NULL;
         }
     }
+    new_env[env_count] = NULL;
+    return new_env;
+}
+
+/* Make new_env the current environment, dropping the array it replaces. */
+static char** replace_env(char** env, char** new_env)
+{
+    if (env == owned_env) mem_free(env);
+    owned_env = new_env;
+    env_index_invalidate();
+    return new_env;
+}
+
+/* Free env at exit if the shell made it. */
+void env_release(char** env)
+{
+    if (!env || env != owned_env) return;
+    for (size_t i = 0; env[i]; i++) {
+        mem_free(env[i]);
+    }
+    mem_free(env);
+    owned_env = NULL;
+}
+
+// Function to set an environement variable
+char** command_setenv(char** args, char** env)
+{
+    if (args[1] == NULL) {
+        printf("Usage:  setenv VAR=value\nor\tsetenv <variable> <value>\n");
+        return env;
+    }
 
     // Determine the format of the uinput and create the new variable
     char* new_var = NULL;
     if(args[2] == NULL) {  // Format Var=value
-        new_var = my_strdup(args[1]);
+        new_var = mem_strdup(MEM_ENV, args[1]);
     } else {
-        new_var = malloc(my_strlen(args[1]) + my_strlen(args[2]) + 2);
+        new_var = mem_alloc(MEM_ENV, my_strlen(args[1]) + my_strlen(args[2]) + 2);
         if (new_var) {
             sprintf(new_var, "%s=%s", args[1], args[2]);
         }
     }
-
     if(!new_var) {
         perror("malloc");
-        for (int i = 0; i < env_count; i++) {
-            free(new_env[i]);
-        }
-        free(new_env);
         return env;
     }
 
-    new_env[env_count] = new_var;
-    new_env[env_count  + 1] = NULL;
+    char** new_env = adopt_env(env, 1);
+    if (!new_env) {
+        mem_free(new_var);
+        return env;
+    }
 
-    // Free the old env array
-    // for (size_t i = 0; env[i]; i++) {
-    //     free(env[i]);
-    // }
-    // free(env);  
+    // Replace an existing definition rather than shadowing it with a second one
+    const char* eq = my_strchr(new_var, '=');
+    size_t name_len = eq ? (size_t)(eq - new_var) : (size_t)my_strlen(new_var);
+    int env_count = count_env_vars(new_env);
+    int slot = env_count;
+    for (int i = 0; i < env_count; i++) {
+        if (my_strncmp(new_env[i], new_var, name_len) == 0 && new_env[i][name_len] == '=') {
+            mem_free(new_env[i]);
+            slot = i;
+            break;
+        }
+    }
 
-    return new_env;
+    new_env[slot] = new_var;
+    if (slot == env_count) {
+        new_env[env_count + 1] = NULL;
+    }
+    return replace_env(env, new_env);
 }
 
 // Function to unset environment variables
@@ -388,30 +244,25 @@ char** command_unsetenv(char** args, char** env){
         return env;
     }
 
-    int env_count = count_env_vars(env);
-    char** new_env = malloc(env_count * sizeof(char*));
-    if(!new_env) {
-        perror("malloc");
-        return env;
-    }
-
-    int j = 0, found = 0;
-    for (int i = 0; i < env_count; i++) { // var=123
-        if (my_strncmp(env[i], args[1], my_strlen(args[1])) == 0 && env[i][my_strlen(args[1])] == '=') {
-            found = 1;
-            free(env[i]); // Free the matching variable
-        } else {
-            new_env[j++] = env[i];
+    size_t name_len = my_strlen(args[1]);
+    int index = -1;
+    for (int i = 0; env[i]; i++) { // var=123
+        if (my_strncmp(env[i], args[1], name_len) == 0 && env[i][name_len] == '=') {
+            index = i;
+            break;
         }
     }
-
-    if (!found) {
+    if (index == -1) {
         printf("Variable %s not found in environment\n", args[1]);
-        free(new_env);
         return env;
     }
 
-    new_env[j] = NULL;
-    // free(env);
-    return new_env;
+    char** new_env = adopt_env(env, 0);
+    if (!new_env) return env;
+
+    mem_free(new_env[index]); // Free the matching variable
+    for (int i = index; new_env[i]; i++) {
+        new_env[i] = new_env[i + 1];
+    }
+    return replace_env(env, new_env);
 }
\ No newline at end of file
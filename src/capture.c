@@ -0,0 +1,286 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <termios.h>
+
+/* Output capture for external commands, enabled by setting EDOSH_CAPTURE
+   (setenv EDOSH_CAPTURE=1). The command's stdout and stderr go to a pty,
+   so it still sees a terminal, and the shell copies everything it reads to
+   the real terminal and into a byte ring. `last` prints a previous output
+   again without rerunning the command.
+
+   The ring starts small on the heap and doubles as needed. Past
+   RING_MEMORY_MAX it moves into an unlinked, sparse temporary file that
+   is mmap'd, so large outputs live in the page cache instead of
+   anonymous memory. At RING_FILE_MAX the oldest bytes are overwritten.
+   Byte positions are absolute (ring_head counts every byte ever stored)
+   and a position p lives at ring[p % ring_cap]. */
+
+#define CAPTURE_RECORDS 32
+#define RING_INITIAL (64 * 1024)
+#define RING_MEMORY_MAX (1024 * 1024)
+#define RING_FILE_MAX (64 * 1024 * 1024)
+
+typedef struct capture_record {
+    char* command;              /* command line, words joined by spaces */
+    uint64_t start;             /* absolute position of the first byte */
+    uint64_t len;
+} capture_record;
+
+static capture_record records[CAPTURE_RECORDS];
+static size_t record_total = 0;     /* records ever started; newest is total - 1 */
+static capture_record* current = NULL;
+
+static char* ring = NULL;
+static size_t ring_cap = 0;
+static int ring_mapped = 0;
+static uint64_t ring_head = 0;
+
+/* Is capture turned on in env? */
+int capture_enabled(char** env)
+{
+    const char* v = env_lookup("EDOSH_CAPTURE", 13, env);
+    return v && *v && my_strcmp(v, "0") != 0;
+}
+
+/* Open a pty pair for a captured child. The slave gets the terminal's size
+   and no output processing, so the bytes read back are what the program
+   wrote. Returns 0 or -1. */
+int capture_open_pty(int* master, int* slave)
+{
+    int m = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (m == -1) return -1;
+
+    char name[64];
+    if (grantpt(m) == -1 || unlockpt(m) == -1 || ptsname_r(m, name, sizeof(name)) != 0) {
+        close(m);
+        return -1;
+    }
+    int s = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (s == -1) {
+        close(m);
+        return -1;
+    }
+
+    struct termios t;
+    if (tcgetattr(s, &t) == 0) {
+        t.c_oflag &= ~OPOST;
+        tcsetattr(s, TCSANOW, &t);
+    }
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) ioctl(s, TIOCSWINSZ, &ws);
+
+    fcntl(m, F_SETFL, fcntl(m, F_GETFL) | O_NONBLOCK);
+    *master = m;
+    *slave = s;
+    return 0;
+}
+
+static capture_record* nth_record(size_t back)
+{
+    if (back == 0 || back > record_total || back > CAPTURE_RECORDS) return NULL;
+    return &records[(record_total - back) % CAPTURE_RECORDS];
+}
+
+/* Absolute position of the oldest byte anything still refers to. */
+static uint64_t oldest_live(void)
+{
+    size_t kept = record_total < CAPTURE_RECORDS ? record_total : CAPTURE_RECORDS;
+    capture_record* oldest = nth_record(kept);
+    return oldest ? oldest->start : ring_head;
+}
+
+static char* alloc_ring(size_t cap, int* mapped)
+{
+    if (cap <= RING_MEMORY_MAX) {
+        *mapped = 0;
+        return malloc(cap);
+    }
+    char path[] = "/tmp/edosh-capture-XXXXXX";
+    int fd = mkostemp(path, O_CLOEXEC);
+    if (fd == -1) return NULL;
+    unlink(path);
+    char* p = MAP_FAILED;
+    if (ftruncate(fd, cap) == 0) {
+        p = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    *mapped = 1;
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void free_ring(char* p, size_t cap, int mapped)
+{
+    if (!p) return;
+    if (mapped) munmap(p, cap);
+    else free(p);
+}
+
+/* Copy absolute range [from, to) out of the ring into dst. */
+static void ring_copy_out(char* dst, uint64_t from, uint64_t to)
+{
+    while (from < to) {
+        size_t pos = from % ring_cap;
+        size_t n = ring_cap - pos;
+        if (n > to - from) n = to - from;
+        memcpy(dst, ring + pos, n);
+        dst += n;
+        from += n;
+    }
+}
+
+/* Make room for n more bytes without dropping live output, if the size
+   limit allows. */
+static void ring_grow(size_t n)
+{
+    uint64_t live = ring_head - oldest_live();
+    if (ring && live + n <= ring_cap) return;
+    if (ring_cap == RING_FILE_MAX) return;
+
+    size_t cap = ring_cap ? ring_cap : RING_INITIAL;
+    while (cap < live + n && cap < RING_FILE_MAX) cap *= 2;
+    if (cap > RING_MEMORY_MAX) cap = RING_FILE_MAX;
+
+    int mapped;
+    char* grown = alloc_ring(cap, &mapped);
+    if (!grown) return;
+
+    /* re-place live bytes at their positions modulo the new size */
+    if (live > ring_cap) live = ring_cap;
+    for (uint64_t p = ring_head - live; p < ring_head; ) {
+        size_t pos = p % cap;
+        size_t chunk = cap - pos;
+        if (chunk > ring_head - p) chunk = ring_head - p;
+        ring_copy_out(grown + pos, p, p + chunk);
+        p += chunk;
+    }
+    free_ring(ring, ring_cap, ring_mapped);
+    ring = grown;
+    ring_cap = cap;
+    ring_mapped = mapped;
+}
+
+static void ring_write(const char* data, size_t n)
+{
+    ring_grow(n);
+    if (!ring) return;
+    if (n > ring_cap) {
+        ring_head += n - ring_cap;
+        data += n - ring_cap;
+        n = ring_cap;
+    }
+    while (n > 0) {
+        size_t pos = ring_head % ring_cap;
+        size_t chunk = ring_cap - pos;
+        if (chunk > n) chunk = n;
+        memcpy(ring + pos, data, chunk);
+        ring_head += chunk;
+        data += chunk;
+        n -= chunk;
+    }
+}
+
+/* Start a record for the command about to run. */
+void capture_begin(char** args)
+{
+    capture_record* r = &records[record_total % CAPTURE_RECORDS];
+    free(r->command);
+
+    strbuf line = {0};
+    for (size_t i = 0; args[i]; i++) {
+        if (i > 0) sb_putc(&line, ' ');
+        sb_append(&line, args[i], my_strlen(args[i]));
+    }
+    sb_putc(&line, '\0');
+
+    r->command = line.data;
+    r->start = ring_head;
+    r->len = 0;
+    record_total++;
+    current = r;
+}
+
+/* Read what the child wrote to the pty master fd, show it and keep a copy. */
+void capture_output(int fd, void* data)
+{
+    (void)data;
+    char buf[16384];
+    while (1) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) return;     /* EAGAIN, or EIO once the slave is closed */
+
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t w = write(STDOUT_FILENO, buf + off, n - off);
+            if (w == -1 && errno == EINTR) continue;
+            if (w <= 0) break;
+            off += w;
+        }
+        ring_write(buf, n);
+        if (current) current->len += n;
+    }
+}
+
+void capture_end(void)
+{
+    current = NULL;
+}
+
+/* last [N] prints the output of the Nth most recent captured command;
+   last -l lists what is kept. */
+int capture_last(char** args, strbuf* out)
+{
+    if (args[1] && my_strcmp(args[1], "-l") == 0) {
+        size_t kept = record_total < CAPTURE_RECORDS ? record_total : CAPTURE_RECORDS;
+        for (size_t back = kept; back >= 1; back--) {
+            capture_record* r = nth_record(back);
+            char line[64];
+            int n = snprintf(line, sizeof(line), "%3zu  %10llu  ", back, (unsigned long long)r->len);
+            if (sb_append(out, line, n) == -1 ||
+                sb_append(out, r->command, my_strlen(r->command)) == -1 ||
+                sb_putc(out, '\n') == -1) return -1;
+        }
+        return 0;
+    }
+
+    size_t back = 1;
+    if (args[1]) {
+        char* end;
+        back = strtoul(args[1], &end, 10);
+        if (*end || back == 0) {
+            fprintf(stderr, "last: usage: last [N] | last -l\n");
+            return -1;
+        }
+    }
+    capture_record* r = nth_record(back);
+    if (!r) {
+        fprintf(stderr, "last: no captured output%s\n",
+                record_total ? " that far back" : " (setenv EDOSH_CAPTURE=1 to enable)");
+        return -1;
+    }
+
+    uint64_t from = r->start;
+    uint64_t to = r->start + r->len;
+    if (ring_head - from > ring_cap) {
+        from = ring_head - ring_cap;
+        fprintf(stderr, "last: output truncated, showing the last %llu bytes\n",
+                (unsigned long long)(to > from ? to - from : 0));
+        if (from > to) from = to;
+    }
+    if (sb_reserve(out, to - from) == -1) return -1;
+    ring_copy_out(out->data + out->len, from, to);
+    out->len += to - from;
+    return 0;
+}
+
+int command_last(char** args)
+{
+    strbuf out = {0};
+    int r = capture_last(args, &out);
+    if (r == 0 && out.len > 0) fwrite(out.data, 1, out.len, stdout);
+    sb_free(&out);
+    return r == 0 ? 0 : 1;
+}
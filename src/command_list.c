@@ -0,0 +1,157 @@
+#include "my_shell.h"
+#include <string.h>
+
+/* Status of the most recently executed command, exposed as $? */
+static int last_status = 0;
+
+int last_exit_status(void)
+{
+    return last_status;
+}
+
+/* Append a node for input[begin..end) joined to the previous node by op.
+   Returns the new node, or NULL on allocation failure. */
+static command_node* append_node(command_node*** tail, const char* input, size_t begin, size_t end, list_op op)
+{
+    char* text = mem_alloc(MEM_PARSER, end - begin + 1);
+    if (!text) { perror("malloc"); return NULL; }
+    memcpy(text, input + begin, end - begin);
+    text[end - begin] = '\0';
+
+    command_node* node = mem_alloc(MEM_PARSER, sizeof(command_node));
+    if (!node) { perror("malloc"); mem_free(text); return NULL; }
+    node->args = parse_input(text);
+    node->op = op;
+    node->next = NULL;
+    mem_free(text);
+    if (!node->args) {
+        mem_free(node);
+        return NULL;
+    }
+
+    **tail = node;
+    *tail = &node->next;
+    return node;
+}
+
+static int node_is_empty(const command_node* node)
+{
+    return !node->args || !node->args[0];
+}
+
+/* Split a line into commands joined by unquoted ';', '&&' and '||'.
+   Quotes, backslash escapes and $(...) are honored the same way parse_input
+   does, so operators inside them stay part of the command.
+   Returns NULL for an empty line or a syntax error. */
+command_node* parse_command_list(const char* input)
+{
+    if (!input) return NULL;
+
+    command_node* head = NULL;
+    command_node** tail = &head;
+    list_op op = LIST_SEQ;
+    size_t begin = 0;
+    char quote = 0;
+
+    for (size_t i = 0; ; i++) {
+        char c = input[i];
+
+        /* operators inside $(...) belong to the substituted command */
+        if (c == '$' && input[i + 1] == '(' && quote != '\'') {
+            const char* end = skip_substitution(&input[i]);
+            if (end) {
+                i = end - input - 1;
+                continue;
+            }
+        }
+        if (quote && c) {
+            if (c == quote) quote = 0;
+            else if (c == '\\' && quote == '"' && input[i + 1]) i++;
+            continue;
+        }
+        if (c == '\'' || c == '"') { quote = c; continue; }
+        if (c == '\\' && input[i + 1]) { i++; continue; }
+
+        list_op next_op;
+        size_t op_len;
+        if (c == ';') { next_op = LIST_SEQ; op_len = 1; }
+        else if (c == '&' && input[i + 1] == '&') { next_op = LIST_AND; op_len = 2; }
+        else if (c == '|' && input[i + 1] == '|') { next_op = LIST_OR; op_len = 2; }
+        else if (c == '\0') { next_op = LIST_SEQ; op_len = 0; }
+        else continue;
+
+        command_node* node = append_node(&tail, input, begin, i, op);
+        if (!node) {
+            free_command_list(head);
+            return NULL;
+        }
+
+        /* an empty command is only allowed at the very end after ';' */
+        if (node_is_empty(node) && (c != '\0' || op != LIST_SEQ)) {
+            fprintf(stderr, "edosh: syntax error near '%.*s'\n", op_len ? (int)op_len : 7,
+                    op_len ? &input[i] : "newline");
+            free_command_list(head);
+            return NULL;
+        }
+
+        if (c == '\0') break;
+        op = next_op;
+        i += op_len - 1;
+        begin = i + 1;
+    }
+
+    /* a line containing only whitespace yields nothing to run */
+    if (head && !head->next && node_is_empty(head)) {
+        free_command_list(head);
+        return NULL;
+    }
+    return head;
+}
+
+void free_command_list(command_node* list)
+{
+    while (list) {
+        command_node* next = list->next;
+        free_tokens(list->args);
+        mem_free(list);
+        list = next;
+    }
+}
+
+/* Run one command joined to the previous one by op, which '&&' and '||'
+   may skip. Literal words need no expansion (compiled scripts know which
+   are, script.c) and are run as they are.
+   Returns the status, or -1 if the shell should exit. */
+int run_command(char** words, list_op op, int literal, char*** env)
+{
+    if (op == LIST_AND && last_status != 0) return last_status;
+    if (op == LIST_OR && last_status == 0) return last_status;
+    if (!words || !words[0]) return last_status;
+
+    /* expand at run time so $? sees the previous command's status */
+    subst_status_reset();
+    char** argv = literal ? words : expand_args(words, *env);
+    if (!argv) {
+        last_status = 1;
+        return last_status;
+    }
+    /* a command of nothing but substitutions has the last one's status */
+    int status = argv[0] ? shell_builts(argv, env) : subst_last_status();
+    if (argv != words) mem_free(argv);
+    glob_cache_clear();
+    if (status == -1) return -1;
+    last_status = status;
+    return status;
+}
+
+/* Run each command in turn. '&&' skips a command when the previous status
+   is non-zero and '||' skips it when the status is zero; both operators have
+   equal precedence and associate left, as in POSIX sh.
+   Returns the status of the last command run, or -1 if the shell should exit. */
+int run_command_list(command_node* list, char*** env)
+{
+    for (command_node* node = list; node; node = node->next) {
+        if (run_command(node->args, node->op, 0, env) == -1) return -1;
+    }
+    return last_status;
+}
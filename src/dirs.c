@@ -0,0 +1,666 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* cd, pushd, popd and z.
+
+   The shell keeps a logical working directory: cd resolves . and ..
+   against it by text, like cd -L in other shells, and exports it as PWD.
+   The prompt and pwd read it from here instead of calling getcwd.
+
+   Every successful directory change is counted in a frecency database,
+   a small binary file mapped read-only at startup and replaced with a
+   rename after each visit. Beside the entries it stores a trigram index:
+   z looks up the rarest trigram of its longest fragment and only checks
+   the entries on that posting list. */
+
+#define DB_MAGIC 0x317a6465u    /* "edz1" */
+#define DB_VERSION 1
+#define RANK_VISIT 100          /* rank added per visit */
+#define RANK_LIMIT (5000 * RANK_VISIT)  /* total rank that triggers aging */
+#define MIN_BUCKETS 64
+#define MAX_BUCKETS 16384
+
+/* The file is a header, then the entries, the bucket starts, the postings
+   and the paths. All offsets are relative to their own section, so the
+   mapping is used in place at any address. */
+typedef struct db_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;             /* entries */
+    uint32_t buckets;           /* trigram buckets, a power of two */
+    uint32_t postings;          /* entry numbers on all posting lists */
+    uint32_t strings;           /* bytes of NUL-terminated paths */
+} db_header;
+
+typedef struct db_entry {
+    uint32_t path;              /* offset into the paths */
+    uint32_t len;
+    uint32_t rank;              /* RANK_VISIT per visit, less after aging */
+    uint32_t last;              /* time of the last visit */
+} db_entry;
+
+typedef struct dir_db {
+    char file[PATH_MAX];        /* "" when there is nowhere to keep it */
+    void* map;
+    size_t size;
+    const db_entry* entries;
+    const uint32_t* starts;     /* bucket b is postings[starts[b], starts[b+1]) */
+    const uint32_t* postings;
+    const char* strings;
+    uint32_t count, buckets;
+    dev_t dev;                  /* file the mapping came from, to notice */
+    ino_t ino;                  /* other shells replacing it */
+    struct timespec mtime;
+} dir_db;
+
+static dir_db db;
+
+static char* pwd = NULL;        /* logical working directory (MEM_DIRS) */
+static char* oldpwd = NULL;
+static char** stack = NULL;     /* pushd stack, top at the end */
+static size_t stack_len = 0, stack_cap = 0;
+
+/* ---------------------- logical paths ---------------------- */
+
+/* Write target, resolved against dir by text, to out: no ".", ".." or
+   empty components and no trailing slash. */
+static int join_path(const char* dir, const char* target, char* out, size_t size)
+{
+    size_t n = 0;               /* out[0, n) is normalised; "" stands for "/" */
+    const char* p = target;
+    if (*target != '/') {
+        if (!dir) return -1;
+        p = dir;
+    }
+    for (int pass = *target == '/'; pass < 2; pass++, p = target) {
+        while (*p) {
+            while (*p == '/') p++;
+            const char* end = p;
+            while (*end && *end != '/') end++;
+            size_t len = end - p;
+            if (len == 0 || (len == 1 && p[0] == '.')) {
+                /* nothing */
+            } else if (len == 2 && p[0] == '.' && p[1] == '.') {
+                while (n > 0 && out[n - 1] != '/') n--;
+                if (n > 0) n--;
+            } else {
+                if (n + 1 + len >= size) return -1;
+                out[n++] = '/';
+                memcpy(out + n, p, len);
+                n += len;
+            }
+            p = end;
+        }
+    }
+    if (n == 0) out[n++] = '/';
+    out[n] = '\0';
+    return 0;
+}
+
+static int same_file(const char* a, const char* b)
+{
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 &&
+           sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+/* The logical working directory, or NULL if it cannot be found. Starts
+   as $PWD when that names the current directory, as other shells do. */
+const char* dirs_pwd(void)
+{
+    if (pwd) return pwd;
+    char path[PATH_MAX];
+    const char* env_pwd = getenv("PWD");
+    if (env_pwd && *env_pwd == '/' && join_path(NULL, env_pwd, path, sizeof(path)) == 0 &&
+        same_file(path, ".")) {
+        pwd = mem_strdup(MEM_DIRS, path);
+    } else {
+        char* cwd = getcwd(NULL, 0);
+        if (cwd) pwd = mem_strdup(MEM_DIRS, cwd);
+        free(cwd);
+    }
+    return pwd;
+}
+
+/* ---------------------- frecency database ---------------------- */
+
+static unsigned char fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+static uint32_t trigram_bucket(const char* s, uint32_t buckets)
+{
+    uint32_t t = (uint32_t)fold(s[0]) << 16 | (uint32_t)fold(s[1]) << 8 | fold(s[2]);
+    return (t * 2654435761u) >> 12 & (buckets - 1);
+}
+
+static void db_unmap(void)
+{
+    if (db.map) munmap(db.map, db.size);
+    db.map = NULL;
+    db.size = 0;
+    db.count = 0;
+    db.buckets = 0;
+    db.ino = 0;
+}
+
+/* Map the database in fd, or leave it empty if the file is not a
+   database this shell can read. */
+static void db_map_fd(int fd)
+{
+    db_unmap();
+    struct stat st;
+    if (fstat(fd, &st) == -1) return;
+    db.dev = st.st_dev;
+    db.ino = st.st_ino;
+    db.mtime = st.st_mtim;
+    if ((size_t)st.st_size < sizeof(db_header)) return;
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return;
+    const db_header* h = map;
+    size_t size = st.st_size;
+    if (h->magic != DB_MAGIC || h->version != DB_VERSION || h->buckets == 0 ||
+        (h->buckets & (h->buckets - 1)) || h->buckets > MAX_BUCKETS ||
+        size != sizeof(db_header) + (size_t)h->count * sizeof(db_entry) +
+                (size_t)(h->buckets + 1 + h->postings) * sizeof(uint32_t) + h->strings) {
+        munmap(map, size);
+        return;
+    }
+
+    const db_entry* entries = (const db_entry*)(h + 1);
+    const uint32_t* starts = (const uint32_t*)(entries + h->count);
+    const uint32_t* postings = starts + h->buckets + 1;
+    const char* strings = (const char*)(postings + h->postings);
+    /* checked once here so lookups can trust every offset */
+    int ok = starts[0] == 0 && starts[h->buckets] == h->postings;
+    for (uint32_t b = 0; ok && b < h->buckets; b++) ok = starts[b] <= starts[b + 1];
+    for (uint32_t i = 0; ok && i < h->postings; i++) ok = postings[i] < h->count;
+    for (uint32_t i = 0; ok && i < h->count; i++) {
+        ok = entries[i].path < h->strings && entries[i].len < h->strings - entries[i].path &&
+             strings[entries[i].path + entries[i].len] == '\0';
+    }
+    if (!ok) {
+        munmap(map, size);
+        return;
+    }
+
+    db.map = map;
+    db.size = size;
+    db.entries = entries;
+    db.starts = starts;
+    db.postings = postings;
+    db.strings = strings;
+    db.count = h->count;
+    db.buckets = h->buckets;
+}
+
+/* Map the file again if another shell has replaced it since. */
+static void db_refresh(void)
+{
+    struct stat st;
+    if (stat(db.file, &st) == -1) {
+        db_unmap();
+        return;
+    }
+    if (st.st_dev == db.dev && st.st_ino == db.ino &&
+        st.st_mtim.tv_sec == db.mtime.tv_sec && st.st_mtim.tv_nsec == db.mtime.tv_nsec) {
+        return;
+    }
+    int fd = open(db.file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        db_unmap();
+        return;
+    }
+    db_map_fd(fd);
+    close(fd);
+}
+
+/* Find where the database lives and map it. */
+void dirs_load(char** env)
+{
+    const char* xdg = env_lookup("XDG_DATA_HOME", 13, env);
+    const char* home = env_lookup("HOME", 4, env);
+    if (xdg && *xdg) snprintf(db.file, sizeof(db.file), "%s/edosh/dirs", xdg);
+    else if (home && *home) snprintf(db.file, sizeof(db.file), "%s/.local/share/edosh/dirs", home);
+    else return;
+    db_refresh();
+}
+
+/* Create the directories leading to the database file. */
+static void make_parents(const char* file)
+{
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", file);
+    for (char* p = dir + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(dir, 0700);
+        *p = '/';
+    }
+}
+
+typedef struct db_record {
+    const char* path;
+    uint32_t len;
+    uint32_t rank;
+    uint32_t last;
+} db_record;
+
+/* Lay out records as a database file image (MEM_DIRS). */
+static char* build_image(const db_record* rec, uint32_t count, size_t* size)
+{
+    uint32_t buckets = MIN_BUCKETS;
+    while (buckets < count * 2 && buckets < MAX_BUCKETS) buckets *= 2;
+
+    /* each entry goes on the list of every distinct bucket its trigrams hit */
+    uint32_t* starts = mem_alloc(MEM_DIRS, (buckets + 1) * sizeof(uint32_t));
+    uint32_t* seen = mem_alloc(MEM_DIRS, buckets * sizeof(uint32_t));
+    if (!starts || !seen) {
+        mem_free(starts);
+        mem_free(seen);
+        return NULL;
+    }
+    memset(starts, 0, (buckets + 1) * sizeof(uint32_t));
+    memset(seen, 0xff, buckets * sizeof(uint32_t));
+    uint32_t postings = 0;
+    size_t strings = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint32_t j = 0; j + 3 <= rec[i].len; j++) {
+            uint32_t b = trigram_bucket(rec[i].path + j, buckets);
+            if (seen[b] == i) continue;
+            seen[b] = i;
+            starts[b + 1]++;
+            postings++;
+        }
+        strings += rec[i].len + 1;
+    }
+    for (uint32_t b = 0; b < buckets; b++) starts[b + 1] += starts[b];
+
+    *size = sizeof(db_header) + (size_t)count * sizeof(db_entry) +
+            (size_t)(buckets + 1 + postings) * sizeof(uint32_t) + strings;
+    char* image = mem_alloc(MEM_DIRS, *size);
+    if (!image) {
+        mem_free(starts);
+        mem_free(seen);
+        return NULL;
+    }
+    db_header* h = (db_header*)image;
+    h->magic = DB_MAGIC;
+    h->version = DB_VERSION;
+    h->count = count;
+    h->buckets = buckets;
+    h->postings = postings;
+    h->strings = strings;
+    db_entry* entries = (db_entry*)(h + 1);
+    uint32_t* out_starts = (uint32_t*)(entries + count);
+    uint32_t* out_postings = out_starts + buckets + 1;
+    char* out_strings = (char*)(out_postings + postings);
+    memcpy(out_starts, starts, (buckets + 1) * sizeof(uint32_t));
+
+    /* starts[b] now serves as the fill cursor of bucket b */
+    memset(seen, 0xff, buckets * sizeof(uint32_t));
+    uint32_t off = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint32_t j = 0; j + 3 <= rec[i].len; j++) {
+            uint32_t b = trigram_bucket(rec[i].path + j, buckets);
+            if (seen[b] == i) continue;
+            seen[b] = i;
+            out_postings[starts[b]++] = i;
+        }
+        entries[i].path = off;
+        entries[i].len = rec[i].len;
+        entries[i].rank = rec[i].rank;
+        entries[i].last = rec[i].last;
+        memcpy(out_strings + off, rec[i].path, rec[i].len + 1);
+        off += rec[i].len + 1;
+    }
+    mem_free(starts);
+    mem_free(seen);
+    return image;
+}
+
+/* Count a visit to path: write a new file beside the database, map it
+   and rename it into place, so readers only ever see a whole file. */
+static void db_visit(const char* path)
+{
+    if (!db.file[0]) return;
+    db_refresh();
+
+    db_record* rec = mem_alloc(MEM_DIRS, (db.count + 1) * sizeof(db_record));
+    if (!rec) return;
+    uint32_t now = (uint32_t)time(NULL);
+    uint32_t len = strlen(path);
+    uint32_t count = 0;
+    uint64_t total = 0;
+    int found = 0;
+    for (uint32_t i = 0; i < db.count; i++) {
+        const db_entry* e = &db.entries[i];
+        db_record r = { db.strings + e->path, e->len, e->rank, e->last };
+        if (!found && r.len == len && memcmp(r.path, path, len) == 0) {
+            r.rank += RANK_VISIT;
+            r.last = now;
+            found = 1;
+        }
+        total += r.rank;
+        rec[count++] = r;
+    }
+    if (!found) {
+        rec[count++] = (db_record){ path, len, RANK_VISIT, now };
+        total += RANK_VISIT;
+    }
+    /* age everything once the ranks add up to too much, forgetting what
+       has not been visited lately */
+    if (total > RANK_LIMIT) {
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            rec[i].rank = rec[i].rank / 10 * 9;
+            if (rec[i].rank >= RANK_VISIT) rec[kept++] = rec[i];
+        }
+        count = kept;
+    }
+
+    size_t size;
+    char* image = build_image(rec, count, &size);
+    mem_free(rec);
+    if (!image) return;
+
+    char tmp[PATH_MAX + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", db.file, (int)getpid());
+    make_parents(db.file);
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd != -1) {
+        size_t done = 0;
+        while (done < size) {
+            ssize_t w = write(fd, image + done, size - done);
+            if (w <= 0) break;
+            done += w;
+        }
+        if (done == size && rename(tmp, db.file) == 0) {
+            db_map_fd(fd);
+        } else {
+            unlink(tmp);
+        }
+        close(fd);
+    }
+    mem_free(image);
+}
+
+/* z's score: visits, weighted by how recent the last one was. */
+static double frecency(const db_entry* e, time_t now)
+{
+    double rank = (double)e->rank / RANK_VISIT;
+    double age = difftime(now, e->last);
+    if (age < 3600) return rank * 4;
+    if (age < 86400) return rank * 2;
+    if (age < 7 * 86400) return rank / 2;
+    return rank / 4;
+}
+
+/* Whether every fragment occurs in path, in order, ignoring ASCII case. */
+static int fragments_match(const char* path, uint32_t len, char** frags)
+{
+    uint32_t at = 0;
+    for (size_t f = 0; frags[f]; f++) {
+        size_t n = strlen(frags[f]);
+        uint32_t i = at;
+        for (; i + n <= len; i++) {
+            size_t k = 0;
+            while (k < n && fold(path[i + k]) == fold(frags[f][k])) k++;
+            if (k == n) break;
+        }
+        if (i + n > len) return 0;
+        at = i + n;
+    }
+    return 1;
+}
+
+/* The posting list to check for frags: the shortest one among the
+   trigrams of the longest fragment. Returns 0 when every entry has to be
+   checked, which is when no fragment has three bytes. */
+static int candidates(char** frags, const uint32_t** list, uint32_t* n)
+{
+    const char* longest = NULL;
+    size_t best_len = 2;
+    for (size_t f = 0; frags[f]; f++) {
+        size_t len = strlen(frags[f]);
+        if (len > best_len) {
+            longest = frags[f];
+            best_len = len;
+        }
+    }
+    if (!longest || db.count == 0) return 0;
+    *n = UINT32_MAX;
+    for (size_t j = 0; j + 3 <= best_len; j++) {
+        uint32_t b = trigram_bucket(longest + j, db.buckets);
+        uint32_t size = db.starts[b + 1] - db.starts[b];
+        if (size < *n) {
+            *n = size;
+            *list = db.postings + db.starts[b];
+        }
+    }
+    return 1;
+}
+
+/* ---------------------- changing directory ---------------------- */
+
+static void export_pwd(char*** env)
+{
+    char* args[] = { "setenv", "PWD", pwd, NULL };
+    *env = command_setenv(args, *env);
+    if (oldpwd) {
+        args[1] = "OLDPWD";
+        args[2] = oldpwd;
+        *env = command_setenv(args, *env);
+    }
+}
+
+/* Change to target, keeping the logical path when it reaches the same
+   place, and fall back to following target physically. */
+static int change_dir(const char* name, const char* target, char*** env)
+{
+    char path[PATH_MAX];
+    char* next = NULL;
+    if (join_path(dirs_pwd(), target, path, sizeof(path)) == 0 && chdir(path) == 0) {
+        next = mem_strdup(MEM_DIRS, path);
+    } else if (chdir(target) == 0) {
+        char* cwd = getcwd(NULL, 0);
+        if (cwd) next = mem_strdup(MEM_DIRS, cwd);
+        free(cwd);
+    } else {
+        fprintf(stderr, "%s: %s: %s\n", name, target, strerror(errno));
+        return 1;
+    }
+    watch_chdir();
+    if (!next) {
+        perror(name);
+        return 1;
+    }
+    mem_free(oldpwd);
+    oldpwd = pwd;
+    pwd = next;
+    export_pwd(env);
+    db_visit(pwd);
+    return 0;
+}
+
+// cd [path], cd - (previous dir); cd with no argument goes to the top, /
+int command_cd(char** args, char*** env)
+{
+    const char* target = args[1] ? args[1] : "/";
+    int dash = args[1] && strcmp(args[1], "-") == 0;
+    if (dash) {
+        target = oldpwd ? oldpwd : env_lookup("OLDPWD", 6, *env);
+        if (!target || !*target) {
+            fprintf(stderr, "cd: OLDPWD not set\n");
+            return 1;
+        }
+    }
+    /* target may be oldpwd, which change_dir hands on */
+    char copy[PATH_MAX];
+    snprintf(copy, sizeof(copy), "%s", target);
+    int r = change_dir("cd", copy, env);
+    if (r == 0 && dash) printf("%s\n", pwd);
+    return r;
+}
+
+static void print_stack(void)
+{
+    printf("%s", pwd);
+    for (size_t i = stack_len; i > 0; i--) printf(" %s", stack[i - 1]);
+    printf("\n");
+}
+
+// pushd <dir> saves the current directory and changes to dir;
+// pushd alone swaps the current directory with the saved one
+int command_pushd(char** args, char*** env)
+{
+    if (!args[1] && stack_len == 0) {
+        fprintf(stderr, "pushd: no other directory\n");
+        return 1;
+    }
+    if (stack_len == stack_cap) {
+        size_t cap = stack_cap ? stack_cap * 2 : 8;
+        char** grown = mem_realloc(MEM_DIRS, stack, cap * sizeof(char*));
+        if (!grown) {
+            perror("pushd");
+            return 1;
+        }
+        stack = grown;
+        stack_cap = cap;
+    }
+    const char* from = dirs_pwd();
+    char* saved = from ? mem_strdup(MEM_DIRS, from) : NULL;
+    if (!saved) {
+        fprintf(stderr, "pushd: current directory unknown\n");
+        return 1;
+    }
+    char target[PATH_MAX];
+    snprintf(target, sizeof(target), "%s", args[1] ? args[1] : stack[stack_len - 1]);
+    if (change_dir("pushd", target, env) != 0) {
+        mem_free(saved);
+        return 1;
+    }
+    if (args[1]) {
+        stack[stack_len++] = saved;
+    } else {
+        mem_free(stack[stack_len - 1]);
+        stack[stack_len - 1] = saved;
+    }
+    print_stack();
+    return 0;
+}
+
+int command_popd(char** args, char*** env)
+{
+    (void)args;
+    if (stack_len == 0) {
+        fprintf(stderr, "popd: directory stack empty\n");
+        return 1;
+    }
+    if (change_dir("popd", stack[stack_len - 1], env) != 0) return 1;
+    mem_free(stack[--stack_len]);
+    print_stack();
+    return 0;
+}
+
+static int compare_scores(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/* z -l: every match with its score, best first. */
+static int list_matches(char** frags)
+{
+    const uint32_t* list = NULL;
+    uint32_t n = db.count;
+    int indexed = candidates(frags, &list, &n);
+    /* pairs of (score, entry) */
+    double* rows = mem_alloc(MEM_DIRS, (n ? n : 1) * 2 * sizeof(double));
+    if (!rows) {
+        perror("z");
+        return 1;
+    }
+    time_t now = time(NULL);
+    uint32_t count = 0;
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t i = indexed ? list[k] : k;
+        const db_entry* e = &db.entries[i];
+        if (!fragments_match(db.strings + e->path, e->len, frags)) continue;
+        rows[count * 2] = frecency(e, now);
+        rows[count * 2 + 1] = i;
+        count++;
+    }
+    qsort(rows, count, 2 * sizeof(double), compare_scores);
+    for (uint32_t k = 0; k < count; k++) {
+        const db_entry* e = &db.entries[(uint32_t)rows[k * 2 + 1]];
+        printf("%10.1f  %s\n", rows[k * 2], db.strings + e->path);
+    }
+    mem_free(rows);
+    return count ? 0 : 1;
+}
+
+// z <fragment...> goes to the most frecent directory matching every
+// fragment; z -l lists the matches
+int command_z(char** args, char*** env)
+{
+    int list = args[1] && strcmp(args[1], "-l") == 0;
+    char** frags = args + 1 + list;
+    if (!list && !*frags) {
+        printf("Usage: z [-l] <fragment...>\n");
+        return 1;
+    }
+    if (db.file[0]) db_refresh();
+    if (list) return list_matches(frags);
+
+    const uint32_t* candidates_list = NULL;
+    uint32_t n = db.count;
+    int indexed = candidates(frags, &candidates_list, &n);
+    time_t now = time(NULL);
+    const char* here = dirs_pwd();
+    const db_entry* best = NULL;
+    double best_score = 0;
+    for (uint32_t k = 0; k < n; k++) {
+        const db_entry* e = &db.entries[indexed ? candidates_list[k] : k];
+        const char* path = db.strings + e->path;
+        if (!fragments_match(path, e->len, frags)) continue;
+        double score = frecency(e, now);
+        if (best && score <= best_score) continue;
+        if (here && strcmp(path, here) == 0) continue;
+        /* only directories that still exist can win */
+        struct stat st;
+        if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) continue;
+        best = e;
+        best_score = score;
+    }
+    if (!best) {
+        fprintf(stderr, "z: no match\n");
+        return 1;
+    }
+    /* the visit below replaces the mapping best points into */
+    char target[PATH_MAX];
+    snprintf(target, sizeof(target), "%s", db.strings + best->path);
+    return change_dir("z", target, env);
+}
+
+/* Unmap the database and drop the directory state at exit. */
+void dirs_release(void)
+{
+    db_unmap();
+    for (size_t i = 0; i < stack_len; i++) mem_free(stack[i]);
+    mem_free(stack);
+    stack = NULL;
+    stack_len = stack_cap = 0;
+    mem_free(pwd);
+    mem_free(oldpwd);
+    pwd = oldpwd = NULL;
+}
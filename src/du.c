@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include "walk.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+
+/* du on the parallel walker (walk.c). Sizes are allocated blocks, shown in
+   KiB as du does by default; a file with several hard links is counted
+   once. Directory lines come out as each directory finishes, so a
+   directory always follows everything inside it, but the order of
+   siblings depends on which thread got there first.
+
+   Supported: -s -a -h -c. Other options run the system du. */
+
+#define DU_FLUSH_AT 65536
+
+/* (dev, ino) of files with more than one link, so each is counted once */
+typedef struct inode_set {
+    pthread_mutex_t lock;
+    unsigned long long* keys;   /* dev and ino pairs; 0,0 is empty */
+    size_t count, cap;          /* cap in pairs, a power of two */
+} inode_set;
+
+typedef struct du_ctx {
+    int summarize;              /* -s: only the operands */
+    int all;                    /* -a: files as well as directories */
+    int human;                  /* -h */
+    unsigned long long root_total;  /* set when the operand finishes */
+    atomic_int status;
+    inode_set seen;
+    pthread_mutex_t out_lock;
+    strbuf out;
+} du_ctx;
+
+static unsigned long long mix(unsigned long long x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Returns 1 if (dev, ino) was new, 0 if it was already there. */
+static int inode_set_add(inode_set* set, unsigned long long dev, unsigned long long ino)
+{
+    dev += 1;                   /* keep 0,0 free as the empty marker */
+    pthread_mutex_lock(&set->lock);
+    if ((set->count + 1) * 2 > set->cap) {
+        size_t cap = set->cap ? set->cap * 2 : 1024;
+        unsigned long long* keys = calloc(cap * 2, sizeof(unsigned long long));
+        if (!keys) {
+            pthread_mutex_unlock(&set->lock);
+            return 1;           /* count it again rather than fail */
+        }
+        for (size_t i = 0; i < set->cap; i++) {
+            if (!set->keys[i * 2]) continue;
+            size_t j = mix(set->keys[i * 2] ^ set->keys[i * 2 + 1]) & (cap - 1);
+            while (keys[j * 2]) j = (j + 1) & (cap - 1);
+            keys[j * 2] = set->keys[i * 2];
+            keys[j * 2 + 1] = set->keys[i * 2 + 1];
+        }
+        free(set->keys);
+        set->keys = keys;
+        set->cap = cap;
+    }
+    size_t j = mix(dev ^ ino) & (set->cap - 1);
+    int added = 1;
+    while (set->keys[j * 2]) {
+        if (set->keys[j * 2] == dev && set->keys[j * 2 + 1] == ino) {
+            added = 0;
+            break;
+        }
+        j = (j + 1) & (set->cap - 1);
+    }
+    if (added) {
+        set->keys[j * 2] = dev;
+        set->keys[j * 2 + 1] = ino;
+        set->count++;
+    }
+    pthread_mutex_unlock(&set->lock);
+    return added;
+}
+
+static void du_print(du_ctx* c, unsigned long long blocks, const char* path)
+{
+    char size[32];
+    if (c->human) format_size_human(size, sizeof(size), blocks * 512);
+    else snprintf(size, sizeof(size), "%llu", (blocks + 1) / 2);
+
+    pthread_mutex_lock(&c->out_lock);
+    sb_append(&c->out, size, my_strlen(size));
+    sb_putc(&c->out, '\t');
+    sb_append(&c->out, path, my_strlen(path));
+    sb_putc(&c->out, '\n');
+    if (c->out.len >= DU_FLUSH_AT) {
+        fwrite(c->out.data, 1, c->out.len, stdout);
+        c->out.len = 0;
+    }
+    pthread_mutex_unlock(&c->out_lock);
+}
+
+static void du_entry(void* data, walk_dir* in, int dirfd, const char* name,
+                     const struct statx* st, walk_dir* child)
+{
+    (void)dirfd;
+    du_ctx* c = data;
+    if (st->stx_nlink > 1 && !S_ISDIR(st->stx_mode) &&
+        !inode_set_add(&c->seen, makedev(st->stx_dev_major, st->stx_dev_minor), st->stx_ino)) {
+        return;
+    }
+    if (child) {
+        atomic_fetch_add(&child->total, st->stx_blocks);
+    } else if (in) {
+        atomic_fetch_add(&in->total, st->stx_blocks);
+        if (c->all && !c->summarize) {
+            size_t plen = my_strlen(in->path);
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s%s%s", in->path,
+                     plen && in->path[plen - 1] == '/' ? "" : "/", name);
+            du_print(c, st->stx_blocks, path);
+        }
+    }
+}
+
+static void du_leave(void* data, walk_dir* dir)
+{
+    du_ctx* c = data;
+    unsigned long long blocks = atomic_load(&dir->total);
+    if (dir->depth == 0) c->root_total = blocks;
+    if (!c->summarize || dir->depth == 0) du_print(c, blocks, dir->path);
+}
+
+static void du_error(void* data, const char* path, int err)
+{
+    du_ctx* c = data;
+    fprintf(stderr, "du: cannot read directory '%s': %s\n", path, strerror(err));
+    atomic_store(&c->status, 1);
+}
+
+// du [-sahc] [path...]
+int command_du(char** args, char** env)
+{
+    du_ctx c;
+    memset(&c, 0, sizeof(c));
+    int total = 0;
+    int i = 1;
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (my_strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char* f = args[i] + 1; *f; f++) {
+            if (*f == 's') c.summarize = 1;
+            else if (*f == 'a') c.all = 1;
+            else if (*f == 'h') c.human = 1;
+            else if (*f == 'c') total = 1;
+            else return executor(args, env);
+        }
+    }
+    if (c.summarize && c.all) {
+        fprintf(stderr, "du: cannot both summarize and show all entries\n");
+        return 1;
+    }
+
+    pthread_mutex_init(&c.seen.lock, NULL);
+    pthread_mutex_init(&c.out_lock, NULL);
+    fflush(stdout);
+
+    char* dot[] = { ".", NULL };
+    char** operands = args[i] ? &args[i] : dot;
+    unsigned long long grand = 0;
+    int status = 0;
+    for (size_t k = 0; operands[k]; k++) {
+        struct stat st;
+        if (lstat(operands[k], &st) == -1) {
+            fprintf(stderr, "du: cannot access '%s': %s\n", operands[k], strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (!S_ISDIR(st.st_mode)) {
+            if (st.st_nlink <= 1 || inode_set_add(&c.seen, st.st_dev, st.st_ino)) {
+                du_print(&c, st.st_blocks, operands[k]);
+                grand += st.st_blocks;
+            }
+            continue;
+        }
+
+        walk_ops ops = {
+            .mask = STATX_TYPE | STATX_BLOCKS | STATX_NLINK | STATX_INO,
+            .entry = du_entry,
+            .leave = du_leave,
+            .error = du_error,
+            .data = &c,
+        };
+        c.root_total = 0;
+        if (walk_tree(operands[k], &ops, 0) == -1) {
+            status = 130;
+            break;
+        }
+        grand += c.root_total;
+    }
+    if (total && status != 130) du_print(&c, grand, "total");
+
+    if (c.out.len) fwrite(c.out.data, 1, c.out.len, stdout);
+    fflush(stdout);
+    sb_free(&c.out);
+    free(c.seen.keys);
+    pthread_mutex_destroy(&c.seen.lock);
+    pthread_mutex_destroy(&c.out_lock);
+    if (status == 0) status = atomic_load(&c.status);
+    return status;
+}
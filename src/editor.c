@@ -0,0 +1,620 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+/* The line editor's buffer and display.
+
+   The text lives in a gap buffer: buf[0, gap) is the text before the
+   cursor, buf[gap_end, cap) the text after it, and the hole between them
+   is where typing goes, so inserting at the cursor only ever touches the
+   byte being inserted. Moving the cursor moves the gap.
+
+   The input can span several lines: Enter on an unclosed quote, an
+   unclosed $( or a trailing backslash adds a newline instead of running
+   the command, and each continuation line is drawn after CONT_PROMPT.
+
+   Text is UTF-8 and the cursor moves by grapheme: a character together
+   with the combining marks, joiners and modifiers that follow it, or a
+   pair of regional indicators (a flag). Widths come from utf8.c.
+
+   The display is kept as a position (row below the prompt's first row,
+   column) that the terminal cursor is known to be at, plus the text
+   offset each screen row starts at. Finding the screen position of an
+   offset is a binary search over the rows and a walk along one row, so
+   it does not depend on the length of the text. An edit records the
+   first offset it changed; the redraw then moves there, rewrites (and
+   re-lays out) the text from there on and clears what is left below.
+   Nothing before the change is ever rewritten, and typing at the end
+   writes just the new bytes. Whenever a row is filled exactly the writer
+   moves to the next row itself, and a wide character that does not fit
+   at the end of a row goes to the next one, as terminals do; so the
+   terminal never sits in its pending-wrap state and rows always follow
+   from the text. While more keys are already read (a paste), redraws are
+   put off until the last of them. */
+
+#define CONT_PROMPT "> "
+#define CONT_COLS 2
+#define EDITOR_MIN_CAP 256
+#define NOT_DIRTY SIZE_MAX
+
+static size_t gap_size(const editor* ed)
+{
+    return ed->gap_end - ed->gap;
+}
+
+size_t editor_len(const editor* ed)
+{
+    return ed->cap - gap_size(ed);
+}
+
+static char char_at(const editor* ed, size_t i)
+{
+    return i < ed->gap ? ed->buf[i] : ed->buf[i + gap_size(ed)];
+}
+
+/* Make room for at least n more bytes. */
+static int reserve(editor* ed, size_t n)
+{
+    if (gap_size(ed) >= n) return 0;
+    size_t len = editor_len(ed);
+    size_t cap = ed->cap ? ed->cap : EDITOR_MIN_CAP;
+    while (cap - len < n) cap *= 2;
+    char* buf = mem_realloc(MEM_EDITOR, ed->buf, cap);
+    if (!buf) return -1;
+    size_t tail = ed->cap - ed->gap_end;
+    memmove(buf + cap - tail, buf + ed->gap_end, tail);
+    ed->buf = buf;
+    ed->gap_end = cap - tail;
+    ed->cap = cap;
+    return 0;
+}
+
+/* Put the gap (the cursor) at offset pos. */
+static void move_gap(editor* ed, size_t pos)
+{
+    if (pos < ed->gap) {
+        size_t n = ed->gap - pos;
+        memmove(ed->buf + ed->gap_end - n, ed->buf + pos, n);
+        ed->gap = pos;
+        ed->gap_end -= n;
+    } else if (pos > ed->gap) {
+        size_t n = pos - ed->gap;
+        memmove(ed->buf + ed->gap, ed->buf + ed->gap_end, n);
+        ed->gap = pos;
+        ed->gap_end += n;
+    }
+}
+
+static void mark_dirty(editor* ed, size_t from)
+{
+    if (from < ed->dirty) ed->dirty = from;
+}
+
+/* ---- graphemes ---- */
+
+/* The code point at pos; *next gets the offset after it. */
+static unsigned decode_at(const editor* ed, size_t pos, size_t* next)
+{
+    unsigned char c = char_at(ed, pos);
+    if (c < 0x80) {
+        *next = pos + 1;
+        return c;
+    }
+    char seq[4];
+    size_t n = 0, len = editor_len(ed);
+    while (n < sizeof(seq) && pos + n < len) {
+        seq[n] = char_at(ed, pos + n);
+        n++;
+    }
+    size_t used;
+    unsigned cp = utf8_decode(seq, n, &used);
+    *next = pos + used;
+    return cp;
+}
+
+/* End of the grapheme that starts at pos, and its width in *width. */
+static size_t grapheme_next(const editor* ed, size_t pos, int* width)
+{
+    size_t len = editor_len(ed), next;
+    unsigned prev = decode_at(ed, pos, &next);
+    int regional = utf8_is_regional(prev);
+    *width = utf8_width(prev);
+    while (next < len) {
+        /* plain ASCII never continues a grapheme */
+        if ((unsigned char)char_at(ed, next) < 0x80) break;
+        size_t after;
+        unsigned cp = decode_at(ed, next, &after);
+        if (regional == 1 && utf8_is_regional(cp)) {
+            regional = 2;
+            *width = 2;
+        } else if (!utf8_extends(cp) && prev != 0x200d) {
+            break;
+        }
+        prev = cp;
+        next = after;
+    }
+    return next;
+}
+
+static size_t cp_start(const editor* ed, size_t pos)
+{
+    do pos--; while (pos > 0 && ((unsigned char)char_at(ed, pos) & 0xc0) == 0x80);
+    return pos;
+}
+
+/* Start of the grapheme that ends at pos. */
+static size_t grapheme_prev(const editor* ed, size_t pos)
+{
+    if (pos == 0) return 0;
+    size_t start = cp_start(ed, pos), next;
+    unsigned cp = decode_at(ed, start, &next);
+    while (start > 0 && cp >= 0x80) {
+        size_t before = cp_start(ed, start);
+        unsigned prev = decode_at(ed, before, &next);
+        if (prev == '\n' || (!utf8_extends(cp) && prev != 0x200d)) break;
+        start = before;
+        cp = prev;
+    }
+    /* regional indicators pair up from the start of their run */
+    if (utf8_is_regional(cp)) {
+        size_t run = 0, p = start;
+        while (p > 0) {
+            size_t before = cp_start(ed, p);
+            if (!utf8_is_regional(decode_at(ed, before, &next))) break;
+            run++;
+            p = before;
+        }
+        if (run % 2) start = cp_start(ed, start);
+    }
+    return start;
+}
+
+static size_t grapheme_after(const editor* ed, size_t pos)
+{
+    int width;
+    return pos < editor_len(ed) ? grapheme_next(ed, pos, &width) : pos;
+}
+
+/* ---- layout ---- */
+
+static int terminal_cols(void)
+{
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col) return ws.ws_col;
+    return 80;
+}
+
+/* Screen row of the first row of text; the prompt may wrap. */
+static long first_row(const editor* ed)
+{
+    return ed->prompt_cols / ed->cols;
+}
+
+static long row_start_col(const editor* ed, size_t r)
+{
+    if (r == 0) return ed->prompt_cols % ed->cols;
+    return char_at(ed, ed->rows[r] - 1) == '\n' ? CONT_COLS : 0;
+}
+
+/* Forget the rows from r on; row r starts at pos. */
+static void set_row(editor* ed, size_t r, size_t pos)
+{
+    if (r >= ed->rows_cap) {
+        size_t cap = ed->rows_cap ? ed->rows_cap * 2 : 64;
+        size_t* rows = mem_realloc(MEM_EDITOR, ed->rows, cap * sizeof(size_t));
+        if (!rows) return;
+        ed->rows = rows;
+        ed->rows_cap = cap;
+    }
+    ed->rows[r] = pos;
+    ed->nrows = r + 1;
+}
+
+/* Screen position of text offset pos, relative to the prompt's row. Needs
+   the rows to be right up to pos. */
+static size_t row_of(const editor* ed, size_t pos)
+{
+    size_t lo = 0, hi = ed->nrows;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (ed->rows[mid] <= pos) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void locate(const editor* ed, size_t pos, long* row, long* col)
+{
+    size_t lo = row_of(ed, pos);
+    *row = first_row(ed) + lo;
+    *col = row_start_col(ed, lo);
+    for (size_t p = ed->rows[lo]; p < pos; ) {
+        int w;
+        size_t next = grapheme_next(ed, p, &w);
+        if (next > pos) break;
+        *col += w;
+        p = next;
+    }
+}
+
+static void move_cursor(editor* ed, strbuf* out, long row, long col)
+{
+    char seq[24];
+    int n = 0;
+    if (row < ed->row) n = snprintf(seq, sizeof(seq), "\x1b[%ldA", ed->row - row);
+    else if (row > ed->row) n = snprintf(seq, sizeof(seq), "\x1b[%ldB", row - ed->row);
+    sb_append(out, seq, n);
+    if (col != ed->col) {
+        sb_putc(out, '\r');
+        if (col) sb_append(out, seq, snprintf(seq, sizeof(seq), "\x1b[%ldC", col));
+    }
+    ed->row = row;
+    ed->col = col;
+}
+
+/* Move to the next row, which starts at text offset pos and column col. */
+static void next_row(editor* ed, size_t pos, long col)
+{
+    ed->row++;
+    ed->col = col;
+    set_row(ed, ed->row - first_row(ed), pos);
+}
+
+/* Write the text from pos, where the terminal cursor is, to the end,
+   laying out the rows as it goes. */
+static void write_from(editor* ed, strbuf* out, size_t pos)
+{
+    size_t len = editor_len(ed);
+    while (pos < len) {
+        char c = char_at(ed, pos);
+        if (c == '\n') {
+            sb_append(out, "\x1b[K\r\n" CONT_PROMPT, 5 + CONT_COLS);
+            next_row(ed, ++pos, CONT_COLS);
+            continue;
+        }
+        int w;
+        size_t next = grapheme_next(ed, pos, &w);
+        if (ed->col + w > ed->cols) {
+            sb_append(out, "\x1b[K\r\n", 5);
+            next_row(ed, pos, 0);
+        }
+        if (pos < ed->gap && next > ed->gap) {
+            sb_append(out, ed->buf + pos, ed->gap - pos);
+            sb_append(out, ed->buf + ed->gap_end, next - ed->gap);
+        } else {
+            sb_append(out, ed->buf + (pos < ed->gap ? pos : pos + gap_size(ed)), next - pos);
+        }
+        pos = next;
+        ed->col += w;
+        if (ed->col >= ed->cols) {
+            sb_append(out, "\r\n", 2);
+            next_row(ed, pos, 0);
+        }
+    }
+}
+
+static void flush_out(strbuf* out)
+{
+    if (out->len) fwrite(out->data, 1, out->len, stdout);
+    fflush(stdout);
+    sb_free(out);
+}
+
+/* Bring the screen up to date: rewrite from the first changed offset, then
+   put the cursor where the gap is. */
+static void draw(editor* ed, int force)
+{
+    if (!force && event_pending()) return;
+    strbuf out = {0};
+    long row, col;
+    if (ed->dirty != NOT_DIRTY) {
+        /* a row that ended early, leaving no room for a wide character,
+           depends on what follows it */
+        size_t r = row_of(ed, ed->dirty);
+        if (r > 0 && ed->rows[r] == ed->dirty && row_start_col(ed, r) == 0) {
+            ed->dirty = grapheme_prev(ed, ed->dirty);
+        }
+        locate(ed, ed->dirty, &row, &col);
+        move_cursor(ed, &out, row, col);
+        ed->nrows = row - first_row(ed) + 1;
+        write_from(ed, &out, ed->dirty);
+        /* text appended at the end leaves nothing old to clear */
+        if (ed->dirty < ed->shown) sb_append(&out, "\x1b[J", 3);
+        ed->dirty = NOT_DIRTY;
+        ed->shown = editor_len(ed);
+    }
+    locate(ed, ed->gap, &row, &col);
+    move_cursor(ed, &out, row, col);
+    flush_out(&out);
+}
+
+/* ---- lifetime ---- */
+
+void editor_free(editor* ed)
+{
+    mem_free(ed->buf);
+    mem_free(ed->rows);
+    memset(ed, 0, sizeof(*ed));
+}
+
+/* Empty the buffer and print a fresh prompt at the start of the line. */
+void editor_begin(editor* ed)
+{
+    ed->gap = 0;
+    ed->gap_end = ed->cap;
+    ed->dirty = NOT_DIRTY;
+    ed->shown = 0;
+    ed->cols = terminal_cols();
+    ed->prompt_cols = prompt_render();
+    fflush(stdout);
+    set_row(ed, 0, 0);
+    ed->row = ed->prompt_cols / ed->cols;
+    ed->col = ed->prompt_cols % ed->cols;
+}
+
+/* Redraw the prompt and all of the text, after a resize or a prompt
+   update. */
+void editor_redraw(editor* ed)
+{
+    strbuf out = {0};
+    move_cursor(ed, &out, 0, ed->col);
+    sb_putc(&out, '\r');
+    flush_out(&out);
+    ed->cols = terminal_cols();
+    ed->prompt_cols = prompt_render();
+    fputs("\x1b[K", stdout);
+    ed->row = ed->prompt_cols / ed->cols;
+    ed->col = ed->prompt_cols % ed->cols;
+    set_row(ed, 0, 0);
+    mark_dirty(ed, 0);
+    draw(ed, 1);
+}
+
+/* Replace the text with s and put the cursor at its end (history). */
+void editor_set(editor* ed, const char* s)
+{
+    size_t n = my_strlen(s);
+    ed->gap = 0;
+    ed->gap_end = ed->cap;
+    if (reserve(ed, n) == 0) {
+        memcpy(ed->buf, s, n);
+        ed->gap = n;
+    }
+    mark_dirty(ed, 0);
+    draw(ed, 0);
+}
+
+/* Show the rest of the text, then mark (e.g. "^C") and end the line, so
+   that whatever comes next starts below the input. */
+void editor_finish(editor* ed, const char* mark)
+{
+    draw(ed, 1);
+    strbuf out = {0};
+    long row, col;
+    locate(ed, editor_len(ed), &row, &col);
+    move_cursor(ed, &out, row, col);
+    sb_append(&out, mark, my_strlen(mark));
+    if (col != 0 || *mark) sb_putc(&out, '\n');
+    flush_out(&out);
+}
+
+/* The whole text, NUL-terminated, for running it: the cursor goes to the
+   end so the text is contiguous and the terminator sits in the gap.
+   Valid until the next edit. */
+char* editor_text(editor* ed)
+{
+    if (reserve(ed, 1) == -1) return NULL;
+    move_gap(ed, editor_len(ed));
+    ed->buf[ed->gap] = '\0';
+    return ed->buf;
+}
+
+/* ---- editing ---- */
+
+void editor_insert(editor* ed, const char* s, size_t n)
+{
+    if (reserve(ed, n) == -1) return;
+    memcpy(ed->buf + ed->gap, s, n);
+    mark_dirty(ed, ed->gap);
+    ed->gap += n;
+    draw(ed, 0);
+}
+
+/* Delete the bytes between the cursor and offset to. */
+static void delete_to(editor* ed, size_t to)
+{
+    if (to < ed->gap) {
+        ed->gap = to;
+    } else if (to > ed->gap) {
+        ed->gap_end += to - ed->gap;
+    } else {
+        return;
+    }
+    mark_dirty(ed, ed->gap);
+    draw(ed, 0);
+}
+
+static void move_to(editor* ed, size_t pos)
+{
+    move_gap(ed, pos);
+    draw(ed, 0);
+}
+
+static size_t line_start(const editor* ed, size_t pos)
+{
+    while (pos > 0 && char_at(ed, pos - 1) != '\n') pos--;
+    return pos;
+}
+
+static size_t line_end(const editor* ed, size_t pos)
+{
+    size_t len = editor_len(ed);
+    while (pos < len && char_at(ed, pos) != '\n') pos++;
+    return pos;
+}
+
+/* Words are letters, digits, _ and anything not ASCII, or with
+   blank_words (Ctrl-W) anything between blanks. Either way a word edge is
+   next to an ASCII byte, so it never splits a character. */
+static int is_word(char c, int blank_words)
+{
+    if (blank_words) return !isspace((unsigned char)c);
+    return isalnum((unsigned char)c) || c == '_' || (unsigned char)c >= 0x80;
+}
+
+static size_t word_left(const editor* ed, size_t pos, int blank_words)
+{
+    while (pos > 0 && !is_word(char_at(ed, pos - 1), blank_words)) pos--;
+    while (pos > 0 && is_word(char_at(ed, pos - 1), blank_words)) pos--;
+    return pos;
+}
+
+static size_t word_right(const editor* ed, size_t pos)
+{
+    size_t len = editor_len(ed);
+    while (pos < len && !is_word(char_at(ed, pos), 0)) pos++;
+    while (pos < len && is_word(char_at(ed, pos), 0)) pos++;
+    return pos;
+}
+
+/* Move to the same column of the previous (dir < 0) or next line of a
+   multi-line input. Returns -1 if there is no such line. */
+int editor_line_move(editor* ed, int dir)
+{
+    size_t start = line_start(ed, ed->gap);
+    long column = 0;
+    int w;
+    for (size_t p = start; p < ed->gap; column += w) p = grapheme_next(ed, p, &w);
+    size_t target;
+    if (dir < 0) {
+        if (start == 0) return -1;
+        target = line_start(ed, start - 1);
+    } else {
+        size_t end = line_end(ed, ed->gap);
+        if (end == editor_len(ed)) return -1;
+        target = end + 1;
+    }
+    size_t end = line_end(ed, target);
+    while (target < end && column > 0) {
+        target = grapheme_next(ed, target, &w);
+        column -= w;
+    }
+    move_to(ed, target);
+    return 0;
+}
+
+void editor_end(editor* ed)
+{
+    move_to(ed, editor_len(ed));
+}
+
+/* Act on one key or escape sequence. Returns 0 if it was an editing key,
+   -1 if the caller should deal with it. */
+int editor_key(editor* ed, const char* key, size_t n)
+{
+    size_t pos = ed->gap;
+    char c = key[0];
+
+    if ((unsigned char)c >= 0x80) {                 /* a UTF-8 character */
+        size_t used;
+        if (utf8_decode(key, n, &used) != 0xfffd && used == n) editor_insert(ed, key, n);
+        return 0;
+    }
+    if (n == 1) {
+        if ((unsigned char)c >= 32 && (unsigned char)c <= 126) editor_insert(ed, key, 1);
+        else if (c == 127 || c == 8) delete_to(ed, grapheme_prev(ed, pos));     /* Backspace */
+        else if (c == 1) move_to(ed, line_start(ed, pos));                      /* Ctrl-A */
+        else if (c == 5) move_to(ed, line_end(ed, pos));                        /* Ctrl-E */
+        else if (c == 2) move_to(ed, grapheme_prev(ed, pos));                   /* Ctrl-B */
+        else if (c == 6) move_to(ed, grapheme_after(ed, pos));                  /* Ctrl-F */
+        else if (c == 23) delete_to(ed, word_left(ed, pos, 1));                 /* Ctrl-W */
+        else if (c == 21) delete_to(ed, line_start(ed, pos));                   /* Ctrl-U */
+        else if (c == 11) delete_to(ed, line_end(ed, pos));                     /* Ctrl-K */
+        else return -1;
+        return 0;
+    }
+
+    if (c != '\x1b') return -1;
+    if (n == 2) {                                   /* Alt-<key> */
+        if (key[1] == 'b') move_to(ed, word_left(ed, pos, 0));
+        else if (key[1] == 'f') move_to(ed, word_right(ed, pos));
+        else if (key[1] == 'd') delete_to(ed, word_right(ed, pos));
+        else if (key[1] == 127 || key[1] == 8) delete_to(ed, word_left(ed, pos, 0));
+        else return -1;
+        return 0;
+    }
+
+    /* CSI and SS3 sequences: the final byte, and a modifier after ';' */
+    char final = key[n - 1];
+    int ctrl = n >= 6 && key[n - 3] == ';' && (key[n - 2] == '5' || key[n - 2] == '3');
+    if (final == 'C') move_to(ed, ctrl ? word_right(ed, pos) : grapheme_after(ed, pos));
+    else if (final == 'D') move_to(ed, ctrl ? word_left(ed, pos, 0) : grapheme_prev(ed, pos));
+    else if (final == 'H') move_to(ed, line_start(ed, pos));
+    else if (final == 'F') move_to(ed, line_end(ed, pos));
+    else if (final == '~' && n == 4 && key[2] == '3') delete_to(ed, grapheme_after(ed, pos));
+    else if (final == '~' && n == 4 && (key[2] == '1' || key[2] == '7')) move_to(ed, line_start(ed, pos));
+    else if (final == '~' && n == 4 && (key[2] == '4' || key[2] == '8')) move_to(ed, line_end(ed, pos));
+    else return -1;
+    return 0;
+}
+
+/* ---- running the text ---- */
+
+/* Whether text is a whole command, or Enter should start a continuation
+   line: not if it ends inside quotes or $(...), or with a backslash. */
+int editor_complete(const char* s)
+{
+    char quote = 0;
+    for (; *s; s++) {
+        if (quote == '\'') {
+            if (*s == '\'') quote = 0;
+            continue;
+        }
+        if (*s == '$' && s[1] == '(') {
+            const char* end = skip_substitution(s);
+            if (!end) return 0;
+            s = end - 1;
+            continue;
+        }
+        if (*s == '\\') {
+            if (!s[1]) return 0;
+            s++;
+        } else if (quote) {
+            if (*s == quote) quote = 0;
+        } else if (*s == '\'' || *s == '"') {
+            quote = *s;
+        }
+    }
+    return quote == 0;
+}
+
+/* Remove backslash-newline pairs outside single quotes, joining
+   continuation lines as the parser expects. Works in place; returns the
+   new length. */
+size_t editor_join_lines(char* s, size_t len)
+{
+    size_t out = 0;
+    char quote = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if (quote == '\'') {
+            if (c == '\'') quote = 0;
+        } else if (c == '\\' && i + 1 < len) {
+            if (s[i + 1] == '\n') {
+                i++;
+                continue;
+            }
+            s[out++] = c;
+            c = s[++i];
+        } else if (c == '\'' || c == '"') {
+            if (!quote) quote = c;
+            else if (c == quote) quote = 0;
+        }
+        s[out++] = c;
+    }
+    s[out] = '\0';
+    return out;
+}
@@ -0,0 +1,97 @@
+#include "my_shell.h"
+#include <stdint.h>
+
+/* Open-addressing hash index over the env array. Each slot stores the
+   position of a variable in env plus one (0 marks an empty slot). The index
+   belongs to one env array and is rebuilt lazily the first time a lookup
+   sees a different array or after env_index_invalidate(). */
+static size_t* slots = NULL;
+static size_t slot_mask = 0;
+static char** indexed_env = NULL;
+static int index_valid = 0;
+
+static uint32_t hash_name(const char* name, size_t len)
+{
+    uint32_t h = 2166136261u; /* FNV-1a */
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Length of the name part of a NAME=value entry */
+static size_t name_length(const char* entry)
+{
+    const char* eq = my_strchr(entry, '=');
+    return eq ? (size_t)(eq - entry) : (size_t)my_strlen(entry);
+}
+
+static int names_equal(const char* entry, const char* name, size_t len)
+{
+    return my_strncmp(entry, name, len) == 0 && entry[len] == '=';
+}
+
+static int rebuild_index(char** env)
+{
+    size_t count = 0;
+    while (env[count]) count++;
+
+    size_t cap = 16;
+    while (cap < count * 2) cap *= 2;
+
+    size_t* table = calloc(cap, sizeof(size_t));
+    if (!table) {
+        perror("calloc");
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        size_t len = name_length(env[i]);
+        size_t s = hash_name(env[i], len) & (cap - 1);
+        int duplicate = 0;
+        while (table[s]) {
+            /* keep the first definition, as a linear search would */
+            if (names_equal(env[table[s] - 1], env[i], len)) { duplicate = 1; break; }
+            s = (s + 1) & (cap - 1);
+        }
+        if (!duplicate) table[s] = i + 1;
+    }
+
+    free(slots);
+    slots = table;
+    slot_mask = cap - 1;
+    indexed_env = env;
+    index_valid = 1;
+    return 0;
+}
+
+/* Forget the current index; called whenever an env array is replaced. */
+void env_index_invalidate(void)
+{
+    index_valid = 0;
+}
+
+/* Returns the value of the variable name[0..len) in env, or NULL. */
+char* env_lookup(const char* name, size_t len, char** env)
+{
+    if (!name || !env) return NULL;
+
+    if (!index_valid || indexed_env != env) {
+        if (rebuild_index(env) == -1) {
+            /* fall back to a linear scan */
+            for (size_t i = 0; env[i]; i++) {
+                if (names_equal(env[i], name, len)) return &env[i][len + 1];
+            }
+            return NULL;
+        }
+    }
+
+    size_t s = hash_name(name, len) & slot_mask;
+    while (slots[s]) {
+        char* entry = env[slots[s] - 1];
+        if (names_equal(entry, name, len)) return &entry[len + 1];
+        s = (s + 1) & slot_mask;
+    }
+    return NULL;
+}
@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+
+/* The shell's single wakeup point. One epoll set holds the terminal, a
+   signalfd for SIGINT/SIGCHLD/SIGWINCH, the prompt worker's eventfd and
+   the inotify descriptor. The three signals are blocked in every thread
+   and arrive only through the signalfd, so there are no handlers and
+   nothing is ever interrupted halfway. Foreground children are waited for
+   through a pidfd in the same set.
+
+   Forked children must call event_child_setup(): it restores the signal
+   mask (exec keeps blocked signals blocked) and drops the inherited epoll
+   set, which is shared with the parent across fork.
+
+   Terminal input is read a block at a time and handed out a byte at a
+   time, so a paste costs one read() per block rather than per byte and
+   the editor can see (event_pending) that more keys are already here.
+   Bytes read past an Enter stay with the shell as type-ahead for the next
+   prompt instead of going to the command. */
+
+#define MAX_EVENTS 8
+#define KEY_BUF 4096
+
+static int epoll_fd = -1;
+static int signal_fd = -1;
+static int prompt_event_fd = -1;
+static int inotify_event_fd = -1;
+static sigset_t handled;
+static sigset_t saved_mask;
+static char key_buf[KEY_BUF];
+static size_t key_pos, key_len;
+
+static int add_fd(int fd, unsigned events)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* Change what fd is watched for; 0 parks it without removing it. */
+static void set_interest(int fd, unsigned events)
+{
+    if (fd == -1) return;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/* Block the handled signals and build the epoll set. Must run before any
+   thread is started so that every thread inherits the blocked mask. */
+int event_init(void)
+{
+    sigemptyset(&handled);
+    sigaddset(&handled, SIGINT);
+    sigaddset(&handled, SIGCHLD);
+    sigaddset(&handled, SIGWINCH);
+    if (sigprocmask(SIG_BLOCK, &handled, &saved_mask) == -1) {
+        perror("sigprocmask");
+        return -1;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    signal_fd = signalfd(-1, &handled, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epoll_fd == -1 || signal_fd == -1) {
+        perror("epoll");
+        return -1;
+    }
+    if (add_fd(STDIN_FILENO, EPOLLIN) == -1 || add_fd(signal_fd, EPOLLIN) == -1) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+/* Add the prompt and inotify descriptors once they exist; both are
+   created lazily by their modules. */
+static void track_lazy_fds(void)
+{
+    if (prompt_event_fd == -1 && prompt_fd() != -1) {
+        prompt_event_fd = prompt_fd();
+        add_fd(prompt_event_fd, EPOLLIN);
+    }
+    if (inotify_event_fd == -1 && watch_fd() != -1) {
+        inotify_event_fd = watch_fd();
+        add_fd(inotify_event_fd, EPOLLIN);
+    }
+}
+
+/* Read every pending signal; returns the EVENT_ bits they map to. */
+static int drain_signals(void)
+{
+    int events = 0;
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGINT) events |= EVENT_INTERRUPT;
+        else if (info.ssi_signo == SIGWINCH) events |= EVENT_RESIZE;
+        /* SIGCHLD only wakes the loop; children are reaped by whoever
+           started them, through their pidfd */
+    }
+    return events;
+}
+
+/* Wait for input at the prompt. Returns EVENT_KEY with the byte in *c, or a
+   mask of EVENT_INTERRUPT, EVENT_RESIZE and EVENT_PROMPT for the caller to
+   act on, or EVENT_EOF when the terminal is gone. */
+int event_next(char* c)
+{
+    if (key_pos < key_len) {
+        *c = key_buf[key_pos++];
+        return EVENT_KEY;
+    }
+    track_lazy_fds();
+    while (1) {
+        struct epoll_event evs[MAX_EVENTS];
+        int n = epoll_wait(epoll_fd, evs, MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return EVENT_EOF;
+        }
+
+        int events = 0;
+        int key_ready = 0;
+        for (int i = 0; i < n; i++) {
+            int fd = evs[i].data.fd;
+            if (fd == signal_fd) {
+                events |= drain_signals();
+            } else if (fd == prompt_event_fd) {
+                prompt_ack();
+                events |= EVENT_PROMPT;
+            } else if (fd == inotify_event_fd) {
+                watch_dispatch();
+            } else if (fd == STDIN_FILENO) {
+                key_ready = 1;
+            }
+        }
+        /* signals first: Ctrl-C must win over keys typed after it */
+        if (events) return events;
+        if (key_ready) {
+            ssize_t r = read(STDIN_FILENO, key_buf, sizeof(key_buf));
+            if (r > 0) {
+                key_len = r;
+                key_pos = 1;
+                *c = key_buf[0];
+                return EVENT_KEY;
+            }
+            if (r == 0 || errno != EAGAIN) return EVENT_EOF;
+        }
+    }
+}
+
+/* Bytes already read from the terminal and not yet handed out. */
+int event_pending(void)
+{
+    return (int)(key_len - key_pos);
+}
+
+/* Wait for child pid to exit and store its wait status. Ctrl-C reaches the
+   child through the terminal; the shell just swallows its own copy. */
+int event_wait_child(pid_t pid, int* status)
+{
+    return event_wait_child_io(pid, status, -1, NULL, NULL);
+}
+
+/* Like event_wait_child, but also runs fn(fd, data) whenever the
+   non-blocking fd has data (the child's captured output), and once more
+   after the child exits to collect what is left. */
+int event_wait_child_io(pid_t pid, int* status, int fd, event_io_fn fn, void* data)
+{
+    int pidfd = epoll_fd == -1 ? -1 : (int)syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1 || add_fd(pidfd, EPOLLIN) == -1 || (fd != -1 && add_fd(fd, EPOLLIN) == -1)) {
+        /* no event loop (or an old kernel): plain blocking wait */
+        if (pidfd != -1) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pidfd, NULL);
+            close(pidfd);
+        }
+        while (waitpid(pid, status, 0) == -1) {
+            if (errno != EINTR) return -1;
+        }
+        if (fd != -1) fn(fd, data);
+        return 0;
+    }
+
+    /* type-ahead and prompt updates wait until the command is done */
+    set_interest(STDIN_FILENO, 0);
+    set_interest(prompt_event_fd, 0);
+
+    int done = 0;
+    int fd_open = fd != -1;
+    while (!done) {
+        struct epoll_event evs[MAX_EVENTS];
+        int n = epoll_wait(epoll_fd, evs, MAX_EVENTS, -1);
+        if (n == -1 && errno != EINTR) break;
+        for (int i = 0; i < n; i++) {
+            int ready = evs[i].data.fd;
+            if (ready == pidfd) {
+                done = 1;
+            } else if (ready == fd) {
+                fn(fd, data);
+                /* the child closed its end early; stop listening */
+                if (evs[i].events & (EPOLLHUP | EPOLLERR)) {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+                    fd_open = 0;
+                }
+            } else if (ready == signal_fd) drain_signals();
+            else if (ready == inotify_event_fd) watch_dispatch();
+        }
+    }
+    if (fd_open) {
+        fn(fd, data);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+
+    set_interest(STDIN_FILENO, EPOLLIN);
+    set_interest(prompt_event_fd, EPOLLIN);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pidfd, NULL);
+    close(pidfd);
+
+    while (waitpid(pid, status, 0) == -1) {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+/* Wait until fd is readable, handling signals and directory changes
+   meanwhile as event_wait_child does: for a reply from a process that is
+   not the shell's child. Without an event loop it returns at once and
+   the caller's read blocks instead. Returns 0 or -1. */
+int event_wait_readable(int fd)
+{
+    if (epoll_fd == -1 || add_fd(fd, EPOLLIN) == -1) return 0;
+    set_interest(STDIN_FILENO, 0);
+    set_interest(prompt_event_fd, 0);
+
+    int ready = 0;
+    while (!ready) {
+        struct epoll_event evs[MAX_EVENTS];
+        int n = epoll_wait(epoll_fd, evs, MAX_EVENTS, -1);
+        if (n == -1 && errno != EINTR) break;
+        for (int i = 0; i < n; i++) {
+            if (evs[i].data.fd == fd) ready = 1;
+            else if (evs[i].data.fd == signal_fd) drain_signals();
+            else if (evs[i].data.fd == inotify_event_fd) watch_dispatch();
+        }
+    }
+
+    set_interest(STDIN_FILENO, EPOLLIN);
+    set_interest(prompt_event_fd, EPOLLIN);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    return ready ? 0 : -1;
+}
+
+/* For native commands that loop in the shell itself (cat, cp, ls -R):
+   whether Ctrl-C has been pressed since they started. SIGINT is blocked,
+   so it waits as a pending signal; it is taken here so the prompt does
+   not see it again. */
+int event_take_interrupt(void)
+{
+    sigset_t pending;
+    if (sigpending(&pending) == -1 || !sigismember(&pending, SIGINT)) return 0;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    struct timespec zero = {0, 0};
+    sigtimedwait(&set, NULL, &zero);
+    return 1;
+}
+
+/* Call in a freshly forked child: restore the signal mask it would have had
+   without the shell, and forget the parent's epoll set. */
+void event_child_setup(void)
+{
+    sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+    if (epoll_fd != -1) {
+        close(epoll_fd);
+        close(signal_fd);
+    }
+    epoll_fd = -1;
+    signal_fd = -1;
+    prompt_event_fd = -1;
+    inotify_event_fd = -1;
+}
+
+/* Signal mask to give spawned processes (see prompt.c). */
+const sigset_t* event_child_mask(void)
+{
+    return &saved_mask;
+}
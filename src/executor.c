@@ -1,137 +1,93 @@
 #include "my_shell.h"
-#include <signal.h>
+#include <limits.h>
 
-// Executes a command by forking and running it in a child process
+// Executes a command by forking and running it in a child process.
+// Returns the child's exit status, 128 + signal number if it was killed,
+// or 1 if it could not be started.
 int executor(char** args, char** env)
 {
     pid_t pid;
     int status;
 
-    /* ignore SIGINT in parent around fork so parent isn't terminated by Ctrl+C
-       save old action to restore after child finishes */
-    struct sigaction sa_ignore, sa_old;
-    sa_ignore.sa_handler = SIG_IGN;
-    sigemptyset(&sa_ignore.sa_mask);
-    sa_ignore.sa_flags = 0;
-    sigaction(SIGINT, &sa_ignore, &sa_old);
+    /* resolve in the parent so the PATH cache and its dirfds are reused */
+    char full_path[PATH_MAX];
+    const char* path = NULL;
+    if (!my_strchr(args[0], '/') && path_cache_resolve(args[0], env, full_path, sizeof(full_path)) == 0) {
+        path = full_path;
+    }
+
+    /* with capture on, stdout and stderr go through a pty (capture.c) */
+    int capture_fd = -1, slave_fd = -1;
+    if (capture_enabled(env) && capture_open_pty(&capture_fd, &slave_fd) == -1) {
+        capture_fd = -1;
+    }
 
-    pid = fork();
+    /* SIGINT stays blocked in the shell and is read from the event loop,
+       so Ctrl+C only reaches the child. Under limit the child starts in
+       the command's cgroup (limit.c). Builtin output still buffered
+       would otherwise come out after the command's. */
+    fflush(stdout);
+    fflush(stderr);
+    pid = limit_fork();
     if (pid == -1) {
-        /* restore previous handler before returning */
-        sigaction(SIGINT, &sa_old, NULL);
         perror("fork");
+        if (capture_fd != -1) {
+            close(capture_fd);
+            close(slave_fd);
+        }
         return 1;
     }
 
     if (pid == 0) {
-        /* In child: restore default SIGINT behavior so child is interruptible */
-        struct sigaction sa_default;
-        sa_default.sa_handler = SIG_DFL;
-        sigemptyset(&sa_default.sa_mask);
-        sa_default.sa_flags = 0;
-        sigaction(SIGINT, &sa_default, NULL);
+        /* In child: unblock signals so the child is interruptible */
+        event_child_setup();
+        if (slave_fd != -1) {
+            dup2(slave_fd, STDOUT_FILENO);
+            dup2(slave_fd, STDERR_FILENO);
+        }
 
-        if (child_process(args, env)) {
+        if (child_process(args, env, path)) {
             perror("execve");
-            /* if execve fails, exit the child */
-            _exit(EXIT_FAILURE);
+            /* if execve fails, exit the child with the conventional "not found" status */
+            _exit(127);
         }
     } 
     else // Parent process
     {
-        if (waitpid(pid, &status, 0) == -1) {
-            /* restore previous handler before returning */
-            sigaction(SIGINT, &sa_old, NULL);
+        int r;
+        if (capture_fd != -1) {
+            close(slave_fd);
+            capture_begin(args);
+            r = event_wait_child_io(pid, &status, capture_fd, capture_output, NULL);
+            capture_end();
+            close(capture_fd);
+        } else {
+            r = event_wait_child(pid, &status);
+        }
+        if (r == -1) {
             perror("waitpid");
             return 1;
         }
-        /* restore parent's previous SIGINT handling (likely our interactive handler) */
-        sigaction(SIGINT, &sa_old, NULL);
 
         if (WIFSIGNALED(status)) {
             printf("Process terminated by signal: %d\n", WTERMSIG(status));
+            return 128 + WTERMSIG(status);
         }
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
     }
     return 1;
 }
 
-// Attempts to execute the command by searching paths and the current directory
-int child_process(char** args, char** env) 
+// Attempts to execute the command at the path resolved by the parent, then
+// relative to the current working directory
+int child_process(char** args, char** env, const char* path)
 {
-    char* path_string = get_path(env);
-    int num_paths;
-    char** path_list = split_paths(path_string, &num_paths);
-
-    // access() execve()
-    for (int i = 0; i < num_paths; i++) {
-        char full_path[MAX_INPUT];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path_list[i], args[0]);
-
-        if (access(full_path, X_OK) == 0) {
-            execve(full_path, args, env);
-        }
-    }
-
-    for (int i = 0; path_list[i]; i++)
-        free(path_list[i]);
-    free(path_string);
-    free(path_list);
-
-    // Try executing the command in the current working directory
-    char* cwd = NULL;
-    cwd = getcwd(NULL, 0);
-    if(cwd == NULL) {
-        perror("getcwd");
-        return 1;
+    if (path) {
+        execve(path, args, env);
     }
 
-    char full_cwd_path[MAX_INPUT];
-    snprintf(full_cwd_path, sizeof(full_cwd_path), "%s/%s", cwd, args[0]);
-    execve(full_cwd_path, args, env);
+    // Names containing '/' and programs in the cwd are executed as given
+    execve(args[0], args, env);
 
-    // perror("execve");
-    
     return 1;
 }
-
-// Fetches the PATH environment variable
-char* get_path(char** env) {
-    for (int i = 0; env[i]; i++) {
-        if(my_strncmp(env[i], "PATH=", 5) == 0) {
-            return my_strdup(env[i] + 5);
-        }
-    }
-    return NULL;
-}
-
-// Split the PATH string into individual paths
-char** split_paths(char* paths, int* count) {
-    char** result = NULL;
-    char* token;
-    size_t size_of_path = my_strlen(paths);
-    char paths_copy[size_of_path + 1]; // +1 for null terminator
-
-    my_strncpy(paths_copy, paths, size_of_path + 1);
-    paths_copy[size_of_path] = '\0';
-
-    token = my_strtok(paths_copy, ":");
-    *count = 0;
-
-    while (token) {
-        result = realloc(result, ((*count + 1) * sizeof(char*)));
-        if (!result) {
-            perror("realloc");
-            return NULL;
-        }
-        result[*count] = my_strdup(token);
-        if (!result[*count]) {
-            perror("my_strdup");
-            return NULL;
-        }
-
-        (*count)++;
-        token = my_strtok(NULL, ":");
-    }
-
-    return result;
-}
\ No newline at end of file
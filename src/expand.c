@@ -0,0 +1,236 @@
+#include "my_shell.h"
+#include <string.h>
+
+/* Expansion turns the raw words produced by parse_input into the argv a
+   command runs with. One left-to-right pass over each word removes quotes
+   and backslashes and substitutes $NAME, ${NAME}, $?, $$, $(...) and a
+   leading ~, writing straight into a single buffer shared by the whole
+   command.
+   Single quotes suppress all expansion; double quotes still allow $.
+   Results are not split into fields. Words with an unquoted *, ? or [
+   are then expanded as path patterns (glob.c). Quoted characters and
+   substituted values are copied with glob metacharacters backslash-escaped
+   so the pattern matcher treats them literally; the escapes are removed
+   again when the word is not a pattern or matches nothing. */
+
+static int is_name_start(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static int is_name_char(char c)
+{
+    return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+typedef struct word_state {
+    strbuf* out;
+    int magic;                  /* saw an unquoted *, ? or [ */
+    int escaped;                /* wrote at least one escaping backslash */
+} word_state;
+
+/* Append a character that must not act as a glob metacharacter. */
+static int put_literal(word_state* w, char c)
+{
+    if (c == '*' || c == '?' || c == '[' || c == '\\') {
+        w->escaped = 1;
+        if (sb_putc(w->out, '\\') == -1) return -1;
+    }
+    return sb_putc(w->out, c);
+}
+
+static int put_literals(word_state* w, const char* str, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (put_literal(w, str[i]) == -1) return -1;
+    }
+    return 0;
+}
+
+static int append_number(strbuf* out, int n)
+{
+    char num[16];
+    int len = snprintf(num, sizeof(num), "%d", n);
+    return sb_append(out, num, len);
+}
+
+/* Expand the parameter starting at the '$' in *pp and advance *pp past it. */
+static int expand_dollar(const char** pp, word_state* w, char** env)
+{
+    strbuf* out = w->out;
+    const char* p = *pp + 1;
+
+    if (*p == '?') {
+        *pp = p + 1;
+        return append_number(out, last_exit_status());
+    }
+    if (*p == '$') {
+        *pp = p + 1;
+        return append_number(out, (int)getpid());
+    }
+
+    if (*p == '(') {
+        const char* end = skip_substitution(*pp);
+        if (!end) {
+            /* unterminated $( is taken literally */
+            *pp = p;
+            return sb_putc(out, '$');
+        }
+        *pp = end;
+        strbuf result = {0};
+        int r = command_substitute(p + 1, end - p - 2, env, &result);
+        if (r == 0) r = put_literals(w, result.data, result.len);
+        sb_free(&result);
+        return r;
+    }
+
+    const char* name = p;
+    size_t len = 0;
+    if (*p == '{') {
+        const char* close = my_strchr(p + 1, '}');
+        if (!close) {
+            /* unterminated ${ is taken literally */
+            *pp = p;
+            return sb_putc(out, '$');
+        }
+        name = p + 1;
+        len = close - name;
+        p = close + 1;
+    } else if (is_name_start(*p)) {
+        while (is_name_char(p[len])) len++;
+        p += len;
+    } else {
+        /* a lone $ is literal */
+        *pp = p;
+        return sb_putc(out, '$');
+    }
+
+    *pp = p;
+    const char* value = env_lookup(name, len, env);
+    return value ? put_literals(w, value, my_strlen(value)) : 0;
+}
+
+/* Remove the escaping backslashes from out->data[start..] in place. */
+static void unescape(strbuf* out, size_t start)
+{
+    size_t j = start;
+    for (size_t i = start; i < out->len; i++) {
+        if (out->data[i] == '\\' && i + 1 < out->len) i++;
+        out->data[j++] = out->data[i];
+    }
+    out->len = j;
+}
+
+/* Turn the pattern in out->data[start..] into its matches. Returns the number
+   of arguments left in out: the matches, or the literal word if none. */
+static int expand_pattern(strbuf* out, size_t start)
+{
+    char* pattern = mem_alloc(MEM_PARSER, out->len - start + 1);
+    if (!pattern) { perror("malloc"); return -1; }
+    memcpy(pattern, out->data + start, out->len - start);
+    pattern[out->len - start] = '\0';
+
+    out->len = start;
+    int n = glob_expand(pattern, out);
+    if (n == 0) {
+        /* no match: the word is passed on unchanged, as in sh */
+        n = sb_append(out, pattern, my_strlen(pattern)) == -1 ? -1 : 1;
+        if (n == 1) {
+            unescape(out, start);
+            if (sb_putc(out, '\0') == -1) n = -1;
+        }
+    }
+    mem_free(pattern);
+    return n;
+}
+
+/* Expand one word onto the end of out, each resulting argument NUL-terminated.
+   Returns the number of arguments produced: 0 if the word vanished
+   (an unquoted expansion that was empty), more than 1 for a pattern
+   matching several paths, -1 on error. */
+static int expand_word(const char* word, strbuf* out, char** env)
+{
+    size_t start = out->len;
+    word_state w = { out, 0, 0 };
+    int quoted = 0;
+    char quote = 0;
+    const char* p = word;
+
+    /* ~ and ~/... expand to $HOME */
+    if (p[0] == '~' && (p[1] == '\0' || p[1] == '/')) {
+        const char* home = env_lookup("HOME", 4, env);
+        if (home) {
+            if (put_literals(&w, home, my_strlen(home)) == -1) return -1;
+            p++;
+        }
+    }
+
+    while (*p) {
+        int err = 0;
+        if (quote == '\'') {
+            if (*p == '\'') { quote = 0; p++; }
+            else err = put_literal(&w, *p++);
+        } else if (*p == '$') {
+            err = expand_dollar(&p, &w, env);
+        } else if (quote == '"') {
+            if (*p == '"') { quote = 0; p++; }
+            else if (*p == '\\' && p[1]) { err = put_literal(&w, p[1]); p += 2; }
+            else err = put_literal(&w, *p++);
+        } else if (*p == '\'' || *p == '"') {
+            quote = *p++;
+            quoted = 1;
+        } else if (*p == '\\') {
+            /* an escaped character, or a trailing backslash taken literally */
+            err = put_literal(&w, p[1] ? p[1] : '\\');
+            p += p[1] ? 2 : 1;
+            quoted = 1;
+        } else {
+            if (*p == '*' || *p == '?' || *p == '[') w.magic = 1;
+            err = sb_putc(out, *p++);
+        }
+        if (err == -1) return -1;
+    }
+
+    if (w.magic) return expand_pattern(out, start);
+    if (out->len == start && !quoted) return 0;
+    if (w.escaped) unescape(out, start);
+    return sb_putc(out, '\0') == -1 ? -1 : 1;
+}
+
+/* Expand every word of a command. The result is a NULL-terminated argv
+   whose pointer array and strings live in one allocation: release it with
+   mem_free(). Returns NULL on allocation failure. */
+char** expand_args(char** words, char** env)
+{
+    if (!words) return NULL;
+
+    strbuf buf = {0};
+    size_t argc = 0;
+    for (size_t i = 0; words[i]; i++) {
+        int r = expand_word(words[i], &buf, env);
+        if (r == -1) {
+            sb_free(&buf);
+            return NULL;
+        }
+        argc += r;
+    }
+
+    size_t table = (argc + 1) * sizeof(char*);
+    char** argv = mem_alloc(MEM_PARSER, table + buf.len);
+    if (!argv) {
+        perror("malloc");
+        sb_free(&buf);
+        return NULL;
+    }
+
+    char* strings = (char*)argv + table;
+    if (buf.len) memcpy(strings, buf.data, buf.len);
+    for (size_t i = 0, off = 0; i < argc; i++) {
+        argv[i] = strings + off;
+        off += my_strlen(argv[i]) + 1;
+    }
+    argv[argc] = NULL;
+
+    sb_free(&buf);
+    return argv;
+}
@@ -0,0 +1,624 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include "walk.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/fs.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/* Native cat, cp, mv and rm. They run in the shell process and let the
+   kernel move the data:
+     cat  sendfile() from each file to stdout
+     cp   a FICLONE reflink, then copy_file_range(), then read/write
+     mv   renameat2(); across filesystems the system mv takes over
+     rm   unlinkat() relative to directory fds, on the parallel walker
+   Options these do not handle, and reading stdin in cat, run the system
+   program instead. So does everything when EDOSH_SYSTEM_FILES is set (and
+   not "0"), which also covers ls. */
+
+#define COPY_BUF 131072
+#define KERNEL_CHUNK (1 << 20)      /* per sendfile/copy_file_range call */
+
+struct linux_dirent64 {
+    ino64_t        d_ino;
+    off64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+int native_files_enabled(char** env)
+{
+    const char* v = env_lookup("EDOSH_SYSTEM_FILES", 18, env);
+    return !(v && *v && my_strcmp(v, "0") != 0);
+}
+
+/* Parse single-letter options out of args. allowed lists the letters this
+   command handles; each one seen is set in seen[letter]. Returns the index
+   of the first operand, or -1 for an option the native version lacks. */
+static int parse_flags(char** args, const char* allowed, char seen[128])
+{
+    memset(seen, 0, 128);
+    int i = 1;
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (my_strcmp(args[i], "--") == 0) return i + 1;
+        if (args[i][1] == '-') return -1;
+        for (const char* f = args[i] + 1; *f; f++) {
+            if ((unsigned char)*f >= 128 || !my_strchr(allowed, *f)) return -1;
+            seen[(int)*f] = 1;
+        }
+    }
+    return i;
+}
+
+/* Last component of path, ignoring trailing slashes, copied into out. */
+static const char* base_name(const char* path, char* out, size_t size)
+{
+    size_t len = my_strlen(path);
+    while (len > 1 && path[len - 1] == '/') len--;
+    size_t start = len;
+    while (start > 0 && path[start - 1] != '/') start--;
+    size_t n = len - start;
+    if (n >= size) n = size - 1;
+    memcpy(out, path + start, n);
+    out[n] = '\0';
+    return out;
+}
+
+/* dir/name into out; 0, or -1 if it does not fit. */
+static int join_path(char* out, size_t size, const char* dir, const char* name)
+{
+    size_t dlen = my_strlen(dir);
+    int n = snprintf(out, size, "%s%s%s", dir, dlen && dir[dlen - 1] == '/' ? "" : "/", name);
+    return n >= 0 && (size_t)n < size ? 0 : -1;
+}
+
+static int is_directory(const char* path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* ---- cat ---- */
+
+/* Set once Ctrl-C is seen in cat or cp (see event_take_interrupt): every
+   copy loop stops, nothing more is reported and the command returns 130.
+   The kernel copies go a chunk at a time so the check comes round often. */
+static int interrupted;
+
+static int check_interrupt(void)
+{
+    if (!interrupted && event_take_interrupt()) interrupted = 1;
+    return interrupted;
+}
+
+/* read/write loop for when the kernel paths do not apply. */
+static int copy_rw(int in, int out)
+{
+    char* buf = mem_alloc(MEM_EXECUTOR, COPY_BUF);
+    if (!buf) return -1;
+    int r = 0;
+    ssize_t n;
+    while ((n = read(in, buf, COPY_BUF)) != 0) {
+        if (check_interrupt()) {
+            r = -1;
+            break;
+        }
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            r = -1;
+            break;
+        }
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t w = write(out, buf + off, n - off);
+            if (w == -1 && errno == EINTR) continue;
+            if (w <= 0) {
+                r = -1;
+                break;
+            }
+            off += w;
+        }
+        if (r == -1) break;
+    }
+    mem_free(buf);
+    return r;
+}
+
+/* Whole file to stdout: sendfile() works for any stdout the kernel can
+   write to (a pipe, file or terminal), but not an O_APPEND file, and
+   /proc files report size 0. Both of those take the read/write path. */
+static int send_file(int in, const struct stat* st)
+{
+    int sent_any = 0;
+    if (st->st_size > 0) {
+        while (1) {
+            if (check_interrupt()) return -1;
+            ssize_t n = sendfile(STDOUT_FILENO, in, NULL, KERNEL_CHUNK);
+            if (n == 0) return 0;
+            if (n > 0) {
+                sent_any = 1;
+                continue;
+            }
+            if (errno == EINTR) continue;
+            if (!sent_any && (errno == EINVAL || errno == ENOSYS)) break;
+            return -1;
+        }
+    }
+    return copy_rw(in, STDOUT_FILENO);
+}
+
+// cat file...
+int command_cat(char** args, char** env)
+{
+    char seen[128];
+    int first = parse_flags(args, "", seen);
+    if (!native_files_enabled(env) || first == -1 || !args[first]) return executor(args, env);
+    for (int i = first; args[i]; i++) {
+        if (my_strcmp(args[i], "-") == 0) return executor(args, env);
+    }
+
+    fflush(stdout);
+    interrupted = 0;
+    int status = 0;
+    for (int i = first; args[i] && !check_interrupt(); i++) {
+        int fd = open(args[i], O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd == -1 || fstat(fd, &st) == -1) {
+            fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+            if (fd != -1) close(fd);
+            status = 1;
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "cat: %s: Is a directory\n", args[i]);
+            status = 1;
+        } else if (send_file(fd, &st) == -1 && !interrupted) {
+            fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+            status = 1;
+        }
+        close(fd);
+    }
+    return interrupted ? 130 : status;
+}
+
+/* ---- cp ---- */
+
+typedef struct copy_ctx {
+    mode_t umask;
+    int status;
+    dev_t top_dev;              /* the directory cp -r created, so a copy */
+    ino_t top_ino;              /* into itself does not recurse forever */
+} copy_ctx;
+
+/* Contents of in to out. A reflink shares the blocks and is done at once;
+   copy_file_range lets the filesystem copy without passing through us;
+   read/write covers everything else (other filesystems on old kernels,
+   /proc files that claim to be empty). */
+static int copy_data(int in, int out, const struct stat* st)
+{
+    if (ioctl(out, FICLONE, in) == 0) return 0;
+    if (st->st_size > 0) {
+        while (1) {
+            if (check_interrupt()) return -1;
+            ssize_t n = copy_file_range(in, NULL, out, NULL, KERNEL_CHUNK, 0);
+            if (n == 0) return 0;
+            if (n > 0) continue;
+            if (errno == EINTR) continue;
+            if (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                errno == EOPNOTSUPP || errno == EBADF) break;
+            return -1;
+        }
+    }
+    return copy_rw(in, out);
+}
+
+static void copy_error(copy_ctx* c, const char* what, const char* path)
+{
+    if (interrupted) return;
+    fprintf(stderr, "cp: %s '%s': %s\n", what, path, strerror(errno));
+    c->status = 1;
+}
+
+static void copy_tree(copy_ctx* c, int sdir, const char* sname, int ddir, const char* dname,
+                      const char* spath, const char* dpath);
+
+/* One entry of any type from sdir/sname to ddir/dname. st is its lstat. */
+static void copy_entry(copy_ctx* c, int sdir, const char* sname, const struct stat* st,
+                       int ddir, const char* dname, const char* spath, const char* dpath)
+{
+    if (S_ISDIR(st->st_mode)) {
+        copy_tree(c, sdir, sname, ddir, dname, spath, dpath);
+    } else if (S_ISLNK(st->st_mode)) {
+        char target[PATH_MAX];
+        ssize_t len = readlinkat(sdir, sname, target, sizeof(target) - 1);
+        if (len == -1) {
+            copy_error(c, "cannot read symbolic link", spath);
+            return;
+        }
+        target[len] = '\0';
+        unlinkat(ddir, dname, 0);
+        if (symlinkat(target, ddir, dname) == -1) copy_error(c, "cannot create symbolic link", dpath);
+    } else if (S_ISREG(st->st_mode)) {
+        int in = openat(sdir, sname, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (in == -1) {
+            copy_error(c, "cannot open", spath);
+            return;
+        }
+        int out = openat(ddir, dname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st->st_mode & 0777);
+        if (out == -1) {
+            copy_error(c, "cannot create regular file", dpath);
+        } else {
+            if (copy_data(in, out, st) == -1) copy_error(c, "error writing", dpath);
+            close(out);
+        }
+        close(in);
+    } else {
+        /* fifos, sockets and devices are recreated, not read */
+        unlinkat(ddir, dname, 0);
+        if (mknodat(ddir, dname, st->st_mode & ~c->umask, st->st_rdev) == -1) {
+            copy_error(c, "cannot create special file", dpath);
+        }
+    }
+}
+
+static void copy_tree(copy_ctx* c, int sdir, const char* sname, int ddir, const char* dname,
+                      const char* spath, const char* dpath)
+{
+    struct stat st;
+    int in = openat(sdir, sname, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (in == -1 || fstat(in, &st) == -1) {
+        copy_error(c, "cannot access", spath);
+        if (in != -1) close(in);
+        return;
+    }
+    if (st.st_dev == c->top_dev && st.st_ino == c->top_ino) {
+        fprintf(stderr, "cp: cannot copy a directory into itself, '%s'\n", spath);
+        c->status = 1;
+        close(in);
+        return;
+    }
+
+    /* owner-writable until filled, then the source's mode */
+    if (mkdirat(ddir, dname, 0700) == -1 && errno != EEXIST) {
+        copy_error(c, "cannot create directory", dpath);
+        close(in);
+        return;
+    }
+    int out = openat(ddir, dname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (out == -1) {
+        copy_error(c, "cannot access", dpath);
+        close(in);
+        return;
+    }
+    if (c->top_ino == 0) {
+        struct stat top;
+        if (fstat(out, &top) == 0) {
+            c->top_dev = top.st_dev;
+            c->top_ino = top.st_ino;
+        }
+    }
+
+    char buf[32768];
+    long n;
+    while (!interrupted && (n = syscall(SYS_getdents64, in, buf, sizeof(buf))) > 0) {
+        for (long off = 0; off < n && !check_interrupt(); ) {
+            struct linux_dirent64* d = (struct linux_dirent64*)(buf + off);
+            off += d->d_reclen;
+            const char* name = d->d_name;
+            if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+
+            char sp[PATH_MAX], dp[PATH_MAX];
+            if (join_path(sp, sizeof(sp), spath, name) == -1 || join_path(dp, sizeof(dp), dpath, name) == -1) {
+                errno = ENAMETOOLONG;
+                copy_error(c, "cannot copy", name);
+                continue;
+            }
+            struct stat est;
+            if (fstatat(in, name, &est, AT_SYMLINK_NOFOLLOW) == -1) {
+                copy_error(c, "cannot stat", sp);
+                continue;
+            }
+            copy_entry(c, in, name, &est, out, name, sp, dp);
+        }
+    }
+    if (fchmod(out, st.st_mode & 07777 & ~c->umask) == -1) copy_error(c, "cannot set mode of", dpath);
+    close(out);
+    close(in);
+}
+
+/* Would target (which need not exist yet) land inside directory src? */
+static int copy_into_itself(const char* src, const char* target)
+{
+    char dir[PATH_MAX], real_src[PATH_MAX], real_dir[PATH_MAX];
+    size_t len = my_strlen(target);
+    while (len > 1 && target[len - 1] == '/') len--;
+    while (len > 0 && target[len - 1] != '/') len--;
+    snprintf(dir, sizeof(dir), "%.*s", len ? (int)len : 1, len ? target : ".");
+    if (!realpath(src, real_src) || !realpath(dir, real_dir)) return 0;
+    size_t n = my_strlen(real_src);
+    return my_strncmp(real_dir, real_src, n) == 0 && (real_dir[n] == '\0' || real_dir[n] == '/');
+}
+
+// cp [-r] source... dest
+int command_cp(char** args, char** env)
+{
+    char seen[128];
+    int first = parse_flags(args, "rR", seen);
+    if (!native_files_enabled(env) || first == -1) return executor(args, env);
+    int recursive = seen['r'] || seen['R'];
+
+    int count = 0;
+    while (args[first + count]) count++;
+    if (count < 2) {
+        fprintf(stderr, count ? "cp: missing destination file operand after '%s'\n"
+                              : "cp: missing file operand\n", args[first]);
+        return 1;
+    }
+    const char* dest = args[first + count - 1];
+    int dest_is_dir = is_directory(dest);
+    if (count > 2 && !dest_is_dir) {
+        fprintf(stderr, "cp: target '%s' is not a directory\n", dest);
+        return 1;
+    }
+
+    copy_ctx c = { .status = 0 };
+    c.umask = umask(0);
+    umask(c.umask);
+    interrupted = 0;
+
+    for (int i = first; i < first + count - 1 && !check_interrupt(); i++) {
+        const char* src = args[i];
+        char target[PATH_MAX], base[NAME_MAX + 1];
+        if (dest_is_dir) {
+            if (join_path(target, sizeof(target), dest, base_name(src, base, sizeof(base))) == -1) {
+                fprintf(stderr, "cp: '%s': File name too long\n", src);
+                c.status = 1;
+                continue;
+            }
+        } else {
+            snprintf(target, sizeof(target), "%s", dest);
+        }
+
+        /* -r copies links as links; a plain cp copies what they point to */
+        struct stat st, dst;
+        if ((recursive ? lstat(src, &st) : stat(src, &st)) == -1) {
+            copy_error(&c, "cannot stat", src);
+            continue;
+        }
+        if (S_ISDIR(st.st_mode) && !recursive) {
+            fprintf(stderr, "cp: -r not specified; omitting directory '%s'\n", src);
+            c.status = 1;
+            continue;
+        }
+        if (stat(target, &dst) == 0 && dst.st_dev == st.st_dev && dst.st_ino == st.st_ino) {
+            fprintf(stderr, "cp: '%s' and '%s' are the same file\n", src, target);
+            c.status = 1;
+            continue;
+        }
+        if (!S_ISDIR(st.st_mode) && stat(target, &dst) == 0 && S_ISDIR(dst.st_mode)) {
+            fprintf(stderr, "cp: cannot overwrite directory '%s' with non-directory\n", target);
+            c.status = 1;
+            continue;
+        }
+        if (S_ISDIR(st.st_mode) && copy_into_itself(src, target)) {
+            fprintf(stderr, "cp: cannot copy a directory, '%s', into itself, '%s'\n", src, target);
+            c.status = 1;
+            continue;
+        }
+
+        c.top_dev = 0;
+        c.top_ino = 0;
+        if (S_ISREG(st.st_mode) && !recursive) {
+            /* plain cp follows a link operand, so open the path itself */
+            int in = open(src, O_RDONLY | O_CLOEXEC);
+            if (in == -1) {
+                copy_error(&c, "cannot open", src);
+                continue;
+            }
+            int out = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+            if (out == -1) {
+                copy_error(&c, "cannot create regular file", target);
+            } else {
+                if (copy_data(in, out, &st) == -1) copy_error(&c, "error writing", target);
+                close(out);
+            }
+            close(in);
+        } else {
+            copy_entry(&c, AT_FDCWD, src, &st, AT_FDCWD, target, src, target);
+        }
+    }
+    return interrupted ? 130 : c.status;
+}
+
+/* ---- mv ---- */
+
+/* Across filesystems a move is a copy that keeps ownership and times and
+   then a removal; the system mv does all of that already. */
+static int system_move(const char* src, const char* target, int no_clobber, char** env)
+{
+    char* argv[5];
+    int n = 0;
+    argv[n++] = "mv";
+    if (no_clobber) argv[n++] = "-n";
+    argv[n++] = (char*)src;
+    argv[n++] = (char*)target;
+    argv[n] = NULL;
+    return executor(argv, env);
+}
+
+// mv [-f|-n] source... dest
+int command_mv(char** args, char** env)
+{
+    char seen[128];
+    int first = parse_flags(args, "fn", seen);
+    if (!native_files_enabled(env) || first == -1) return executor(args, env);
+
+    int count = 0;
+    while (args[first + count]) count++;
+    if (count < 2) {
+        fprintf(stderr, count ? "mv: missing destination file operand after '%s'\n"
+                              : "mv: missing file operand\n", args[first]);
+        return 1;
+    }
+    const char* dest = args[first + count - 1];
+    int dest_is_dir = is_directory(dest);
+    if (count > 2 && !dest_is_dir) {
+        fprintf(stderr, "mv: target '%s' is not a directory\n", dest);
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = first; i < first + count - 1; i++) {
+        const char* src = args[i];
+        char target[PATH_MAX], base[NAME_MAX + 1];
+        if (dest_is_dir) {
+            if (join_path(target, sizeof(target), dest, base_name(src, base, sizeof(base))) == -1) {
+                fprintf(stderr, "mv: '%s': File name too long\n", src);
+                status = 1;
+                continue;
+            }
+        } else {
+            snprintf(target, sizeof(target), "%s", dest);
+        }
+
+        unsigned flags = seen['n'] ? RENAME_NOREPLACE : 0;
+        int r = renameat2(AT_FDCWD, src, AT_FDCWD, target, flags);
+        if (r == -1 && flags && (errno == EINVAL || errno == ENOSYS)) {
+            /* the filesystem cannot refuse atomically; check, then rename */
+            struct stat st;
+            if (lstat(target, &st) == 0) continue;
+            r = rename(src, target);
+        }
+        if (r == 0) continue;
+
+        if (errno == EEXIST && seen['n']) continue;
+        if (errno == EXDEV) {
+            if (system_move(src, target, seen['n'], env) != 0) status = 1;
+        } else if (errno == ENOENT && access(src, F_OK) == -1) {
+            fprintf(stderr, "mv: cannot stat '%s': %s\n", src, strerror(ENOENT));
+            status = 1;
+        } else if (errno == EINVAL) {
+            fprintf(stderr, "mv: cannot move '%s' to a subdirectory of itself, '%s'\n", src, target);
+            status = 1;
+        } else {
+            fprintf(stderr, "mv: cannot move '%s' to '%s': %s\n", src, target, strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* ---- rm ---- */
+
+/* rm -r runs on the parallel walker (walk.c): files are unlinked as each
+   directory is read, and a directory is removed once everything below it
+   is gone. Every removal is relative to an open directory fd, so a path
+   renamed mid-walk cannot redirect it elsewhere. */
+typedef struct remove_ctx {
+    atomic_int status;
+} remove_ctx;
+
+static void remove_failed(remove_ctx* c, const char* dir, const char* name, int err)
+{
+    size_t dlen = my_strlen(dir);
+    fprintf(stderr, "rm: cannot remove '%s%s%s': %s\n", dir,
+            dlen && dir[dlen - 1] != '/' ? "/" : "", name, strerror(err));
+    atomic_store(&c->status, 1);
+}
+
+static void remove_entry(void* data, walk_dir* in, int dirfd, const char* name,
+                         const struct statx* st, walk_dir* child)
+{
+    (void)st;
+    if (child || !in) return;
+    if (unlinkat(dirfd, name, 0) == -1) remove_failed(data, in->path, name, errno);
+}
+
+static void remove_dir(void* data, walk_dir* dir)
+{
+    const char* name;
+    int at = walk_dir_at(dir, &name);
+    if (unlinkat(at, name, AT_REMOVEDIR) == -1) remove_failed(data, "", dir->path, errno);
+}
+
+static void remove_error(void* data, const char* path, int err)
+{
+    remove_failed(data, "", path, err);
+}
+
+/* Whether st is the root directory, however the operand spelled it:
+   /, //, or a link to / with a trailing slash. */
+static int is_root(const struct stat* st)
+{
+    struct stat root;
+    return stat("/", &root) == 0 && root.st_dev == st->st_dev && root.st_ino == st->st_ino;
+}
+
+// rm [-rf] file...
+int command_rm(char** args, char** env)
+{
+    char seen[128];
+    int first = parse_flags(args, "rRf", seen);
+    if (!native_files_enabled(env) || first == -1) return executor(args, env);
+    int recursive = seen['r'] || seen['R'];
+
+    int force = seen['f'];
+    remove_ctx c;
+    atomic_init(&c.status, 0);
+    if (!args[first]) {
+        if (force) return 0;
+        fprintf(stderr, "rm: missing operand\n");
+        return 1;
+    }
+
+    for (int i = first; args[i]; i++) {
+        const char* path = args[i];
+        char base[NAME_MAX + 1];
+        base_name(path, base, sizeof(base));
+        struct stat st;
+        if (lstat(path, &st) == -1) {
+            if (errno == ENOENT && force) continue;
+            fprintf(stderr, "rm: cannot remove '%s': %s\n", path, strerror(errno));
+            atomic_store(&c.status, 1);
+            continue;
+        }
+        if (!S_ISDIR(st.st_mode)) {
+            if (unlink(path) == -1) {
+                fprintf(stderr, "rm: cannot remove '%s': %s\n", path, strerror(errno));
+                atomic_store(&c.status, 1);
+            }
+            continue;
+        }
+        if (!recursive) {
+            fprintf(stderr, "rm: cannot remove '%s': Is a directory\n", path);
+            atomic_store(&c.status, 1);
+            continue;
+        }
+        if (is_root(&st)) {
+            fprintf(stderr, "rm: it is dangerous to operate recursively on '%s'\n", path);
+            fprintf(stderr, "rm: use --no-preserve-root to override this failsafe\n");
+            atomic_store(&c.status, 1);
+            continue;
+        }
+        if (my_strcmp(base, ".") == 0 || my_strcmp(base, "..") == 0) {
+            fprintf(stderr, "rm: refusing to remove '.' or '..' directory: skipping '%s'\n", path);
+            atomic_store(&c.status, 1);
+            continue;
+        }
+
+        walk_ops ops = {
+            .mask = 0,
+            .entry = remove_entry,
+            .leave = remove_dir,
+            .error = remove_error,
+            .data = &c,
+        };
+        if (walk_tree(path, &ops, 0) == -1) return 130;
+    }
+    return atomic_load(&c.status);
+}
@@ -0,0 +1,428 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/* Pathname expansion for *, ?, [...] and ** (any number of directories).
+   Directories are read with getdents64 and each listing is sorted once and
+   kept until glob_cache_clear(), so patterns such as src/a*.c src/b*.c or a
+   recursive ** never read the same directory twice. Matches come out of
+   the walk grouped by directory (** emits its zero-directory matches
+   before those below), so the result is sorted once at the end. ** does
+   not descend through symbolic links, so a link to a parent cannot make
+   it loop.
+   The listing of the current directory is also kept across commands while
+   an inotify watch on it (watch.c) stays quiet, and dropped on any change
+   or when cd moves elsewhere.
+   Backslash escapes a metacharacter; expand_args uses this to pass quoted
+   characters through literally. */
+
+struct linux_dirent64 {
+    ino64_t        d_ino;
+    off64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+typedef struct dir_entry {
+    const char* name;
+    unsigned char type;
+} dir_entry;
+
+typedef struct dir_listing {
+    char* path;
+    dir_entry* entries;
+    size_t count;
+    char* names;                /* storage for all entry names */
+    struct dir_listing* next;
+} dir_listing;
+
+#define LISTING_BUCKETS 64
+static dir_listing* listings[LISTING_BUCKETS];
+
+/* watch on the cwd while its listing is cached, and whether it fired */
+static int cwd_watch = -1;
+static int cwd_stale = 0;
+static int cwd_listening = 0;
+
+static unsigned listing_hash(const char* path)
+{
+    unsigned h = 5381;
+    while (*path) h = h * 33 + (unsigned char)*path++;
+    return h & (LISTING_BUCKETS - 1);
+}
+
+static int compare_entries(const void* a, const void* b)
+{
+    return strcmp(((const dir_entry*)a)->name, ((const dir_entry*)b)->name);
+}
+
+/* Read a directory with getdents64 into a new sorted listing, or NULL. */
+static dir_listing* read_listing(const char* path)
+{
+    int fd = openat(AT_FDCWD, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+
+    strbuf names = {0};
+    size_t count = 0;
+    char buf[32768];
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+        for (long off = 0; off < n; ) {
+            struct linux_dirent64* d = (struct linux_dirent64*)(buf + off);
+            off += d->d_reclen;
+            if (d->d_name[0] == '.' && (d->d_name[1] == '\0' ||
+                (d->d_name[1] == '.' && d->d_name[2] == '\0'))) continue;
+            /* store the type byte in front of each name */
+            if (sb_putc(&names, (char)d->d_type) == -1 ||
+                sb_append(&names, d->d_name, my_strlen(d->d_name) + 1) == -1) {
+                close(fd);
+                sb_free(&names);
+                return NULL;
+            }
+            count++;
+        }
+    }
+    close(fd);
+
+    dir_listing* listing = calloc(1, sizeof(dir_listing));
+    dir_entry* entries = malloc((count ? count : 1) * sizeof(dir_entry));
+    char* copy = my_strdup(path);
+    if (!listing || !entries || !copy) {
+        perror("malloc");
+        free(listing);
+        free(entries);
+        free(copy);
+        sb_free(&names);
+        return NULL;
+    }
+
+    const char* p = names.data;
+    for (size_t i = 0; i < count; i++) {
+        entries[i].type = (unsigned char)*p++;
+        entries[i].name = p;
+        p += my_strlen(p) + 1;
+    }
+    qsort(entries, count, sizeof(dir_entry), compare_entries);
+
+    listing->path = copy;
+    listing->entries = entries;
+    listing->count = count;
+    listing->names = names.data;
+    return listing;
+}
+
+static int is_cwd(const char* path)
+{
+    return path[0] == '.' && path[1] == '\0';
+}
+
+/* Something in the cwd changed, or cd left it. Only flags the listing:
+   it may be in use by a walk and is dropped before the next pattern. */
+static void cwd_changed(void* data, const char* name, unsigned mask)
+{
+    (void)data;
+    (void)name;
+    (void)mask;
+    cwd_stale = 1;
+}
+
+static void cwd_moved(void* data, const char* name, unsigned mask)
+{
+    cwd_changed(data, name, mask);
+    watch_remove(cwd_watch);
+    cwd_watch = -1;
+}
+
+static void free_listing(dir_listing* l)
+{
+    free(l->path);
+    free(l->entries);
+    free(l->names);
+    free(l);
+}
+
+/* Drop cached listings, keeping the cwd's if keep_cwd and it is still valid. */
+static void drop_listings(int keep_cwd)
+{
+    keep_cwd = keep_cwd && cwd_watch != -1 && !cwd_stale;
+    for (int i = 0; i < LISTING_BUCKETS; i++) {
+        dir_listing** link = &listings[i];
+        while (*link) {
+            dir_listing* l = *link;
+            if (keep_cwd && is_cwd(l->path)) {
+                link = &l->next;
+                continue;
+            }
+            *link = l->next;
+            free_listing(l);
+        }
+    }
+    if (!keep_cwd) cwd_stale = 0;
+}
+
+/* Cached listing of path, reading the directory on first use. */
+static dir_listing* get_listing(const char* path)
+{
+    unsigned h = listing_hash(path);
+    for (dir_listing* l = listings[h]; l; l = l->next) {
+        if (strcmp(l->path, path) == 0) return l;
+    }
+    /* watch before reading so no change can slip in between */
+    if (is_cwd(path) && cwd_watch == -1) {
+        if (!cwd_listening) cwd_listening = watch_cwd_listen(cwd_moved, NULL) == 0;
+        cwd_watch = watch_add(".", cwd_changed, NULL);
+        cwd_stale = 0;
+    }
+    dir_listing* l = read_listing(path);
+    if (l) {
+        l->next = listings[h];
+        listings[h] = l;
+    }
+    return l;
+}
+
+/* Drop cached listings. Called after each command so that a following
+   command sees files created by the previous one; the cwd listing stays
+   while its watch reports no change. */
+void glob_cache_clear(void)
+{
+    drop_listings(1);
+}
+
+/* Does pattern contain an unescaped *, ? or [ ? */
+int glob_has_magic(const char* pat, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (pat[i] == '\\' && i + 1 < len) { i++; continue; }
+        if (pat[i] == '*' || pat[i] == '?' || pat[i] == '[') return 1;
+    }
+    return 0;
+}
+
+/* Match a [...] class at pat (pointing at '['). Sets *end past the class.
+   Returns 1/0 for match, or -1 if the class is not terminated. */
+static int match_class(const char* pat, const char* pend, unsigned char c, const char** end)
+{
+    const char* p = pat + 1;
+    int negate = 0;
+    if (p < pend && (*p == '!' || *p == '^')) { negate = 1; p++; }
+
+    int matched = 0;
+    int first = 1;
+    while (p < pend && (*p != ']' || first)) {
+        first = 0;
+        unsigned char lo = (unsigned char)*p;
+        if (lo == '\\' && p + 1 < pend) lo = (unsigned char)*++p;
+        p++;
+        unsigned char hi = lo;
+        if (p + 1 < pend && *p == '-' && p[1] != ']') {
+            hi = (unsigned char)p[1];
+            if (hi == '\\' && p + 2 < pend) { hi = (unsigned char)p[2]; p++; }
+            p += 2;
+        }
+        if (lo <= c && c <= hi) matched = 1;
+    }
+    if (p >= pend) return -1;
+    *end = p + 1;
+    return matched != negate;
+}
+
+/* Match one path component against pat[0..len). */
+int glob_match(const char* pat, size_t len, const char* name)
+{
+    const char* p = pat;
+    const char* pend = pat + len;
+    const char* n = name;
+    const char* star_p = NULL;
+    const char* star_n = NULL;
+
+    while (*n) {
+        if (p < pend && *p == '*') {
+            star_p = ++p;
+            star_n = n;
+            continue;
+        }
+        if (p < pend) {
+            if (*p == '?') { p++; n++; continue; }
+            if (*p == '[') {
+                const char* end;
+                int m = match_class(p, pend, (unsigned char)*n, &end);
+                if (m == 1) { p = end; n++; continue; }
+                if (m == -1 && *n == '[') { p++; n++; continue; } /* literal [ */
+            } else {
+                char lit = *p;
+                const char* next = p + 1;
+                if (lit == '\\' && p + 1 < pend) { lit = p[1]; next = p + 2; }
+                if (lit == *n) { p = next; n++; continue; }
+            }
+        }
+        /* mismatch: let the last * absorb one more character */
+        if (!star_p) return 0;
+        p = star_p;
+        n = ++star_n;
+    }
+    while (p < pend && *p == '*') p++;
+    return p == pend;
+}
+
+/* Copy pat[0..len) without its escaping backslashes. */
+static int append_unescaped(strbuf* sb, const char* pat, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (pat[i] == '\\' && i + 1 < len) i++;
+        if (sb_putc(sb, pat[i]) == -1) return -1;
+    }
+    return 0;
+}
+
+/* Whether path is a directory; follow says whether a symlink to one counts. */
+static int is_directory(const char* path, unsigned char type, int follow)
+{
+    if (type == DT_DIR) return 1;
+    if (type != DT_UNKNOWN && !(type == DT_LNK && follow)) return 0;
+    struct stat st;
+    return (follow ? stat(path, &st) : lstat(path, &st)) == 0 && S_ISDIR(st.st_mode);
+}
+
+typedef struct glob_state {
+    const char* pattern;
+    strbuf* out;
+    strbuf path;
+    int matches;
+} glob_state;
+
+/* Emit path as a result; it must exist when the last component was literal. */
+static int emit(glob_state* g, int check_exists)
+{
+    if (sb_reserve(&g->path, 1) == -1) return -1;
+    g->path.data[g->path.len] = '\0';
+    if (check_exists) {
+        struct stat st;
+        if (lstat(g->path.data, &st) == -1) return 0;
+    }
+    g->matches++;
+    return sb_append(g->out, g->path.data, g->path.len + 1);
+}
+
+/* Extend g->path (currently naming a directory, or empty for ".") with the
+   components of the pattern starting at comp. */
+static int walk(glob_state* g, const char* comp)
+{
+    while (*comp == '/') comp++;
+    if (*comp == '\0') return emit(g, 0);
+
+    const char* slash = my_strchr(comp, '/');
+    size_t len = slash ? (size_t)(slash - comp) : (size_t)my_strlen(comp);
+    size_t base = g->path.len;
+    const char* dir = base ? g->path.data : ".";
+
+    if (!glob_has_magic(comp, len)) {
+        if (append_unescaped(&g->path, comp, len) == -1) return -1;
+        int r = slash ? (sb_putc(&g->path, '/') == -1 ? -1 : walk(g, slash + 1))
+                      : emit(g, 1);
+        g->path.len = base;
+        return r;
+    }
+
+    int globstar = len == 2 && comp[0] == '*' && comp[1] == '*';
+    if (sb_reserve(&g->path, 1) == -1) return -1;
+    g->path.data[base] = '\0';
+    dir_listing* listing = get_listing(dir);
+    if (!listing) return 0;
+
+    if (globstar) {
+        /* ** matches zero directories ... */
+        if (slash && walk(g, slash + 1) == -1) return -1;
+    }
+
+    for (size_t i = 0; i < listing->count; i++) {
+        const dir_entry* e = &listing->entries[i];
+        /* hidden entries only match a pattern that starts with a literal dot */
+        if (e->name[0] == '.' && comp[0] != '.') continue;
+        if (!globstar && !glob_match(comp, len, e->name)) continue;
+
+        g->path.len = base;
+        if (sb_append(&g->path, e->name, my_strlen(e->name)) == -1) return -1;
+        if (sb_reserve(&g->path, 1) == -1) return -1;
+        g->path.data[g->path.len] = '\0';
+
+        int r = 0;
+        if (globstar) {
+            /* a trailing ** matches every entry below the directory */
+            if (!slash) r = emit(g, 0);
+            /* ... or one more directory, then ** again */
+            if (r != -1 && is_directory(g->path.data, e->type, 0)) {
+                if (sb_putc(&g->path, '/') == -1) return -1;
+                r = walk(g, comp);
+            }
+        } else if (slash) {
+            if (is_directory(g->path.data, e->type, 1)) {
+                if (sb_putc(&g->path, '/') == -1) return -1;
+                r = walk(g, slash + 1);
+            }
+        } else {
+            r = emit(g, 0);
+        }
+        /* listings stay alive until glob_cache_clear, so e is still valid here */
+        if (r == -1) return -1;
+    }
+    g->path.len = base;
+    return 0;
+}
+
+static int compare_paths(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/* Sort the count NUL-terminated matches in out->data[start..]. */
+static int sort_matches(strbuf* out, size_t start, int count)
+{
+    size_t size = out->len - start;
+    const char** paths = malloc(count * sizeof(char*));
+    char* copy = malloc(size);
+    if (!paths || !copy) {
+        perror("malloc");
+        free(paths);
+        free(copy);
+        return -1;
+    }
+    memcpy(copy, out->data + start, size);
+    const char* p = copy;
+    for (int i = 0; i < count; i++) {
+        paths[i] = p;
+        p += my_strlen(p) + 1;
+    }
+    qsort(paths, count, sizeof(char*), compare_paths);
+    out->len = start;
+    for (int i = 0; i < count; i++) sb_append(out, paths[i], my_strlen(paths[i]) + 1);
+    free(paths);
+    free(copy);
+    return 0;
+}
+
+/* Expand pattern, appending each match NUL-terminated to out, sorted.
+   Returns the number of matches (0 if nothing matched) or -1 on error. */
+int glob_expand(const char* pattern, strbuf* out)
+{
+    /* apply pending directory changes before any listing is in use */
+    watch_dispatch();
+    if (cwd_stale) drop_listings(0);
+
+    size_t start = out->len;
+    glob_state g = { pattern, out, {0}, 0 };
+    const char* comp = pattern;
+    if (*comp == '/') {
+        if (sb_putc(&g.path, '/') == -1) return -1;
+        while (*comp == '/') comp++;
+    }
+    int r = walk(&g, comp);
+    sb_free(&g.path);
+    if (r == 0 && g.matches > 1) r = sort_matches(out, start, g.matches);
+    return r == -1 ? -1 : g.matches;
+}
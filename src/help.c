@@ -3,30 +3,32 @@
 #include <string.h>
 
 /* help <command> moved out of builtins.c to keep that file smaller.
-   Uses my_strcmp from helpers. */
+   Built-ins are described by the registry (builtins.def); the rest of
+   this file covers common external commands. Uses my_strcmp from helpers. */
 int command_help(char** args, char** env)
 {
     (void)env;
     if (!args || !args[1]) {
         printf("Usage: help <command>\n");
+        printf("Built-ins:");
+        for (size_t i = 0; i < builtin_count; i++) {
+            if (!(builtin_table[i].flags & BUILTIN_UNLISTED)) printf(" %s", builtin_table[i].name);
+        }
+        printf("\n");
         printf("Try: help cd | help pwd | help ls | help cp | help rm | help chmod | help uname | help df | help top | help run\n");
         return 0;
     }
 
     const char* cmd = args[1];
+    const builtin* b = builtin_lookup(cmd);
 
-    if (my_strcmp(cmd, "cd") == 0) {
-        printf("cd <directory>\n");
-        printf("  Change the current directory.\n");
-        printf("  Example: cd /tmp\n");
-    } else if (my_strcmp(cmd, "pwd") == 0) {
-        printf("pwd\n");
-        printf("  Print the current working directory.\n");
-        printf("  Example: pwd\n");
-    } else if (my_strcmp(cmd, "ls") == 0) {
-        printf("ls [options] [file...]\n");
-        printf("  List directory contents. The shell appends -F by default to mark directories with '/'.\n");
-        printf("  Example: ls -la\n");
+    if (b) {
+        if (b->help) {
+            printf("%s", b->help);
+        } else {
+            printf("%s\n", b->usage);
+            printf("  %s\n", b->summary);
+        }
     } else if (my_strcmp(cmd, "mkdir") == 0) {
         printf("mkdir <directory>\n");
         printf("  Create a new directory.\n");
@@ -39,22 +41,6 @@ int command_help(char** args, char** env)
         printf("touch <file>\n");
         printf("  Create an empty file or update file timestamps.\n");
         printf("  Example: touch file.txt\n");
-    } else if (my_strcmp(cmd, "cp") == 0) {
-        printf("cp <source> <dest>\n");
-        printf("  Copy files or directories (use -r for directories).\n");
-        printf("  Example: cp file.txt /tmp/file.txt\n");
-    } else if (my_strcmp(cmd, "mv") == 0) {
-        printf("mv <source> <dest>\n");
-        printf("  Move or rename files/directories.\n");
-        printf("  Example: mv oldname newname\n");
-    } else if (my_strcmp(cmd, "rm") == 0) {
-        printf("rm [options] <file>\n");
-        printf("  Remove files or directories (use -r to remove directories).\n");
-        printf("  Example: rm -r mydir\n");
-    } else if (my_strcmp(cmd, "cat") == 0) {
-        printf("cat <file>\n");
-        printf("  Concatenate and print file(s) to stdout.\n");
-        printf("  Example: cat file.txt\n");
     } else if (my_strcmp(cmd, "less") == 0) {
         printf("less <file>\n");
         printf("  Pager to view files interactively (q to quit).\n");
@@ -95,18 +81,6 @@ int command_help(char** args, char** env)
         printf("top\n");
         printf("  Interactive process viewer (press q to quit).\n");
         printf("  Example: top\n");
-    } else if (my_strcmp(cmd, "run") == 0) {
-        printf("run <file> [args...]\n");
-        printf("  Compile and/or run source files. Supported types: .c, .cpp, .cc, .cxx, .py, .java\n");
-        printf("  - C:    compiles with gcc and runs the produced binary.\n");
-        printf("  - C++:  compiles with g++ and runs the produced binary.\n");
-        printf("  - Python: runs with python3.\n");
-        printf("  - Java: javac then java (class name derived from filename).\n");
-        printf("  Examples:\n");
-        printf("    run hello.c\n");
-        printf("    run codes/cppt.cpp arg1 arg2\n");
-        printf("    run script.py --flag\n");
-        printf("    run MyClass.java\n");
     } else if (my_strcmp(cmd, "ping") == 0) {
         printf("ping [options] <host>\n");
         printf("  Send ICMP ECHO_REQUEST packets to network hosts and display replies.\n");
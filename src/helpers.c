@@ -1,4 +1,211 @@
 #include "my_shell.h"
+#include <stdint.h>
+
+/* String kernels behind my_strlen, my_strcmp, my_strncmp, my_strchr and
+   my_strtok. On x86-64 they scan 16 bytes at a time with SSE2, or 32 with
+   AVX2 when the CPU has it; the choice is made once at load time through
+   GNU ifunc. Aligned loads never cross a page, and unaligned loads are only
+   used when they stay inside the current page, so reading past the
+   terminating NUL is always safe. Other targets use the scalar versions,
+   which tests/test_helpers.c also checks the vector kernels against. */
+
+/* on x86-64 only the tests call the first two */
+__attribute__((unused))
+static size_t strlen_scalar(const char* s)
+{
+    const char* p = s;
+    while (*p) p++;
+    return p - s;
+}
+
+/* First byte equal to c or the terminating NUL. */
+__attribute__((unused))
+static const char* strchrnul_scalar(const char* s, char c)
+{
+    while (*s && *s != c) s++;
+    return s;
+}
+
+static int strncmp_scalar(const char* a, const char* b, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i] || a[i] == '\0') {
+            return (unsigned char)a[i] - (unsigned char)b[i];
+        }
+    }
+    return 0;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+/* A w-byte load at p does not cross into the next 4 KB page. */
+#define WITHIN_PAGE(p, w) (((uintptr_t)(p) & 4095) <= 4096 - (w))
+
+static size_t strlen_sse2(const char* s)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t off = (uintptr_t)s & 15;
+    const char* p = s - off;
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i*)p), zero)) >> off;
+    if (mask) return __builtin_ctz(mask);
+    for (;;) {
+        p += 16;
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i*)p), zero));
+        if (mask) return p - s + __builtin_ctz(mask);
+    }
+}
+
+__attribute__((target("avx2")))
+static size_t strlen_avx2(const char* s)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    size_t off = (uintptr_t)s & 31;
+    const char* p = s - off;
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)p), zero)) >> off;
+    if (mask) return __builtin_ctz(mask);
+    for (;;) {
+        p += 32;
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)p), zero));
+        if (mask) return p - s + __builtin_ctz(mask);
+    }
+}
+
+static const char* strchrnul_sse2(const char* s, char c)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t off = (uintptr_t)s & 15;
+    const char* p = s - off;
+    __m128i v = _mm_load_si128((const __m128i*)p);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, needle))) >> off;
+    if (mask) return s + __builtin_ctz(mask);
+    for (;;) {
+        p += 16;
+        v = _mm_load_si128((const __m128i*)p);
+        mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, needle)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+}
+
+__attribute__((target("avx2")))
+static const char* strchrnul_avx2(const char* s, char c)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t off = (uintptr_t)s & 31;
+    const char* p = s - off;
+    __m256i v = _mm256_load_si256((const __m256i*)p);
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, zero), _mm256_cmpeq_epi8(v, needle))) >> off;
+    if (mask) return s + __builtin_ctz(mask);
+    for (;;) {
+        p += 32;
+        v = _mm256_load_si256((const __m256i*)p);
+        mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, zero), _mm256_cmpeq_epi8(v, needle)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+}
+
+/* The two strings are rarely aligned alike, so compare with unaligned
+   loads while both stay within their pages and fall back to bytes for the
+   chunk that crosses a page boundary. strcmp is strncmp with n = SIZE_MAX. */
+static int strncmp_sse2(const char* a, const char* b, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    while (n > 0) {
+        if (n >= 16 && WITHIN_PAGE(a, 16) && WITHIN_PAGE(b, 16)) {
+            __m128i va = _mm_loadu_si128((const __m128i*)a);
+            __m128i vb = _mm_loadu_si128((const __m128i*)b);
+            unsigned stop = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xffff;
+            stop |= (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(va, zero));
+            if (stop) {
+                unsigned i = __builtin_ctz(stop);
+                return (unsigned char)a[i] - (unsigned char)b[i];
+            }
+            a += 16;
+            b += 16;
+            n -= 16;
+            continue;
+        }
+        size_t chunk = n < 16 ? n : 16;
+        int r = strncmp_scalar(a, b, chunk);
+        if (r != 0) return r;
+        for (size_t i = 0; i < chunk; i++) {
+            if (a[i] == '\0') return 0;
+        }
+        a += chunk;
+        b += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
+
+__attribute__((target("avx2")))
+static int strncmp_avx2(const char* a, const char* b, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    while (n > 0) {
+        if (n >= 32 && WITHIN_PAGE(a, 32) && WITHIN_PAGE(b, 32)) {
+            __m256i va = _mm256_loadu_si256((const __m256i*)a);
+            __m256i vb = _mm256_loadu_si256((const __m256i*)b);
+            unsigned stop = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+            stop |= (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, zero));
+            if (stop) {
+                unsigned i = __builtin_ctz(stop);
+                return (unsigned char)a[i] - (unsigned char)b[i];
+            }
+            a += 32;
+            b += 32;
+            n -= 32;
+            continue;
+        }
+        size_t chunk = n < 32 ? n : 32;
+        int r = strncmp_scalar(a, b, chunk);
+        if (r != 0) return r;
+        for (size_t i = 0; i < chunk; i++) {
+            if (a[i] == '\0') return 0;
+        }
+        a += chunk;
+        b += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
+
+typedef size_t (*strlen_fn)(const char*);
+typedef const char* (*strchrnul_fn)(const char*, char);
+typedef int (*strncmp_fn)(const char*, const char*, size_t);
+
+/* ifunc resolvers run during relocation, before any constructor */
+static strlen_fn resolve_strlen(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? strlen_avx2 : strlen_sse2;
+}
+
+static strchrnul_fn resolve_strchrnul(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? strchrnul_avx2 : strchrnul_sse2;
+}
+
+static strncmp_fn resolve_strncmp(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? strncmp_avx2 : strncmp_sse2;
+}
+
+static size_t fast_strlen(const char* s) __attribute__((ifunc("resolve_strlen")));
+static const char* fast_strchrnul(const char* s, char c) __attribute__((ifunc("resolve_strchrnul")));
+static int fast_strncmp(const char* a, const char* b, size_t n) __attribute__((ifunc("resolve_strncmp")));
+
+#else
+
+#define fast_strlen strlen_scalar
+#define fast_strchrnul strchrnul_scalar
+#define fast_strncmp strncmp_scalar
+
+#endif
 
 // 0: The strings are equal
 // < 0: str1 < str2
@@ -8,12 +215,7 @@ int my_strcmp(const char* str1, const char* str2)
 {
     if (str1 == NULL || str2 == NULL) return 1;
 
-    while (*str1 && (*str1 == *str2)) {
-        str1++;
-        str2++;
-    }
-
-    return *(unsigned char*)str1 - *(unsigned char*)str2;    
+    return fast_strncmp(str1, str2, SIZE_MAX);
 }
 
 // Length of the given strting.
@@ -21,12 +223,7 @@ int my_strlen(const char* str)
 {
     if (str == NULL) return -1;
 
-    size_t len = 0;
-    while (*str) {
-        len++;
-        str++;
-    }
-    return len;
+    return fast_strlen(str);
 }
 
 // 0: if strin are equal to n characters
@@ -37,20 +234,7 @@ int my_strncmp(const char* str1, const char* str2, size_t n)
 {
     if (str1 == NULL || str2 == NULL) return 1;
 
-    size_t i = 0;
-
-    while (i < n && str1[i] && str2[i]) {
-        if (str1[i] != str2[i]) {
-            return (unsigned char)str1[i] - (unsigned char)str2[i];
-        }
-        i++;
-    }
-
-    if (i == n) {
-        return 0;
-    }
-    
-    return (unsigned char)str1[i] - (unsigned char)str2[i];
+    return fast_strncmp(str1, str2, n);
 }
 
 // Searches the environment variables for the specified name and returns its value.
@@ -60,16 +244,8 @@ char* my_getenv(const char *name, char**env)
         return NULL;
     }
 
-    size_t name_len = my_strlen(name);
-
-    for (size_t i = 0; env[i]; i++)
-    {
-        // Check if the curr env var starts with 'name='
-        if (my_strncmp(env[i], name, name_len) == 0 && env[i][name_len] == '=') {
-            return &env[i][name_len + 1];
-        }
-    }
-    return NULL;
+    // Hashed lookup, see env_store.c
+    return env_lookup(name, my_strlen(name), env);
 }
 
 // Creates a duplicate of the input string by allocating new memory.
@@ -103,15 +279,11 @@ char* my_strcpy(char* dest, const char* src)
 }
 
 // Locates the first occurrence of a character in a string.
+// Unlike strchr, searching for '\0' finds nothing.
 char* my_strchr(const char* str, char c)
 {
-    while(*str) {
-        if (*str == c) {
-            return (char*)str;
-        }
-        str++;
-    }
-    return NULL;
+    const char* found = fast_strchrnul(str, c);
+    return *found && c ? (char*)found : NULL;
 }
 
 // Tokenizes a string by splitting it based on a set of delimiter characters.
@@ -127,7 +299,16 @@ char* my_strtok(char* input_string, const char* delimiter)
         return NULL;
     }
 
-    while (*input_string && my_strchr(delimiter, *input_string)) {
+    // Bitmap of the delimiter characters, tested once per byte
+    uint64_t set[4] = {0, 0, 0, 0};
+    size_t delimiter_count = 0;
+    for (const unsigned char* d = (const unsigned char*)delimiter; *d; d++) {
+        set[*d >> 6] |= 1ull << (*d & 63);
+        delimiter_count++;
+    }
+#define IS_DELIMITER(ch) ((set[(unsigned char)(ch) >> 6] >> ((unsigned char)(ch) & 63)) & 1)
+
+    while (*input_string && IS_DELIMITER(*input_string)) {
         input_string++;
     }
 
@@ -138,9 +319,15 @@ char* my_strtok(char* input_string, const char* delimiter)
 
     char* token = input_string;
 
-    while (*input_string && !my_strchr(delimiter, *input_string)) {
-        input_string++;
+    // A single delimiter (the PATH case) is found with the vector scan
+    if (delimiter_count == 1) {
+        input_string = (char*)fast_strchrnul(input_string, delimiter[0]);
+    } else {
+        while (*input_string && !IS_DELIMITER(*input_string)) {
+            input_string++;
+        }
     }
+#undef IS_DELIMITER
 
     if (*input_string) {
         *input_string = '\0';
@@ -165,4 +352,49 @@ char* my_strncpy(char* dest, const char* src, size_t n) {
     }
 
     return dest;
-}
\ No newline at end of file
+}
+
+// Grows the buffer so that at least extra more bytes fit. Returns 0 or -1.
+int sb_reserve(strbuf* sb, size_t extra)
+{
+    if (sb->len + extra <= sb->cap) return 0;
+
+    size_t cap = sb->cap ? sb->cap : 64;
+    while (cap < sb->len + extra) cap *= 2;
+
+    char* data = realloc(sb->data, cap);
+    if (data == NULL) {
+        perror("realloc");
+        return -1;
+    }
+    sb->data = data;
+    sb->cap = cap;
+    return 0;
+}
+
+// Appends n bytes to the buffer. Returns 0 or -1.
+int sb_append(strbuf* sb, const char* str, size_t n)
+{
+    if (sb_reserve(sb, n) == -1) return -1;
+    for (size_t i = 0; i < n; i++) {
+        sb->data[sb->len + i] = str[i];
+    }
+    sb->len += n;
+    return 0;
+}
+
+// Appends a single byte to the buffer. Returns 0 or -1.
+int sb_putc(strbuf* sb, char c)
+{
+    if (sb->len == sb->cap && sb_reserve(sb, 1) == -1) return -1;
+    sb->data[sb->len++] = c;
+    return 0;
+}
+
+// Releases the buffer and resets it to empty.
+void sb_free(strbuf* sb)
+{
+    free(sb->data);
+    sb->data = NULL;
+    sb->len = sb->cap = 0;
+}
@@ -2,15 +2,50 @@
 #include <ctype.h>
 #include <string.h>
 
-/* Parse input into argv-style array, honoring single and double quotes and backslash escapes.
-   Returns malloc'd NULL-terminated array; tokens and array must be freed with free_tokens(). */
+/* Given p pointing at "$(", return a pointer just past the matching ')',
+   or NULL if the substitution is not terminated. Quotes, escapes and nested
+   substitutions inside are skipped over. */
+const char* skip_substitution(const char* p)
+{
+    int depth = 0;
+    char quote = 0;
+    for (p++; *p; p++) {
+        if (quote) {
+            if (*p == quote) quote = 0;
+            else if (*p == '\\' && quote == '"' && p[1]) p++;
+            else if (quote == '"' && *p == '$' && p[1] == '(') {
+                const char* end = skip_substitution(p);
+                if (!end) return NULL;
+                p = end - 1;
+            }
+            continue;
+        }
+        if (*p == '\'' || *p == '"') quote = *p;
+        else if (*p == '\\' && p[1]) p++;
+        else if (*p == '$' && p[1] == '(') {
+            const char* end = skip_substitution(p);
+            if (!end) return NULL;
+            p = end - 1;
+        }
+        else if (*p == '(') depth++;
+        else if (*p == ')' && --depth == 0) return p + 1;
+    }
+    return NULL;
+}
+
+/* Split input into words, honoring single and double quotes and backslash escapes.
+   Quotes and backslashes are kept in the words: removing them is left to the
+   expansion stage (expand_args) so it knows which parts were quoted.
+   A $(...) substitution always stays within one word.
+   Returns a NULL-terminated array (tagged MEM_PARSER) to be freed with
+   free_tokens(), or NULL on allocation failure. */
 char** parse_input(char* input)
 {
     if (!input) return NULL;
 
     size_t capacity = 16;
     size_t count = 0;
-    char** tokens = malloc(capacity * sizeof(char*));
+    char** tokens = mem_alloc(MEM_PARSER, capacity * sizeof(char*));
     if (!tokens) { perror("malloc"); return NULL; }
 
     char* p = input;
@@ -21,67 +56,52 @@ char** parse_input(char* input)
 
         /* ensure capacity */
         if (count + 1 >= capacity) {
-            capacity *= 2;
-            char** tmp = realloc(tokens, capacity * sizeof(char*));
-            if (!tmp) { perror("realloc"); break; }
+            char** tmp = mem_realloc(MEM_PARSER, tokens, capacity * 2 * sizeof(char*));
+            if (!tmp) { perror("realloc"); goto fail; }
             tokens = tmp;
+            capacity *= 2;
         }
 
+        /* find the end of the word: unquoted whitespace or end of input */
+        char* begin = p;
         char quote = 0;
-        if (*p == '\'' || *p == '"') {
-            quote = *p;
-            p++;
-        }
-
-        /* build token in a dynamic buffer */
-        size_t buf_cap = 128;
-        size_t buf_len = 0;
-        char* buf = malloc(buf_cap);
-        if (!buf) { perror("malloc"); break; }
-
         while (*p) {
+            if (*p == '$' && p[1] == '(' && quote != '\'') {
+                const char* end = skip_substitution(p);
+                if (end) { p = (char*)end; continue; }
+            }
             if (quote) {
-                if (*p == quote) { p++; break; }        /* closing quote */
-                if (*p == '\\' && quote == '"' && p[1]) { /* allow backslash escapes inside double quotes */
-                    p++;
-                    buf[buf_len++] = *p++;
-                } else {
-                    buf[buf_len++] = *p++;
-                }
+                if (*p == quote) quote = 0;
+                else if (*p == '\\' && quote == '"' && p[1]) p++;
             } else {
                 if (isspace((unsigned char)*p)) break;
-                if (*p == '\'' || *p == '"') {
-                    /* start quoted segment inside unquoted token */
-                    quote = *p++;
-                    continue;
-                }
-                if (*p == '\\' && p[1]) {
-                    p++;
-                    buf[buf_len++] = *p++;
-                } else {
-                    buf[buf_len++] = *p++;
-                }
-            }
-            if (buf_len + 1 >= buf_cap) {
-                buf_cap *= 2;
-                char* nb = realloc(buf, buf_cap);
-                if (!nb) { perror("realloc"); free(buf); buf = NULL; break; }
-                buf = nb;
+                if (*p == '\'' || *p == '"') quote = *p;
+                else if (*p == '\\' && p[1]) p++;
             }
+            p++;
         }
 
-        if (!buf) break;
-        buf[buf_len] = '\0';
+        size_t len = p - begin;
+        char* buf = mem_alloc(MEM_PARSER, len + 1);
+        if (!buf) { perror("malloc"); goto fail; }
+        memcpy(buf, begin, len);
+        buf[len] = '\0';
         tokens[count++] = buf;
     }
 
     tokens[count] = NULL;
     return tokens;
+
+fail:
+    /* never hand back a truncated command */
+    tokens[count] = NULL;
+    free_tokens(tokens);
+    return NULL;
 }
 
 void free_tokens(char** tokens)
 {
     if (!tokens) return;
-    for (size_t i = 0; tokens[i]; ++i) free(tokens[i]);
-    free(tokens);
-}
\ No newline at end of file
+    for (size_t i = 0; tokens[i]; ++i) mem_free(tokens[i]);
+    mem_free(tokens);
+}
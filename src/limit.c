@@ -0,0 +1,459 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+/* limit: resource limits and accounting for one command.
+
+   limit gives the command a cgroup v2 leaf of its own, next to the
+   shell's, and runs it with every process the executor starts created
+   directly inside that leaf: clone3() with CLONE_INTO_CGROUP, or on
+   kernels without it a fork() whose child moves itself in before
+   execve. Memory, CPU and pid limits are written to the leaf, and its
+   cpu.stat and memory.peak are read back when the command is done, so
+   the numbers cover the whole tree of processes and nothing else. What
+   the command leaves running is killed with the leaf.
+
+   Controllers can only be given to children of a cgroup with no
+   processes in it, so the first limit moves the shell into a leaf of
+   its own (edosh-shell) if that is what stands in the way. Without a
+   writable cgroup v2 tree (no delegation, or a v1-only host) a memory
+   limit becomes RLIMIT_AS and a pid limit RLIMIT_NPROC in each child,
+   and the times come from getrusage(). A CPU limit has no rlimit
+   counterpart and is left out with a warning. RLIMIT_NPROC counts every
+   process of the user rather than of the command, and root is exempt
+   from it, so a pid limit warns too, and is left out for root.
+
+   Only builtins that do their work in processes they start
+   (BUILTIN_SPAWNS, such as run) can be limited. The others run inside
+   the shell, out of reach of both the leaf and the rlimits, and are
+   refused.
+
+   A clone3() child does not run glibc's fork handlers, so like a
+   forked child of this threaded shell it only makes async-signal-safe
+   calls until execve. */
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+#define CPU_PERIOD 100000       /* cpu.max period in microseconds */
+#define RMDIR_TRIES 100         /* waits of 1 ms for killed leftovers */
+
+/* struct clone_args of linux/sched.h, up to the cgroup field */
+struct clone3_args {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+typedef struct limit_request {
+    unsigned long long mem;     /* bytes, 0 for no limit */
+    double cpus;                /* CPUs' worth of time, 0 for no limit */
+    long pids;                  /* 0 for no limit */
+} limit_request;
+
+enum { APPLIED_MEM = 1, APPLIED_CPU = 2, APPLIED_PIDS = 4 };
+
+static int active = 0;          /* a limited command is running */
+static int leaf_fd = -1;        /* its cgroup, or -1 without one */
+static char leaf_path[PATH_MAX];
+static int clone3_works = 1;    /* cleared when the kernel lacks it */
+static int rlimit_mem = 0, rlimit_pids = 0;
+static struct rlimit mem_rlimit, pids_rlimit;
+
+/* Where the shell's cgroups live: "" before the first look, "-" when
+   there is no cgroup v2 tree to use. */
+static char cgroup_base[PATH_MAX];
+static unsigned leaf_seq = 0;
+
+int limit_active(void)
+{
+    return active;
+}
+
+/* ---- cgroup files ---- */
+
+static ssize_t read_at(int dir, const char* name, char* buf, size_t size)
+{
+    int fd = openat(dir, name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    buf[n > 0 ? n : 0] = '\0';
+    return n;
+}
+
+/* Write text to a cgroup file; errno is kept for the caller on failure. */
+static int write_at(int dir, const char* name, const char* text)
+{
+    int fd = openat(dir, name, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    ssize_t n = write(fd, text, my_strlen(text));
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return n == (ssize_t)my_strlen(text) ? 0 : -1;
+}
+
+/* The value of key in a flat keyed file such as cpu.stat, or 0. */
+static unsigned long long keyed_value(const char* text, const char* key)
+{
+    size_t len = my_strlen(key);
+    for (const char* p = text; *p; ) {
+        if (strncmp(p, key, len) == 0 && p[len] == ' ') return strtoull(p + len + 1, NULL, 10);
+        const char* nl = my_strchr(p, '\n');
+        if (!nl) break;
+        p = nl + 1;
+    }
+    return 0;
+}
+
+/* Whether word appears in a space separated list such as
+   cgroup.controllers. */
+static int has_word(const char* list, const char* word)
+{
+    size_t len = my_strlen(word);
+    for (const char* p = list; (p = strstr(p, word)); p += len) {
+        if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\n' || !p[len])) return 1;
+    }
+    return 0;
+}
+
+/* The shell's own cgroup v2 directory: the cgroup2 mount from
+   mountinfo joined with the "0::" line of /proc/self/cgroup. */
+static int own_cgroup(char* out, size_t size)
+{
+    char mount[PATH_MAX] = "", root[PATH_MAX] = "";
+    FILE* f = fopen("/proc/self/mountinfo", "re");
+    if (!f) return -1;
+    char* line = NULL;
+    size_t cap = 0;
+    while (!mount[0] && getline(&line, &cap, f) != -1) {
+        /* id parent dev root mountpoint options ... - fstype source ... */
+        if (!strstr(line, " - cgroup2 ")) continue;
+        char* field = line;
+        for (int i = 0; i < 3 && field; i++) {
+            field = my_strchr(field, ' ');
+            if (field) field++;
+        }
+        if (!field || sscanf(field, "%4095s %4095s", root, mount) != 2) mount[0] = '\0';
+    }
+    fclose(f);
+
+    char path[PATH_MAX] = "";
+    f = mount[0] ? fopen("/proc/self/cgroup", "re") : NULL;
+    while (f && !path[0] && getline(&line, &cap, f) != -1) {
+        if (strncmp(line, "0::", 3) != 0) continue;
+        line[strcspn(line, "\n")] = '\0';
+        snprintf(path, sizeof(path), "%s", line + 3);
+    }
+    if (f) fclose(f);
+    free(line);
+    if (!mount[0] || path[0] != '/') return -1;
+
+    /* inside a cgroup namespace the mount may start below the root */
+    const char* rel = path;
+    size_t rlen = my_strlen(root);
+    if (my_strcmp(root, "/") != 0 && strncmp(path, root, rlen) == 0) rel = path + rlen;
+    int n = snprintf(out, size, "%s%s", mount, my_strcmp(rel, "/") == 0 ? "" : rel);
+    return n > 0 && (size_t)n < size ? 0 : -1;
+}
+
+/* Hand the controllers the request needs to the children of base. When
+   the shell itself is in base, move it to a leaf first. */
+static void enable_controllers(int base, const limit_request* req)
+{
+    char available[256];
+    if (read_at(base, "cgroup.controllers", available, sizeof(available)) <= 0) return;
+
+    /* memory and pids also give memory.peak and pids.peak */
+    const char* wanted[] = { "memory", "pids", req->cpus > 0 ? "cpu" : NULL };
+    for (size_t i = 0; i < sizeof(wanted) / sizeof(*wanted); i++) {
+        if (!wanted[i] || !has_word(available, wanted[i])) continue;
+        char text[16];
+        snprintf(text, sizeof(text), "+%s", wanted[i]);
+        if (write_at(base, "cgroup.subtree_control", text) == 0 || errno != EBUSY) continue;
+
+        char pid[16];
+        snprintf(pid, sizeof(pid), "%d", (int)getpid());
+        if (mkdirat(base, "edosh-shell", 0755) == -1 && errno != EEXIST) return;
+        int shell = openat(base, "edosh-shell", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        int moved = shell != -1 && write_at(shell, "cgroup.procs", pid) == 0;
+        if (shell != -1) close(shell);
+        if (!moved || write_at(base, "cgroup.subtree_control", text) == -1) return;
+    }
+}
+
+/* Create the leaf for one command and write the limits it can hold.
+   Returns the APPLIED_* limits, or -1 without a leaf. */
+static int open_leaf(const limit_request* req)
+{
+    if (!cgroup_base[0] && own_cgroup(cgroup_base, sizeof(cgroup_base)) == -1) {
+        snprintf(cgroup_base, sizeof(cgroup_base), "-");
+    }
+    if (my_strcmp(cgroup_base, "-") == 0) return -1;
+    int base = open(cgroup_base, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (base == -1) return -1;
+    enable_controllers(base, req);
+
+    int n = snprintf(leaf_path, sizeof(leaf_path), "%s/edosh-%d-%u", cgroup_base, (int)getpid(), leaf_seq++);
+    close(base);
+    if (n < 0 || (size_t)n >= sizeof(leaf_path) || mkdir(leaf_path, 0755) == -1) return -1;
+    leaf_fd = open(leaf_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (leaf_fd == -1) {
+        rmdir(leaf_path);
+        return -1;
+    }
+
+    int applied = 0;
+    char text[64];
+    if (req->mem) {
+        snprintf(text, sizeof(text), "%llu", req->mem);
+        /* without swap limited too, the limit only moves memory to swap */
+        if (write_at(leaf_fd, "memory.max", text) == 0) {
+            write_at(leaf_fd, "memory.swap.max", "0");
+            applied |= APPLIED_MEM;
+        }
+    }
+    if (req->cpus > 0) {
+        long quota = (long)(req->cpus * CPU_PERIOD + 0.5);
+        snprintf(text, sizeof(text), "%ld %d", quota < 1000 ? 1000 : quota, CPU_PERIOD);
+        if (write_at(leaf_fd, "cpu.max", text) == 0) applied |= APPLIED_CPU;
+    }
+    if (req->pids) {
+        snprintf(text, sizeof(text), "%ld", req->pids);
+        if (write_at(leaf_fd, "pids.max", text) == 0) applied |= APPLIED_PIDS;
+    }
+    return applied;
+}
+
+/* Kill what is still in the leaf and remove it. */
+static void close_leaf(void)
+{
+    if (leaf_fd == -1) return;
+    char events[256];
+    if (read_at(leaf_fd, "cgroup.events", events, sizeof(events)) > 0 && keyed_value(events, "populated")) {
+        fprintf(stderr, "limit: killing what the command left running\n");
+        write_at(leaf_fd, "cgroup.kill", "1");
+    }
+    close(leaf_fd);
+    leaf_fd = -1;
+    struct timespec ms = { 0, 1000000 };
+    for (int i = 0; rmdir(leaf_path) == -1 && errno == EBUSY && i < RMDIR_TRIES; i++) nanosleep(&ms, NULL);
+}
+
+/* ---- spawning ---- */
+
+/* fork(), except that while a limited command runs the child starts in
+   its leaf and with its rlimits. Called by the executor. */
+pid_t limit_fork(void)
+{
+    if (!active) return fork();
+
+    pid_t pid = -1;
+    int joined = 0;
+    if (leaf_fd != -1 && clone3_works) {
+        struct clone3_args args;
+        memset(&args, 0, sizeof(args));
+        args.flags = CLONE_INTO_CGROUP;
+        args.exit_signal = SIGCHLD;
+        args.cgroup = leaf_fd;
+        pid = syscall(SYS_clone3, &args, sizeof(args));
+        if (pid == -1 && (errno == ENOSYS || errno == E2BIG || errno == EINVAL)) clone3_works = 0;
+        joined = pid != -1;
+    }
+    if (pid == -1) pid = fork();
+    if (pid != 0) return pid;
+
+    /* in the child: nothing that allocates or takes a lock */
+    if (!joined && leaf_fd != -1) write_at(leaf_fd, "cgroup.procs", "0");
+    if (rlimit_mem) setrlimit(RLIMIT_AS, &mem_rlimit);
+    if (rlimit_pids) setrlimit(RLIMIT_NPROC, &pids_rlimit);
+    return 0;
+}
+
+/* ---- reporting ---- */
+
+static double since_ms(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static double timeval_s(const struct timeval* tv)
+{
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void report_cgroup(double wall_ms)
+{
+    char text[1024];
+    unsigned long long usage = 0, user = 0, system = 0, throttled = 0, throttled_us = 0;
+    if (read_at(leaf_fd, "cpu.stat", text, sizeof(text)) > 0) {
+        usage = keyed_value(text, "usage_usec");
+        user = keyed_value(text, "user_usec");
+        system = keyed_value(text, "system_usec");
+        throttled = keyed_value(text, "nr_throttled");
+        throttled_us = keyed_value(text, "throttled_usec");
+    }
+    fprintf(stderr, "limit: %.1f ms, cpu %.3f s (user %.3f s, system %.3f s)",
+            wall_ms, usage / 1e6, user / 1e6, system / 1e6);
+    if (read_at(leaf_fd, "memory.peak", text, sizeof(text)) > 0) {
+        char size[32];
+        format_size_human(size, sizeof(size), strtoull(text, NULL, 10));
+        fprintf(stderr, ", memory peak %s", size);
+    }
+    if (read_at(leaf_fd, "pids.peak", text, sizeof(text)) > 0) {
+        fprintf(stderr, ", pids peak %llu", strtoull(text, NULL, 10));
+    }
+    fputc('\n', stderr);
+
+    if (throttled) {
+        fprintf(stderr, "limit: throttled %llu times, %.3f s in all\n", throttled, throttled_us / 1e6);
+    }
+    if (read_at(leaf_fd, "memory.events", text, sizeof(text)) > 0 && keyed_value(text, "oom_kill")) {
+        fprintf(stderr, "limit: %llu processes killed at the memory limit\n", keyed_value(text, "oom_kill"));
+    }
+}
+
+static void report_rusage(double wall_ms, const struct rusage* before)
+{
+    struct rusage after;
+    getrusage(RUSAGE_CHILDREN, &after);
+    double user = timeval_s(&after.ru_utime) - timeval_s(&before->ru_utime);
+    double system = timeval_s(&after.ru_stime) - timeval_s(&before->ru_stime);
+    fprintf(stderr, "limit: %.1f ms, cpu %.3f s (user %.3f s, system %.3f s)",
+            wall_ms, user + system, user, system);
+    /* ru_maxrss is the largest child ever waited for, so it only says
+       something about this command when it grew */
+    if (after.ru_maxrss > before->ru_maxrss) {
+        char size[32];
+        format_size_human(size, sizeof(size), (unsigned long long)after.ru_maxrss * 1024);
+        fprintf(stderr, ", max rss %s", size);
+    }
+    fputc('\n', stderr);
+}
+
+/* ---- the builtin ---- */
+
+/* "512M", "1.5G", "4096": bytes, with binary K, M, G and T suffixes.
+   Returns 0 if s is not a size. */
+static unsigned long long parse_size(const char* s)
+{
+    char* end;
+    double v = strtod(s, &end);
+    if (end == s || v <= 0) return 0;
+    static const char units[] = "KMGT";
+    if (*end) {
+        const char* u = my_strchr(units, *end >= 'a' ? *end - 'a' + 'A' : *end);
+        if (!u || end[1]) return 0;
+        for (int i = 0; i <= u - units; i++) v *= 1024;
+    }
+    return (unsigned long long)v;
+}
+
+static int usage(void)
+{
+    fprintf(stderr, "usage: limit [--mem SIZE] [--cpu N] [--pids N] command [args...]\n");
+    return 2;
+}
+
+int command_limit(char** args, char*** env)
+{
+    limit_request req = { 0, 0, 0 };
+    int i = 1;
+    for (; args[i] && args[i][0] == '-'; i += 2) {
+        if (my_strcmp(args[i], "--") == 0) {
+            i++;
+            break;
+        }
+        const char* value = args[i + 1];
+        if (!value) return usage();
+        char* end = NULL;
+        if (my_strcmp(args[i], "--mem") == 0) {
+            req.mem = parse_size(value);
+            if (!req.mem) {
+                fprintf(stderr, "limit: bad size '%s'\n", value);
+                return 2;
+            }
+        } else if (my_strcmp(args[i], "--cpu") == 0) {
+            req.cpus = strtod(value, &end);
+            if (end == value || *end || req.cpus <= 0) {
+                fprintf(stderr, "limit: bad CPU count '%s'\n", value);
+                return 2;
+            }
+        } else if (my_strcmp(args[i], "--pids") == 0) {
+            req.pids = strtol(value, &end, 10);
+            if (end == value || *end || req.pids <= 0) {
+                fprintf(stderr, "limit: bad pid count '%s'\n", value);
+                return 2;
+            }
+        } else {
+            return usage();
+        }
+    }
+    if (!args[i]) return usage();
+    if (active) {
+        fprintf(stderr, "limit: already inside limit\n");
+        return 1;
+    }
+    const builtin* b = builtin_lookup(args[i]);
+    if (b && !(b->flags & BUILTIN_SPAWNS)) {
+        fprintf(stderr, "limit: %s runs inside the shell and cannot be limited\n", args[i]);
+        return 1;
+    }
+
+    struct rusage before;
+    getrusage(RUSAGE_CHILDREN, &before);
+    int applied = open_leaf(&req);
+    if (applied == -1) applied = 0;
+
+    /* what the leaf could not take falls back to rlimits */
+    rlimit_mem = req.mem && !(applied & APPLIED_MEM);
+    mem_rlimit.rlim_cur = mem_rlimit.rlim_max = req.mem;
+    rlimit_pids = req.pids && !(applied & APPLIED_PIDS);
+    pids_rlimit.rlim_cur = pids_rlimit.rlim_max = req.pids;
+    if (rlimit_pids && getuid() == 0) {
+        rlimit_pids = 0;
+        fprintf(stderr, "limit: no cgroup pids controller here and RLIMIT_NPROC does not bind root, "
+                        "running without a pid limit\n");
+    } else if (rlimit_pids) {
+        fprintf(stderr, "limit: no cgroup pids controller here, the pid limit is RLIMIT_NPROC, "
+                        "which counts every process of this user\n");
+    }
+    if (req.cpus > 0 && !(applied & APPLIED_CPU)) {
+        fprintf(stderr, "limit: no cgroup cpu controller here, running without a CPU limit\n");
+    }
+
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    active = 1;
+    int status = shell_builts(args + i, env);
+    active = 0;
+    double wall_ms = since_ms(&started);
+
+    if (leaf_fd != -1) report_cgroup(wall_ms);
+    else report_rusage(wall_ms, &before);
+    close_leaf();
+    rlimit_mem = rlimit_pids = 0;
+    return status;
+}
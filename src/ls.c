@@ -0,0 +1,691 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <limits.h>
+#include <pwd.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <time.h>
+
+/* Native ls. Runs in the shell process: directories are read with
+   getdents64, the d_type of each entry answers "is it a directory or a
+   link" without a stat, and statx is only called, relative to the open
+   directory fd and with the smallest field mask that will do, for entries
+   whose type, mode or times are actually printed or sorted on. Everything
+   goes through one output buffer written with write(2) in 64 KB pieces.
+
+   Supported: -a -A -l -h -F -p -R -d -1 -r -t -S -U and the matching long
+   options. Like the old wrapper around /bin/ls, -F is on unless -p is
+   given. Any other option hands the command to the external ls. */
+
+struct linux_dirent64 {
+    ino64_t        d_ino;
+    off64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+#define LS_FLUSH_AT 65536
+#define SIX_MONTHS (365 * 24 * 3600 / 2)
+
+typedef struct ls_opts {
+    int all;                    /* -a: everything, including . and .. */
+    int almost_all;             /* -A: hidden files but not . and .. */
+    int long_format;            /* -l */
+    int human;                  /* -h */
+    int classify;               /* -F: / @ | = * suffixes */
+    int slash_dirs;             /* -p: / on directories only */
+    int recursive;              /* -R */
+    int directory;              /* -d: list directories themselves */
+    int one_per_line;           /* -1, or output is not a terminal */
+    int reverse;                /* -r */
+    char sort;                  /* 'n'ame, 't'ime, 'S'ize or 'U'nsorted */
+} ls_opts;
+
+typedef struct ls_entry {
+    const char* name;
+    unsigned char type;         /* DT_*, from getdents or statx */
+    unsigned char have_stat;
+    mode_t mode;
+    nlink_t nlink;
+    uid_t uid;
+    gid_t gid;
+    unsigned long long size;
+    unsigned long long blocks;  /* 512-byte units */
+    long long mtime;
+    unsigned mtime_nsec;
+    unsigned rdev_major, rdev_minor;
+} ls_entry;
+
+typedef struct ls_ctx {
+    ls_opts o;
+    strbuf out;
+    int width;                  /* terminal columns */
+    int status;
+    int printed;                /* anything listed yet (for blank lines) */
+    int interrupted;            /* Ctrl-C seen during -R */
+    time_t now;
+} ls_ctx;
+
+/* ---- output ---- */
+
+static void out_flush(ls_ctx* c)
+{
+    size_t off = 0;
+    while (off < c->out.len) {
+        ssize_t n = write(STDOUT_FILENO, c->out.data + off, c->out.len - off);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        off += n;
+    }
+    c->out.len = 0;
+}
+
+static void out_put(ls_ctx* c, const char* s, size_t n)
+{
+    sb_append(&c->out, s, n);
+    if (c->out.len >= LS_FLUSH_AT) out_flush(c);
+}
+
+static void out_str(ls_ctx* c, const char* s)
+{
+    out_put(c, s, my_strlen(s));
+}
+
+static void out_pad(ls_ctx* c, size_t n)
+{
+    static const char spaces[] = "                                ";
+    while (n > 0) {
+        size_t k = n < sizeof(spaces) - 1 ? n : sizeof(spaces) - 1;
+        out_put(c, spaces, k);
+        n -= k;
+    }
+}
+
+/* ---- entry details ---- */
+
+static unsigned char type_of_mode(mode_t mode)
+{
+    switch (mode & S_IFMT) {
+    case S_IFDIR:  return DT_DIR;
+    case S_IFLNK:  return DT_LNK;
+    case S_IFREG:  return DT_REG;
+    case S_IFIFO:  return DT_FIFO;
+    case S_IFSOCK: return DT_SOCK;
+    case S_IFCHR:  return DT_CHR;
+    case S_IFBLK:  return DT_BLK;
+    default:       return DT_UNKNOWN;
+    }
+}
+
+/* statx e->name relative to dirfd, asking only for mask and the type.
+   The type and mode are taken only as far as stx_mask says they were
+   filled in; otherwise e keeps the type d_type gave it. */
+static void stat_entry(int dirfd, const char* name, ls_entry* e, unsigned mask, int follow)
+{
+    struct statx st;
+    int flags = AT_NO_AUTOMOUNT | (follow ? 0 : AT_SYMLINK_NOFOLLOW);
+    if (statx(dirfd, name, flags, mask | STATX_TYPE, &st) == -1) return;
+    e->have_stat = 1;
+    e->mode = ((st.stx_mask & STATX_TYPE) ? st.stx_mode & S_IFMT : 0) |
+              ((st.stx_mask & STATX_MODE) ? st.stx_mode & ~S_IFMT : 0);
+    if (st.stx_mask & STATX_TYPE) e->type = type_of_mode(st.stx_mode);
+    e->nlink = st.stx_nlink;
+    e->uid = st.stx_uid;
+    e->gid = st.stx_gid;
+    e->size = st.stx_size;
+    e->blocks = st.stx_blocks;
+    e->mtime = st.stx_mtime.tv_sec;
+    e->mtime_nsec = st.stx_mtime.tv_nsec;
+    e->rdev_major = st.stx_rdev_major;
+    e->rdev_minor = st.stx_rdev_minor;
+}
+
+/* The statx fields an entry needs under these options, or 0 for none. */
+static unsigned stat_mask(const ls_opts* o, const ls_entry* e)
+{
+    if (o->long_format) return STATX_BASIC_STATS;
+    unsigned mask = 0;
+    if (o->sort == 't') mask |= STATX_MTIME;
+    if (o->sort == 'S') mask |= STATX_SIZE;
+    /* an executable needs its mode; other types are known from d_type */
+    if (o->classify && (e->type == DT_REG || e->type == DT_UNKNOWN)) mask |= STATX_TYPE | STATX_MODE;
+    if ((o->recursive || o->slash_dirs) && e->type == DT_UNKNOWN) mask |= STATX_TYPE;
+    return mask;
+}
+
+static char suffix_of(const ls_opts* o, const ls_entry* e)
+{
+    if (o->slash_dirs) return e->type == DT_DIR ? '/' : 0;
+    if (!o->classify) return 0;
+    switch (e->type) {
+    case DT_DIR:  return '/';
+    case DT_LNK:  return o->long_format ? 0 : '@';
+    case DT_FIFO: return '|';
+    case DT_SOCK: return '=';
+    case DT_REG:  return e->have_stat && (e->mode & 0111) ? '*' : 0;
+    default:      return 0;
+    }
+}
+
+static size_t display_len(const ls_opts* o, const ls_entry* e)
+{
+    return my_strlen(e->name) + (suffix_of(o, e) ? 1 : 0);
+}
+
+/* 1023, 1.0K, 9.9K, 10K, 1.5M: rounded up, as ls -h and du -h print sizes. */
+void format_size_human(char* buf, size_t size, unsigned long long bytes)
+{
+    static const char units[] = "KMGTPE";
+    if (bytes < 1024) {
+        snprintf(buf, size, "%llu", bytes);
+        return;
+    }
+    double v = bytes;
+    int u = -1;
+    while (v >= 1024 && u < 5) {
+        v /= 1024;
+        u++;
+    }
+    /* round up like coreutils: one decimal below 10, none above */
+    double tenths = (double)(unsigned long long)(v * 10);
+    if (tenths < v * 10) tenths += 1;
+    if (tenths < 100) {
+        snprintf(buf, size, "%.1f%c", tenths / 10, units[u]);
+    } else {
+        unsigned long long whole = (unsigned long long)v;
+        if (whole < v) whole++;
+        if (whole >= 1024 && u < 5) snprintf(buf, size, "1.0%c", units[u + 1]);
+        else snprintf(buf, size, "%llu%c", whole, units[u]);
+    }
+}
+
+static void format_mode(char* s, const ls_entry* e)
+{
+    static const char types[] = "?pc?d?b?-?l?s???";
+    mode_t m = e->mode;
+    s[0] = types[(m & S_IFMT) >> 12];
+    s[1] = m & S_IRUSR ? 'r' : '-';
+    s[2] = m & S_IWUSR ? 'w' : '-';
+    s[3] = m & S_ISUID ? (m & S_IXUSR ? 's' : 'S') : (m & S_IXUSR ? 'x' : '-');
+    s[4] = m & S_IRGRP ? 'r' : '-';
+    s[5] = m & S_IWGRP ? 'w' : '-';
+    s[6] = m & S_ISGID ? (m & S_IXGRP ? 's' : 'S') : (m & S_IXGRP ? 'x' : '-');
+    s[7] = m & S_IROTH ? 'r' : '-';
+    s[8] = m & S_IWOTH ? 'w' : '-';
+    s[9] = m & S_ISVTX ? (m & S_IXOTH ? 't' : 'T') : (m & S_IXOTH ? 'x' : '-');
+    s[10] = '\0';
+}
+
+/* Owner and group names, remembered since the same few ids repeat. */
+#define ID_CACHE 16
+typedef struct id_name {
+    unsigned id;
+    int valid;
+    char name[33];
+} id_name;
+
+static const char* id_lookup(id_name* cache, unsigned id, int group)
+{
+    id_name* slot = &cache[id % ID_CACHE];
+    if (!slot->valid || slot->id != id) {
+        const char* name = NULL;
+        if (group) {
+            struct group* g = getgrgid(id);
+            if (g) name = g->gr_name;
+        } else {
+            struct passwd* p = getpwuid(id);
+            if (p) name = p->pw_name;
+        }
+        if (name) snprintf(slot->name, sizeof(slot->name), "%s", name);
+        else snprintf(slot->name, sizeof(slot->name), "%u", id);
+        slot->id = id;
+        slot->valid = 1;
+    }
+    return slot->name;
+}
+
+static id_name user_names[ID_CACHE];
+static id_name group_names[ID_CACHE];
+
+/* ---- sorting ---- */
+
+static int sort_key;            /* qsort has no context argument */
+static int sort_reverse;
+
+static int compare_entries(const void* pa, const void* pb)
+{
+    const ls_entry* a = *(ls_entry* const*)pa;
+    const ls_entry* b = *(ls_entry* const*)pb;
+    int r = 0;
+    if (sort_key == 't') {
+        if (a->mtime != b->mtime) r = a->mtime < b->mtime ? 1 : -1;
+        else if (a->mtime_nsec != b->mtime_nsec) r = a->mtime_nsec < b->mtime_nsec ? 1 : -1;
+    } else if (sort_key == 'S') {
+        if (a->size != b->size) r = a->size < b->size ? 1 : -1;
+    }
+    if (r == 0) r = strcmp(a->name, b->name);
+    return sort_reverse ? -r : r;
+}
+
+/* Sorts pointers, not the entries themselves, to keep qsort's moves small. */
+static void sort_entries(const ls_opts* o, ls_entry** list, size_t count)
+{
+    if (o->sort == 'U') return;
+    sort_key = o->sort;
+    sort_reverse = o->reverse;
+    qsort(list, count, sizeof(ls_entry*), compare_entries);
+}
+
+/* ---- printing ---- */
+
+static void print_name(ls_ctx* c, const ls_entry* e)
+{
+    out_str(c, e->name);
+    char s = suffix_of(&c->o, e);
+    if (s) out_put(c, &s, 1);
+}
+
+static void print_long(ls_ctx* c, int dirfd, ls_entry** list, size_t count, int show_total)
+{
+    size_t w_links = 1, w_user = 1, w_group = 1, w_size = 1;
+    unsigned long long total = 0;
+    char buf[64];
+    char date[64];
+    size_t date_len = 0;
+    time_t date_for = 0;
+    int date_valid = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        ls_entry* e = list[i];
+        if (!e->have_stat) continue;
+        total += e->blocks;
+        size_t n = snprintf(buf, sizeof(buf), "%lu", (unsigned long)e->nlink);
+        if (n > w_links) w_links = n;
+        n = my_strlen(id_lookup(user_names, e->uid, 0));
+        if (n > w_user) w_user = n;
+        n = my_strlen(id_lookup(group_names, e->gid, 1));
+        if (n > w_group) w_group = n;
+        if (e->type == DT_CHR || e->type == DT_BLK) {
+            n = snprintf(buf, sizeof(buf), "%u, %u", e->rdev_major, e->rdev_minor);
+        } else if (c->o.human) {
+            format_size_human(buf, sizeof(buf), e->size);
+            n = my_strlen(buf);
+        } else {
+            n = snprintf(buf, sizeof(buf), "%llu", e->size);
+        }
+        if (n > w_size) w_size = n;
+    }
+
+    if (show_total) {
+        out_str(c, "total ");
+        if (c->o.human) format_size_human(buf, sizeof(buf), total * 512);
+        else snprintf(buf, sizeof(buf), "%llu", (total + 1) / 2);
+        out_str(c, buf);
+        out_str(c, "\n");
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        ls_entry* e = list[i];
+        if (!e->have_stat) {
+            out_str(c, "?????????? ? ? ? ?            ? ");
+            print_name(c, e);
+            out_str(c, "\n");
+            continue;
+        }
+        char mode[11];
+        format_mode(mode, e);
+        out_str(c, mode);
+
+        size_t n = snprintf(buf, sizeof(buf), "%lu", (unsigned long)e->nlink);
+        out_pad(c, 1 + w_links - n);
+        out_put(c, buf, n);
+
+        const char* user = id_lookup(user_names, e->uid, 0);
+        out_str(c, " ");
+        out_str(c, user);
+        out_pad(c, w_user - my_strlen(user) + 1);
+        const char* group = id_lookup(group_names, e->gid, 1);
+        out_str(c, group);
+        out_pad(c, w_group - my_strlen(group));
+
+        if (e->type == DT_CHR || e->type == DT_BLK) {
+            n = snprintf(buf, sizeof(buf), "%u, %u", e->rdev_major, e->rdev_minor);
+        } else if (c->o.human) {
+            format_size_human(buf, sizeof(buf), e->size);
+            n = my_strlen(buf);
+        } else {
+            n = snprintf(buf, sizeof(buf), "%llu", e->size);
+        }
+        out_pad(c, 1 + w_size - n);
+        out_put(c, buf, n);
+
+        /* files written together share a timestamp; format each once */
+        time_t t = (time_t)e->mtime;
+        if (!date_valid || t != date_for) {
+            struct tm tm;
+            localtime_r(&t, &tm);
+            int recent = t > c->now - SIX_MONTHS && t <= c->now + 3600;
+            date_len = strftime(date, sizeof(date), recent ? " %b %e %H:%M " : " %b %e  %Y ", &tm);
+            date_for = t;
+            date_valid = 1;
+        }
+        out_put(c, date, date_len);
+
+        print_name(c, e);
+        if (e->type == DT_LNK) {
+            char target[PATH_MAX];
+            ssize_t len = readlinkat(dirfd, e->name, target, sizeof(target) - 1);
+            if (len >= 0) {
+                out_str(c, " -> ");
+                out_put(c, target, len);
+                /* -F classifies what the link points at */
+                ls_entry to;
+                memset(&to, 0, sizeof(to));
+                if (c->o.classify || c->o.slash_dirs) {
+                    stat_entry(dirfd, e->name, &to, STATX_TYPE | STATX_MODE, 1);
+                }
+                char s = to.have_stat ? suffix_of(&c->o, &to) : 0;
+                if (s) out_put(c, &s, 1);
+            }
+        }
+        out_str(c, "\n");
+    }
+}
+
+/* Columns, filled top to bottom then left to right, as ls does. */
+static void print_columns(ls_ctx* c, ls_entry** list, size_t count)
+{
+    if (count == 0) return;
+    if (c->o.one_per_line) {
+        for (size_t i = 0; i < count; i++) {
+            print_name(c, list[i]);
+            out_str(c, "\n");
+        }
+        return;
+    }
+
+    size_t* lens = mem_alloc(MEM_EXECUTOR, count * sizeof(size_t));
+    size_t* widths = mem_alloc(MEM_EXECUTOR, count * sizeof(size_t));
+    if (!lens || !widths) {
+        mem_free(lens);
+        mem_free(widths);
+        c->o.one_per_line = 1;
+        print_columns(c, list, count);
+        c->o.one_per_line = 0;
+        return;
+    }
+
+    /* the narrowest possible layout needs at least this many rows */
+    size_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        lens[i] = display_len(&c->o, list[i]);
+        sum += lens[i] + 2;
+    }
+    size_t rows = sum / (size_t)c->width;
+    if (rows == 0) rows = 1;
+
+    size_t cols = 0;
+    for (; rows <= count; rows++) {
+        cols = (count + rows - 1) / rows;
+        size_t line = 0;
+        for (size_t col = 0; col < cols; col++) {
+            size_t w = 0;
+            for (size_t r = 0; r < rows && col * rows + r < count; r++) {
+                if (lens[col * rows + r] > w) w = lens[col * rows + r];
+            }
+            widths[col] = w;
+            line += w + (col + 1 < cols ? 2 : 0);
+        }
+        if (line <= (size_t)c->width || rows == count) break;
+    }
+
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t col = 0; col < cols; col++) {
+            size_t i = col * rows + r;
+            if (i >= count) break;
+            print_name(c, list[i]);
+            /* pad unless this is the last entry on the line */
+            if (col + 1 < cols && (col + 1) * rows + r < count) out_pad(c, widths[col] + 2 - lens[i]);
+        }
+        out_str(c, "\n");
+    }
+    mem_free(lens);
+    mem_free(widths);
+}
+
+static void print_entries(ls_ctx* c, int dirfd, ls_entry** list, size_t count, int show_total)
+{
+    if (c->o.long_format) print_long(c, dirfd, list, count, show_total);
+    else print_columns(c, list, count);
+    c->printed = 1;
+}
+
+/* ---- directories ---- */
+
+static int is_dot_or_dotdot(const char* name)
+{
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+static void list_dir(ls_ctx* c, const char* path, int header)
+{
+    /* ls -R can run long in the shell itself: stop on Ctrl-C */
+    if (c->interrupted || (c->interrupted = event_take_interrupt())) return;
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "ls: cannot open directory '%s': %s\n", path, strerror(errno));
+        c->status = c->status ? c->status : 1;
+        return;
+    }
+
+    /* names, each preceded by its d_type byte */
+    strbuf names = {0};
+    size_t count = 0;
+    char buf[32768];
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+        for (long off = 0; off < n; ) {
+            struct linux_dirent64* d = (struct linux_dirent64*)(buf + off);
+            off += d->d_reclen;
+            if (d->d_name[0] == '.') {
+                if (!c->o.all && !c->o.almost_all) continue;
+                if (!c->o.all && is_dot_or_dotdot(d->d_name)) continue;
+            }
+            sb_putc(&names, (char)d->d_type);
+            sb_append(&names, d->d_name, my_strlen(d->d_name) + 1);
+            count++;
+        }
+    }
+
+    ls_entry* entries = mem_alloc(MEM_EXECUTOR, (count ? count : 1) * sizeof(ls_entry));
+    ls_entry** list = mem_alloc(MEM_EXECUTOR, (count ? count : 1) * sizeof(ls_entry*));
+    if (!entries || !list) {
+        perror("ls");
+        mem_free(entries);
+        mem_free(list);
+        sb_free(&names);
+        close(fd);
+        c->status = 2;
+        return;
+    }
+    const char* p = names.data;
+    for (size_t i = 0; i < count; i++) {
+        memset(&entries[i], 0, sizeof(ls_entry));
+        entries[i].type = (unsigned char)*p++;
+        entries[i].name = p;
+        list[i] = &entries[i];
+        p += my_strlen(p) + 1;
+    }
+
+    /* one pass of statx calls for just the entries that need it */
+    for (size_t i = 0; i < count; i++) {
+        unsigned mask = stat_mask(&c->o, &entries[i]);
+        if (mask) stat_entry(fd, entries[i].name, &entries[i], mask, 0);
+    }
+    sort_entries(&c->o, list, count);
+
+    if (header) {
+        if (c->printed) out_str(c, "\n");
+        out_str(c, path);
+        out_str(c, ":\n");
+    }
+    print_entries(c, fd, list, count, 1);
+
+    if (c->o.recursive) {
+        for (size_t i = 0; i < count; i++) {
+            ls_entry* e = list[i];
+            if (e->type != DT_DIR || is_dot_or_dotdot(e->name)) continue;
+            size_t plen = my_strlen(path);
+            char sub[PATH_MAX];
+            int len = snprintf(sub, sizeof(sub), "%s%s%s", path,
+                               plen && path[plen - 1] == '/' ? "" : "/", e->name);
+            if (len < (int)sizeof(sub)) list_dir(c, sub, 1);
+        }
+    }
+
+    mem_free(entries);
+    mem_free(list);
+    sb_free(&names);
+    close(fd);
+}
+
+/* ---- options ---- */
+
+/* Parse options into o. Returns the index of the first operand, or -1 if
+   an option is not supported here. */
+static int parse_options(char** args, ls_opts* o)
+{
+    memset(o, 0, sizeof(*o));
+    o->classify = 1;
+    o->sort = 'n';
+
+    int i = 1;
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        const char* a = args[i];
+        if (my_strcmp(a, "--") == 0) return i + 1;
+        if (a[1] == '-') {
+            if (my_strcmp(a, "--all") == 0) o->all = 1;
+            else if (my_strcmp(a, "--almost-all") == 0) o->almost_all = 1;
+            else if (my_strcmp(a, "--classify") == 0) o->classify = 1;
+            else if (my_strcmp(a, "--human-readable") == 0) o->human = 1;
+            else if (my_strcmp(a, "--recursive") == 0) o->recursive = 1;
+            else if (my_strcmp(a, "--reverse") == 0) o->reverse = 1;
+            else if (my_strcmp(a, "--directory") == 0) o->directory = 1;
+            else return -1;
+            continue;
+        }
+        for (const char* f = a + 1; *f; f++) {
+            switch (*f) {
+            case 'a': o->all = 1; break;
+            case 'A': o->almost_all = 1; break;
+            case 'l': o->long_format = 1; break;
+            case 'h': o->human = 1; break;
+            case 'F': o->classify = 1; o->slash_dirs = 0; break;
+            case 'p': o->slash_dirs = 1; o->classify = 0; break;
+            case 'R': o->recursive = 1; break;
+            case 'd': o->directory = 1; break;
+            case '1': o->one_per_line = 1; break;
+            case 'r': o->reverse = 1; break;
+            case 't': o->sort = 't'; break;
+            case 'S': o->sort = 'S'; break;
+            case 'U': o->sort = 'U'; break;
+            default: return -1;
+            }
+        }
+    }
+    return i;
+}
+
+/* Unsupported options: run the real ls, adding -F as the shell always has. */
+static int external_ls(char** args, char** env)
+{
+    for (size_t i = 1; args[i]; i++) {
+        if (my_strcmp(args[i], "-F") == 0 || my_strcmp(args[i], "-p") == 0 ||
+            my_strcmp(args[i], "--classify") == 0) {
+            return executor(args, env);
+        }
+    }
+    size_t count = 0;
+    while (args[count]) count++;
+    char** new_args = mem_alloc(MEM_EXECUTOR, (count + 2) * sizeof(char*));
+    if (!new_args) {
+        perror("malloc");
+        return executor(args, env);
+    }
+    new_args[0] = args[0];
+    new_args[1] = "-F";
+    for (size_t i = 1; i <= count; i++) new_args[i + 1] = args[i];
+    int ret = executor(new_args, env);
+    mem_free(new_args);
+    return ret;
+}
+
+// ls [-aAlhFpRd1rtSU] [file...]
+int command_ls(char** args, char** env)
+{
+    ls_ctx c;
+    memset(&c, 0, sizeof(c));
+    int first = parse_options(args, &c.o);
+    if (first == -1 || !native_files_enabled(env)) return external_ls(args, env);
+
+    struct winsize ws;
+    if (!isatty(STDOUT_FILENO)) c.o.one_per_line = 1;
+    c.width = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col ? ws.ws_col : 80;
+    c.now = time(NULL);
+    fflush(stdout);
+
+    char* dot[] = { ".", NULL };
+    char** operands = args[first] ? &args[first] : dot;
+    size_t n_ops = 0;
+    while (operands[n_ops]) n_ops++;
+
+    /* operands that are files (or any operand with -d) are listed together
+       first, then each directory; symlinks are followed except with -l, -F
+       and -d, which describe the link itself */
+    int follow = !(c.o.long_format || c.o.classify || c.o.directory);
+    ls_entry* ops = mem_alloc(MEM_EXECUTOR, n_ops * sizeof(ls_entry));
+    ls_entry** files = mem_alloc(MEM_EXECUTOR, n_ops * sizeof(ls_entry*));
+    ls_entry** dirs = mem_alloc(MEM_EXECUTOR, n_ops * sizeof(ls_entry*));
+    if (!ops || !files || !dirs) {
+        perror("ls");
+        mem_free(ops);
+        mem_free(files);
+        mem_free(dirs);
+        return 2;
+    }
+    size_t n_files = 0, n_dirs = 0;
+    for (size_t i = 0; i < n_ops; i++) {
+        ls_entry* e = &ops[i];
+        memset(e, 0, sizeof(*e));
+        e->name = operands[i];
+        stat_entry(AT_FDCWD, e->name, e, STATX_BASIC_STATS, follow);
+        if (!e->have_stat) {
+            fprintf(stderr, "ls: cannot access '%s': %s\n", e->name, strerror(errno));
+            c.status = 2;
+            continue;
+        }
+        if (e->type == DT_DIR && !c.o.directory) dirs[n_dirs++] = e;
+        else files[n_files++] = e;
+    }
+
+    sort_entries(&c.o, files, n_files);
+    sort_entries(&c.o, dirs, n_dirs);
+    if (n_files) print_entries(&c, AT_FDCWD, files, n_files, 0);
+    for (size_t i = 0; i < n_dirs; i++) {
+        list_dir(&c, dirs[i]->name, n_ops > 1 || c.o.recursive);
+    }
+
+    out_flush(&c);
+    sb_free(&c.out);
+    mem_free(ops);
+    mem_free(files);
+    mem_free(dirs);
+    return c.interrupted ? 130 : c.status;
+}
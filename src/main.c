@@ -17,102 +17,18 @@
 // Manage Path
 // Error Handling
 
-void display_help() {
-    printf("Available commands:\n");
-    printf("\tcd <directory>      - Change the current directory.\n");
-    printf("\tpwd                 - Print the current working directory.\n");
-    printf("\trun <file>          - Compile and run the given file.\n");
-    printf("\techo <text>         - Print the given text.\n");
-    printf("\tenv                 - Display all environment variables.\n");
-    printf("\tsetenv VAR=value    - Set an environment variable.\n");
-    printf("\tunsetenv <variable> - Remove an environment variable.\n");
-    printf("\twhich <command>     - Locate an executable in the system's PATH.\n");
-    printf("\t.help               - Display this help message.\n");
-    printf("\thelp <command>      - Display help messages with examples for certain commands.\n");
-    printf("\texit or quit        - Exit the shell.\n");
-}
-
-// Built-ins: cd, pwd, echo, env, setenv, unsetenv, which, exit
-// Binary: ls, cat.. we'll use executor
-int shell_builts(char** args, char** env, char* initial_directory)
+// Built-ins are looked up in the registry (builtins.def); anything else
+// is an external command run by the executor.
+// Returns the command's exit status, or -1 if the shell should exit.
+int shell_builts(char** args, char*** env)
 {
     if (!args || !args[0]) return 0;
 
-    if (my_strcmp(args[0], "cd") == 0) {
-        return command_cd(args, initial_directory);
-    } else if (my_strcmp(args[0], "pwd") == 0) {
-        return command_pwd();
-    } else if (my_strcmp(args[0], "echo") == 0) {
-        return command_echo(args, env);
-    } else if (my_strcmp(args[0], "env") == 0) {
-        return command_env(env);
-    } else if (my_strcmp(args[0], "which") == 0) {
-        return command_which(args, env);
-    } else if (my_strcmp(args[0], ".help") == 0) {
-        display_help();
-        return 0;
-    } else if (my_strcmp(args[0], "help") == 0) {
-        return command_help(args, env);
-    } else if (my_strcmp(args[0], "run") == 0) {
-        return command_run(args, env);
-    } else if (my_strcmp(args[0], "exit") == 0 || my_strcmp(args[0], "quit") == 0) {
-        /* signal caller to exit cleanly */
-        return -1;
-    } else {
-        /* Intercept ls and add -F if user didn't provide it so directories are suffixed with '/' */
-        if (my_strcmp(args[0], "ls") == 0) {
-            int has_flag = 0;
-            for (size_t i = 1; args[i]; i++) {
-                if (my_strcmp(args[i], "-F") == 0 ||
-                    my_strcmp(args[i], "-p") == 0 ||
-                    my_strcmp(args[i], "--classify") == 0) {
-                    has_flag = 1;
-                    break;
-                }
-            }
-            if (!has_flag) {
-                /* count existing args (including final NULL) */
-                size_t count = 0;
-                while (args[count]) count++;
-
-                /* new_args: original args plus one flag and the NULL terminator */
-                char** new_args = malloc((count + 1 + 1) * sizeof(char*));
-                if (!new_args) {
-                    perror("malloc");
-                    return executor(args, env);
-                }
-
-                new_args[0] = args[0];
-                new_args[1] = my_strdup("-F");
-                for (size_t i = 1; i <= count; i++) { /* copy args[1..count] where args[count] == NULL */
-                    new_args[i + 1] = args[i];
-                }
-
-                int ret = executor(new_args, env);
-
-                /* free only the array and the added flag string; original token strings remain owned by parse_input/free_tokens */
-                free(new_args[1]);
-                free(new_args);
-                return ret;
-            }
-        }
-
-        /* default: execute external command */
-        return executor(args, env);
+    const builtin* b = builtin_lookup(args[0]);
+    if (b) {
+        return b->handler(args, env);
     }
-    return 0;
-}
-
-/* flag set by handler to indicate an interrupt occurred */
-static volatile sig_atomic_t sigint_received = 0;
-
-/* async-signal-safe handler: set flag and write a newline */
-void sigint_handler(int signo)
-{
-    (void)signo;
-    sigint_received = 1;
-    /* write is async-signal-safe */
-    write(STDOUT_FILENO, "\n", 1);
+    return executor(args, *env);
 }
 
 /* raw mode helpers for single-char input */
@@ -139,44 +55,67 @@ static int enable_raw_mode(void) {
     return 0;
 }
 
-/* print prompt (cwd) */
-static void print_prompt(void) {
-    char* cwd = getcwd(NULL, 0);
-    if (cwd) {
-        printf("%s > ", cwd);
-        free(cwd);
-    } else {
-        printf("[unknown]> ");
+#define KEY_MAX 16
+
+/* Read one key: a byte, a whole UTF-8 character or a whole escape
+   sequence into key[0..*n).
+   Prompt updates and terminal resizes redraw the line in place; returns
+   EVENT_KEY, EVENT_INTERRUPT or EVENT_EOF. */
+static int read_key(editor* ed, char* key, size_t* n)
+{
+    *n = 0;
+    while (1) {
+        session_mark_ready();
+        char c;
+        int ev = event_next(&c);
+        if (ev == EVENT_EOF) return ev;
+        if (ev & EVENT_INTERRUPT) return EVENT_INTERRUPT;
+        if (ev != EVENT_KEY) {
+            editor_redraw(ed);
+            continue;
+        }
+        session_record_key(c);
+        key[(*n)++] = c;
+        if ((unsigned char)key[0] >= 0x80) {
+            /* the lead byte gives the length; a stray byte is a key of its own */
+            int len = utf8_seq_len(key[0]);
+            if (*n >= (size_t)len || (*n > 1 && ((unsigned char)c & 0xc0) != 0x80)) return EVENT_KEY;
+            continue;
+        }
+        /* ESC x is Alt-x; ESC [ and ESC O run up to a final byte @..~ */
+        if (key[0] != '\x1b' || *n == KEY_MAX) return EVENT_KEY;
+        if (*n == 2 && c != '[' && c != 'O') return EVENT_KEY;
+        if (*n > 2 && c >= '@' && c <= '~') return EVENT_KEY;
     }
-    fflush(stdout);
 }
 
-static void refresh_display(const char* input_buf, size_t input_len, size_t cursor)
+/* Length of s[0..len) without leading and trailing blanks and newlines;
+   *start gets the offset of the first byte kept. */
+static size_t trim(const char* s, size_t len, size_t* start)
 {
-    printf("\r");
-    print_prompt();
-    printf("\x1b[K"); /* clear to end of line */
-    if (input_len > 0) {
-        /* print the whole buffer */
-        fwrite(input_buf, 1, input_len, stdout);
-    }
-    /* move cursor back to correct position */
-    size_t to_move = input_len > cursor ? input_len - cursor : 0;
-    for (size_t m = 0; m < to_move; ++m) printf("\x1b[D");
-    fflush(stdout);
+    size_t i = 0;
+    while (i < len && (s[i] == ' ' || s[i] == '\t' || s[i] == '\n')) i++;
+    while (len > i && (s[len-1] == ' ' || s[len-1] == '\t' || s[len-1] == '\n')) len--;
+    *start = i;
+    return len - i;
 }
 
-void shell_loop(char** env)
+static long long elapsed_ns(const struct timespec* start)
 {
-    char input_buf[MAX_INPUT];
-    size_t input_len = 0;
-    size_t cursor = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000000LL + (now.tv_nsec - start->tv_nsec);
+}
 
-    char** args;
-    char* initial_directory = getcwd(NULL, 0);
+void shell_loop(char** env)
+{
+    editor ed;
+    memset(&ed, 0, sizeof(ed));
 
     /* print a blank line before the next prompt when the previous input executed */
     bool need_leading_newline = false;
+    /* a command ran since the last prompt, so the git dirty flag may be stale */
+    bool command_ran = false;
 
     /* Clear the terminal and show a big "edoX" banner on startup */
     system("clear");
@@ -190,12 +129,11 @@ void shell_loop(char** env)
 
     printf("\nEnter .help for help.\n\n");
 
-    /* install our SIGINT handler for the interactive prompt */
-    struct sigaction sa;
-    sa.sa_handler = sigint_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    sigaction(SIGINT, &sa, NULL);
+    /* signals arrive through the event loop from here on (event.c) */
+    if (event_init() == -1) return;
+    dirs_load(env);
+    state_load(env);
+    bool at_eof = false;
 
     /* simple history */
     #define HISTORY_SIZE 100
@@ -203,13 +141,11 @@ void shell_loop(char** env)
     int history_count = 0;
     int history_index = 0; /* navigation index */
     for (int i = 0; i < HISTORY_SIZE; ++i) history[i] = NULL;
+    /* the last session's history, read in place from the state image */
+    history_count = state_history(history, HISTORY_SIZE);
 
     while (1)
     {
-        /* reset input buffer and navigation index */
-        memset(input_buf, 0, sizeof(input_buf));
-        input_len = 0;
-        cursor = 0;
         history_index = history_count; /* start at "current" (no selection) */
 
         /* if the previous command ran, print an extra newline before showing the prompt */
@@ -217,107 +153,75 @@ void shell_loop(char** env)
             putchar('\n');
             need_leading_newline = false;
         }
-        print_prompt();
+        prompt_request(command_ran);
+        command_ran = false;
+        editor_begin(&ed);
 
         if (enable_raw_mode() == -1) {
             perror("tcgetattr");
             break;
         }
 
+        bool discard = false;
         while (1) {
-            char c;
-            ssize_t r = read(STDIN_FILENO, &c, 1);
-            if (r <= 0) {
+            char key[KEY_MAX];
+            size_t n;
+            int ev = read_key(&ed, key, &n);
+            if (ev == EVENT_EOF) {
+                disable_raw_mode();
+                at_eof = true;
+                break;
+            }
+            if (ev == EVENT_INTERRUPT) { /* Ctrl-C discards the line */
+                editor_finish(&ed, "^C");
+                discard = true;
                 disable_raw_mode();
                 break;
             }
 
-            if (c == '\r' || c == '\n') { /* Enter */
-                putchar('\n');
+            if (n == 1 && (key[0] == '\r' || key[0] == '\n')) { /* Enter */
+                /* an open quote, $( or a trailing backslash continues on the next line */
+                if (!editor_complete(editor_text(&ed))) {
+                    editor_insert(&ed, "\n", 1);
+                    continue;
+                }
+                editor_finish(&ed, "");
                 disable_raw_mode();
                 break;
-            } else if (c == 127 || c == 8) { /* Backspace */
-                 if (cursor > 0) {
-                     /* remove char before cursor */
-                     memmove(&input_buf[cursor - 1], &input_buf[cursor], input_len - cursor + 1); /* include null */
-                     input_len--;
-                     cursor--;
-                    refresh_display(input_buf, input_len, cursor);
-                 }
-             } else if (c == '\x1b') { /* Escape sequence: arrows */
-                char seq[2] = {0,0};
-                if (read(STDIN_FILENO, &seq[0], 1) <= 0) continue;
-                if (read(STDIN_FILENO, &seq[1], 1) <= 0) continue;
-                if (seq[0] == '[') {
-                    if (seq[1] == 'A') { /* Up */
-                        if (history_count == 0) continue;
-                        if (history_index > 0) history_index--;
-                        const char* h = history[history_index];
-                        if (h) {
-                            strncpy(input_buf, h, sizeof(input_buf)-1);
-                            input_len = strlen(input_buf);
-                            cursor = input_len;
-                        } else {
-                            input_buf[0] = '\0';
-                            input_len = cursor = 0;
-                        }
-                        refresh_display(input_buf, input_len, cursor);
-                    } else if (seq[1] == 'B') { /* Down */
-                        if (history_count == 0) continue;
-                        if (history_index < history_count - 1) {
-                            history_index++;
-                            const char* h = history[history_index];
-                            if (h) {
-                                strncpy(input_buf, h, sizeof(input_buf)-1);
-                                input_len = strlen(input_buf);
-                                cursor = input_len;
-                            }
-                        } else {
-                            history_index = history_count;
-                            input_buf[0] = '\0';
-                            input_len = cursor = 0;
-                        }
-                        refresh_display(input_buf, input_len, cursor);
-                    } else if (seq[1] == 'C') { /* Right */
-                         if (cursor < input_len) {
-                             printf("\x1b[C");
-                             cursor++;
-                             fflush(stdout);
-                         }
-                     } else if (seq[1] == 'D') { /* Left */
-                         if (cursor > 0) {
-                             printf("\x1b[D");
-                             cursor--;
-                             fflush(stdout);
-                         }
-                     }
-                 }
-             } else if ((unsigned char)c >= 32 && (unsigned char)c <= 126) { /* printable */
-                 if (input_len + 1 < sizeof(input_buf)) {
-                     /* insert at cursor */
-                     memmove(&input_buf[cursor + 1], &input_buf[cursor], input_len - cursor + 1);
-                     input_buf[cursor] = c;
-                     input_len++;
-                     cursor++;
-                    refresh_display(input_buf, input_len, cursor);
-                     /* if user was navigating history and types, move to editing (empties selection) */
-                     history_index = history_count;
-                 }
-             } else {
-                 /* ignore other control characters */
-                 continue;
-             }
+            }
+            if (n == 3 && key[0] == '\x1b' && key[1] == '[' && (key[2] == 'A' || key[2] == 'B')) {
+                /* Up/Down move between the lines of a multi-line input,
+                   then through history */
+                int up = key[2] == 'A';
+                if (editor_line_move(&ed, up ? -1 : 1) == 0 || history_count == 0) continue;
+                if (up) {
+                    if (history_index > 0) history_index--;
+                    editor_set(&ed, history[history_index]);
+                } else if (history_index < history_count - 1) {
+                    history_index++;
+                    editor_set(&ed, history[history_index]);
+                } else {
+                    history_index = history_count;
+                    editor_set(&ed, "");
+                }
+                continue;
+            }
+            if (editor_key(&ed, key, n) == 0 && n == 1 && (unsigned char)key[0] >= 32) {
+                /* if user was navigating history and types, move to editing (empties selection) */
+                history_index = history_count;
+            }
+            /* anything else is ignored */
         } /* end char read loop */
 
-        /* if raw mode was left due to EOF */
-        if (!raw_enabled && feof(stdin)) break;
+        /* the terminal went away */
+        if (at_eof) break;
+        if (discard) continue;
 
         /* trim leading/trailing whitespace */
-        size_t start = 0;
-        while (start < input_len && (input_buf[start] == ' ' || input_buf[start] == '\t' || input_buf[start] == '\n')) start++;
-        size_t end = input_len;
-        while (end > start && (input_buf[end-1] == ' ' || input_buf[end-1] == '\t' || input_buf[end-1] == '\n')) end--;
-        size_t linelen = (end > start) ? (end - start) : 0;
+        char* input_buf = editor_text(&ed);
+        if (!input_buf) continue;
+        size_t start;
+        size_t linelen = trim(input_buf, editor_len(&ed), &start);
 
         if (linelen == 0) {
             continue;
@@ -325,63 +229,91 @@ void shell_loop(char** env)
 
         /* add to history (keep newest at end) */
         if (linelen > 0) {
-            char* entry = malloc(linelen + 1);
+            char* entry = mem_alloc(MEM_HISTORY, linelen + 1);
             if (entry) {
                 memcpy(entry, &input_buf[start], linelen);
                 entry[linelen] = '\0';
                 if (history_count == HISTORY_SIZE) {
                     /* drop oldest */
-                    free(history[0]);
+                    if (!state_contains(history[0])) mem_free(history[0]);
                     memmove(&history[0], &history[1], (HISTORY_SIZE - 1) * sizeof(char*));
                     history[HISTORY_SIZE - 1] = entry;
                 } else {
                     history[history_count++] = entry;
                 }
+                state_history_added();
             }
         }
 
-        /* parse & execute */
-        args = parse_input(&input_buf[start]);
-        if (!args || !args[0]) {
-            free_tokens(args);
+        /* parse & execute, with continuation lines joined back up */
+        linelen = trim(input_buf, editor_join_lines(input_buf, editor_len(&ed)), &start);
+        input_buf[start + linelen] = '\0';
+        command_node* list = parse_command_list(&input_buf[start]);
+        if (!list) {
             continue;
-        } else if (my_strcmp(args[0], "setenv") == 0) {
-            env = command_setenv(args, env);
-        } else if (my_strcmp(args[0], "unsetenv") == 0) {
-            env = command_unsetenv(args, env);
-        } else {
-            int sb = shell_builts(args, env, initial_directory);
-            /* if shell_builts signalled exit (-1), clean up and break */
-            if (sb == -1) {
-                free_tokens(args);
-                /* ensure terminal state restored before exiting */
-                disable_raw_mode();
-                /* free history and other resources will be done after loop */
-                need_leading_newline = false;
-                break;
-            }
         }
-        free_tokens(args);
+        struct timespec started;
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        int status = run_command_list(list, &env);
+        free_command_list(list);
+        prompt_set_duration(elapsed_ns(&started));
+        command_ran = true;
+        /* if a command signalled exit (-1), clean up and break */
+        if (status == -1) {
+            /* ensure terminal state restored before exiting */
+            disable_raw_mode();
+            /* free history and other resources will be done after loop */
+            need_leading_newline = false;
+            break;
+        }
         /* mark that a command executed so next prompt is preceded by a newline */
         need_leading_newline = true;
+        state_save_periodic(history, history_count);
 
     } /* main while */
 
+    state_save(history, history_count);
     /* cleanup history */
-    for (int i = 0; i < history_count; ++i) free(history[i]);
+    for (int i = 0; i < history_count; ++i) {
+        if (!state_contains(history[i])) mem_free(history[i]);
+    }
+    editor_free(&ed);
     disable_raw_mode();
-    free(initial_directory);
-    /* Do NOT free 'env' here — it may point to the process environment or memory
-       not allocated by this code. Freeing it causes crashes. If you want to
-       manage env ownership, track allocations returned by setenv/unsetenv and
-       free only those specific buffers. */
+    /* releases env only if setenv/unsetenv made it; the process
+       environment is left alone */
+    env_release(env);
 }  /* end shell_loop */
 
 /* Program entry point */
 int main(int argc, char** argv, char** env)
 {
-    (void)argc;
-    (void)argv;
+    /* edosh --record FILE | edosh --replay FILE [--realtime] (session.c) */
+    if (argc >= 3 && my_strcmp(argv[1], "--replay") == 0) {
+        int realtime = argc >= 4 && my_strcmp(argv[3], "--realtime") == 0;
+        return session_replay(argv[2], realtime);
+    }
+    if (argc >= 3 && my_strcmp(argv[1], "--record") == 0) {
+        if (session_record_open(argv[2]) == -1) return 1;
+    } else if (argc == 2 && argv[1][0] != '-') {
+        /* edosh FILE runs a script without the terminal or event loop;
+           children are waited for with plain waitpid */
+        int status = script_run(argv[1], &env);
+        if (status == -1) status = last_exit_status();
+        env_release(env);
+        runner_release();
+        pyserver_release();
+        dirs_release();
+        mem_check_leaks();
+        return status;
+    } else if (argc >= 2) {
+        fprintf(stderr, "usage: %s [FILE | --record FILE | --replay FILE [--realtime]]\n", argv[0]);
+        return 2;
+    }
     shell_loop(env);
+    runner_release();
+    pyserver_release();
+    dirs_release();
+    state_release();
+    mem_check_leaks();
     return 0;
 }
\ No newline at end of file
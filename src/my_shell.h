@@ -6,30 +6,250 @@
 #include <signal.h>
 #include <errno.h>
 
-#define MAX_INPUT 1024
+// Growable byte buffer
+typedef struct strbuf {
+    char* data;
+    size_t len;
+    size_t cap;
+} strbuf;
+
+int sb_reserve          (strbuf* sb, size_t extra);
+int sb_append           (strbuf* sb, const char* str, size_t n);
+int sb_putc             (strbuf* sb, char c);
+void sb_free            (strbuf* sb);
+
+// Tagged allocation with per-subsystem accounting (mem.c)
+typedef enum mem_tag {
+    MEM_PARSER,
+    MEM_ENV,
+    MEM_HISTORY,
+    MEM_RUN,
+    MEM_EXECUTOR,
+    MEM_EDITOR,
+    MEM_DIRS,
+    MEM_TAG_COUNT
+} mem_tag;
+
+void* mem_alloc         (mem_tag tag, size_t size);
+void* mem_realloc       (mem_tag tag, void* p, size_t size);
+char* mem_strdup        (mem_tag tag, const char* s);
+void mem_free           (void* p);
+int capture_mem         (char** args, strbuf* out);
+int command_mem         (char** args);
+void mem_check_leaks    (void);
 
 // Input Parser
 char** parse_input      (char* input);
 void free_tokens        (char** tokens);
+const char* skip_substitution (const char* p);
+
+// Command lists: commands joined by ';', '&&' and '||'
+typedef enum { LIST_SEQ, LIST_AND, LIST_OR } list_op;
+
+typedef struct command_node {
+    char** args;                /* words of this command, before expansion */
+    list_op op;                 /* how this command joins the previous one */
+    struct command_node* next;
+} command_node;
+
+command_node* parse_command_list (const char* input);
+void free_command_list           (command_node* list);
+int run_command_list             (command_node* list, char*** env);
+int run_command                  (char** words, list_op op, int literal, char*** env);
+int last_exit_status             (void);
+
+// Builtin registry (builtins.def, builtin_table.c)
+#define BUILTIN_CAPTURABLE   0x1    /* capture() can produce its output in-process */
+#define BUILTIN_UNLISTED     0x2    /* left out of .help */
+#define BUILTIN_SPAWNS       0x4    /* does its work in processes it starts, so limit holds it */
+
+typedef struct builtin {
+    const char* name;
+    int (*handler)(char** args, char*** env);
+    int (*capture)(char** args, strbuf* out);
+    unsigned flags;
+    const char* usage;
+    const char* summary;
+    const char* help;
+} builtin;
+
+extern const builtin builtin_table[];
+extern const size_t builtin_count;
+
+const builtin* builtin_lookup (const char* name);
+int shell_builts        (char** args, char*** env);
+void display_help       (void);
 
 // Built-in function implementations
-int command_cd          (char** args, char* initial_directory);
 int command_pwd         ();
 int command_echo        (char** args, char** env);
+int command_ls          (char** args, char** env);
+int command_cat         (char** args, char** env);
+int command_cp          (char** args, char** env);
+int command_mv          (char** args, char** env);
+int command_rm          (char** args, char** env);
+int native_files_enabled (char** env);
+void format_size_human  (char* buf, size_t size, unsigned long long bytes);
+int command_du          (char** args, char** env);
+int command_procs       (char** args);
+int capture_pwd         (char** args, strbuf* out);
+int capture_echo        (char** args, strbuf* out);
 int command_env         (char** env);
 int command_which       (char** args, char** env);
 int command_help        (char** args, char** env);
 int command_run         (char** args, char** env);
+void runner_release     (void);
+int pyserver_enabled    (char** env);
+int pyserver_run        (const char* file, char** args, char** env, int* status);
+void pyserver_release   (void);
 char** command_setenv   (char** args, char** env);
 char** command_unsetenv (char** args, char** env);
+void env_release        (char** env);
+
+// cd, pushd, popd, z and the logical working directory (dirs.c)
+int command_cd          (char** args, char*** env);
+int command_pushd       (char** args, char*** env);
+int command_popd        (char** args, char*** env);
+int command_z           (char** args, char*** env);
+const char* dirs_pwd    (void);
+void dirs_load          (char** env);
+void dirs_release       (void);
+
+// Script files and their compiled cache (script.c)
+int script_run          (const char* path, char*** env);
+int command_source      (char** args, char*** env);
 
 // Executor
 int executor            (char** args, char** env);
-int child_process       (char** args, char** env);
+int child_process       (char** args, char** env, const char* path);
+
+// Resource limits and accounting for one command (limit.c)
+int command_limit       (char** args, char*** env);
+int limit_active        (void);
+pid_t limit_fork        (void);
+
+// Directory change notification (watch.c)
+typedef void (*watch_fn)(void* data, const char* name, unsigned mask);
+
+int watch_fd            (void);
+int watch_add           (const char* path, watch_fn fn, void* data);
+void watch_remove       (int id);
+void watch_dispatch     (void);
+int watch_cwd_listen    (watch_fn fn, void* data);
+void watch_chdir        (void);
+
+// PATH cache (path_cache.c)
+int path_cache_update   (char** env);
+int path_cache_resolve  (const char* command, char** env, char* out, size_t out_size);
+int path_cache_snapshot (strbuf* out);
+
+// State image carried from one session to the next (state.c)
+enum { STATE_HISTORY, STATE_COMMANDS, STATE_SECTION_COUNT };
+
+void state_load         (char** env);
+const void* state_section (int id, size_t* size);
+int state_contains      (const void* p);
+int state_history       (char** history, int max);
+void state_history_added (void);
+int state_save          (char** history, int count);
+void state_save_periodic (char** history, int count);
+void state_release      (void);
+
+// Event loop: terminal, signals, child exits and background wakeups (event.c)
+#define EVENT_KEY       0x1
+#define EVENT_INTERRUPT 0x2
+#define EVENT_RESIZE    0x4
+#define EVENT_PROMPT    0x8
+#define EVENT_EOF       0x10
+
+int event_init          (void);
+int event_next          (char* c);
+int event_pending       (void);
+typedef void (*event_io_fn)(int fd, void* data);
+
+int event_wait_child    (pid_t pid, int* status);
+int event_wait_child_io (pid_t pid, int* status, int fd, event_io_fn fn, void* data);
+int event_wait_readable (int fd);
+int event_take_interrupt (void);
+void event_child_setup  (void);
+const sigset_t* event_child_mask (void);
+
+// Output capture and the `last` builtin (capture.c)
+int capture_enabled     (char** env);
+int capture_open_pty    (int* master, int* slave);
+void capture_begin      (char** args);
+void capture_output     (int fd, void* data);
+void capture_end        (void);
+int capture_last        (char** args, strbuf* out);
+int command_last        (char** args);
+
+// Line editor: gap buffer, continuation lines and redraw (editor.c)
+typedef struct editor {
+    char* buf;
+    size_t cap;
+    size_t gap, gap_end;        /* text is buf[0, gap) then buf[gap_end, cap) */
+    size_t dirty;               /* text from here on is not on screen yet */
+    size_t shown;               /* length of the text on screen */
+    size_t* rows;               /* text offset each screen row of text starts at */
+    size_t nrows, rows_cap;
+    int cols;                   /* terminal width */
+    int prompt_cols;            /* width of the prompt */
+    long row, col;              /* terminal cursor, from the prompt's first row */
+} editor;
+
+void editor_begin       (editor* ed);
+void editor_free        (editor* ed);
+void editor_redraw      (editor* ed);
+void editor_set         (editor* ed, const char* s);
+void editor_finish      (editor* ed, const char* mark);
+char* editor_text       (editor* ed);
+size_t editor_len       (const editor* ed);
+void editor_insert      (editor* ed, const char* s, size_t n);
+void editor_end         (editor* ed);
+int editor_line_move    (editor* ed, int dir);
+int editor_key          (editor* ed, const char* key, size_t n);
+int editor_complete     (const char* s);
+size_t editor_join_lines (char* s, size_t len);
+
+// UTF-8 decoding and display widths (utf8.c)
+int utf8_seq_len        (unsigned char lead);
+unsigned utf8_decode    (const char* s, size_t n, size_t* len);
+int utf8_width          (unsigned cp);
+int utf8_extends        (unsigned cp);
+int utf8_is_regional    (unsigned cp);
+size_t utf8_string_width (const char* s, size_t n);
+
+// Keystroke recording and replay (session.c)
+int session_record_open (const char* path);
+void session_record_key (char c);
+void session_mark_ready (void);
+int session_replay      (const char* path, int realtime);
+
+// Prompt segments, git status computed off the input thread (prompt.c)
+void prompt_request     (int after_command);
+int prompt_render       (void);
+void prompt_set_duration (long long ns);
+int prompt_fd           (void);
+void prompt_ack         (void);
+
+// Environment index: O(1) lookups into the env array
+char* env_lookup        (const char* name, size_t len, char** env);
+void env_index_invalidate (void);
+
+// Expansion of $VAR, ${VAR}, $?, $(...), ~, patterns and quote removal
+char** expand_args      (char** words, char** env);
+
+// Command substitution $(...) (subst.c)
+int command_substitute  (const char* text, size_t len, char** env, strbuf* result);
+void subst_status_reset (void);
+int subst_last_status   (void);
+int builtin_capture     (char** args, strbuf* out, int* status);
 
-// Path functions
-char* get_path          (char** env);
-char** split_paths      (char* paths, int* count);
+// Pathname expansion (glob.c)
+int glob_expand         (const char* pattern, strbuf* out);
+int glob_match          (const char* pat, size_t len, const char* name);
+int glob_has_magic      (const char* pat, size_t len);
+void glob_cache_clear   (void);
 
 // Helpers
 int my_strcmp           (const char* str1, const char* str2);
@@ -42,6 +262,3 @@ char* my_strchr         (const char* str, char c);
 char* my_strtok         (char* input_string, const char* delimiter);
 char* my_strncpy        (char* dest, const char* src, size_t n);
 
-/* SIGINT handler used by the shell to avoid exiting on Ctrl+C.
-   Declared here so executor.c can restore the handler. */
-void sigint_handler(int signo);
\ No newline at end of file
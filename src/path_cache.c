@@ -0,0 +1,462 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* Parsed PATH, built once per PATH value. All directory names live in one
+   buffer (a copy of PATH with ':' turned into '\0') and are addressed by
+   offset. Each absolute directory is opened once as an O_PATH dirfd, so a
+   lookup is a faccessat() relative to that fd with no string building;
+   the full path is formatted only for the directory that matches.
+   Nothing here uses my_strtok.
+
+   Results are remembered per command name, including "not found", and
+   every directory is watched with inotify (watch.c): a change in a
+   directory forgets only the names it mentions, and a directory that
+   disappears forces a rebuild. Between events a lookup makes no system
+   calls besides the empty inotify read. A PATH directory that does not
+   exist is covered by a watch on its parent. Results that depend on an
+   unwatched directory (relative, or with no watchable parent) are not
+   remembered.
+
+   What one session learned is kept in the state image (state.c): the
+   next session uses that section in place, as a second table behind the
+   one above, for as long as PATH is the same string and no directory on
+   it has a different mtime. Any inotify event on a PATH directory drops
+   it. */
+
+typedef struct path_dir {
+    size_t offset;              /* start of the name in path_buf */
+    size_t len;
+    int fd;                     /* O_PATH dirfd, or -1 (missing or relative) */
+    int watch;                  /* watch id, or -1 if not watched */
+} path_dir;
+
+typedef struct command_entry {
+    char* name;
+    int dir;                    /* index into path_dirs, -1 if not on PATH */
+    struct command_entry* next;
+} command_entry;
+
+#define COMMAND_BUCKETS 256
+static command_entry* commands[COMMAND_BUCKETS];
+
+/* The STATE_COMMANDS section: this header, a snap_dir per PATH entry,
+   an open-addressing table of snap_slots and the names they point to
+   (offsets from the start of the names). */
+typedef struct snap_header {
+    uint64_t path_hash;         /* of the PATH string */
+    uint32_t dirs;
+    uint32_t slots;             /* a power of two */
+    uint32_t names;             /* bytes of names */
+    uint32_t unused;
+} snap_header;
+
+typedef struct snap_dir {
+    uint64_t dev, ino;          /* all zero for a missing or relative entry */
+    int64_t sec, nsec;          /* mtime */
+} snap_dir;
+
+#define SNAP_EMPTY UINT32_MAX
+
+typedef struct snap_slot {
+    uint32_t name;              /* offset of the name, or SNAP_EMPTY */
+    int32_t dir;                /* as in command_entry */
+} snap_slot;
+
+static const snap_slot* snap_slots = NULL;      /* NULL when not in use */
+static uint32_t snap_mask = 0;
+static const char* snap_names = NULL;
+static uint32_t snap_names_size = 0;
+
+static char* path_buf = NULL;   /* PATH with ':' replaced by '\0' */
+static size_t path_len = 0;
+static path_dir* path_dirs = NULL;
+static size_t path_count = 0;
+static int path_built = 0;
+
+static unsigned name_hash(const char* name)
+{
+    unsigned h = 5381;
+    while (*name) h = h * 33 + (unsigned char)*name++;
+    return h;
+}
+
+static unsigned command_hash(const char* name)
+{
+    return name_hash(name) & (COMMAND_BUCKETS - 1);
+}
+
+static command_entry* find_command(const char* name)
+{
+    for (command_entry* e = commands[command_hash(name)]; e; e = e->next) {
+        if (my_strcmp(e->name, name) == 0) return e;
+    }
+    return NULL;
+}
+
+static void remember_command(const char* name, int dir)
+{
+    command_entry* e = malloc(sizeof(command_entry));
+    if (!e) return;
+    e->name = my_strdup(name);
+    if (!e->name) {
+        free(e);
+        return;
+    }
+    unsigned h = command_hash(name);
+    e->dir = dir;
+    e->next = commands[h];
+    commands[h] = e;
+}
+
+static void forget_command(const char* name)
+{
+    command_entry** link = &commands[command_hash(name)];
+    while (*link) {
+        command_entry* e = *link;
+        if (my_strcmp(e->name, name) == 0) {
+            *link = e->next;
+            free(e->name);
+            free(e);
+            return;
+        }
+        link = &e->next;
+    }
+}
+
+static void forget_all_commands(void)
+{
+    for (int i = 0; i < COMMAND_BUCKETS; i++) {
+        while (commands[i]) {
+            command_entry* e = commands[i];
+            commands[i] = e->next;
+            free(e->name);
+            free(e);
+        }
+    }
+}
+
+/* inotify callback for a PATH directory */
+static void path_dir_changed(void* data, const char* name, unsigned mask)
+{
+    (void)data;
+    (void)mask;
+    snap_slots = NULL;
+    if (name) {
+        forget_command(name);
+    } else {
+        /* the directory was removed or replaced: start over on next lookup */
+        forget_all_commands();
+        path_built = 0;
+    }
+}
+
+/* Name of the last component of directory d, or NULL if it ends in '/'. */
+static const char* dir_basename(const path_dir* d)
+{
+    const char* dir = &path_buf[d->offset];
+    const char* base = dir;
+    for (size_t i = 0; i < d->len; i++) {
+        if (dir[i] == '/') base = &dir[i + 1];
+    }
+    return *base ? base : NULL;
+}
+
+/* inotify callback on the parent of a PATH directory that does not exist yet */
+static void missing_dir_changed(void* data, const char* name, unsigned mask)
+{
+    (void)mask;
+    const char* base = dir_basename(&path_dirs[(intptr_t)data]);
+    snap_slots = NULL;
+    if (!name || my_strcmp(name, base) == 0) {
+        forget_all_commands();
+        path_built = 0;
+    }
+}
+
+/* Watch the parent of missing directory d so its creation is noticed. */
+static int watch_missing_dir(size_t index)
+{
+    const path_dir* d = &path_dirs[index];
+    const char* base = dir_basename(d);
+    if (!base) return -1;
+
+    char parent[PATH_MAX];
+    size_t len = base - &path_buf[d->offset];
+    if (len >= sizeof(parent)) return -1;
+    memcpy(parent, &path_buf[d->offset], len);
+    parent[len] = '\0';
+    return watch_add(parent, missing_dir_changed, (void*)(intptr_t)index);
+}
+
+static void path_cache_clear(void)
+{
+    forget_all_commands();
+    snap_slots = NULL;
+    for (size_t i = 0; i < path_count; i++) {
+        if (path_dirs[i].fd != -1) close(path_dirs[i].fd);
+        watch_remove(path_dirs[i].watch);
+    }
+    free(path_dirs);
+    free(path_buf);
+    path_dirs = NULL;
+    path_buf = NULL;
+    path_count = 0;
+    path_len = 0;
+    path_built = 0;
+}
+
+/* Does the cache still describe this PATH value? */
+static int path_matches(const char* path)
+{
+    if (!path_built) return 0;
+    if (!path) return path_buf == NULL;
+    if (!path_buf || (size_t)my_strlen(path) != path_len) return 0;
+    for (size_t i = 0; i < path_len; i++) {
+        char c = path_buf[i] ? path_buf[i] : ':';
+        if (c != path[i]) return 0;
+    }
+    return 1;
+}
+
+/* FNV-1a of the PATH the cache was built from. */
+static uint64_t path_hash(void)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < path_len; i++) {
+        h = (h ^ (unsigned char)(path_buf[i] ? path_buf[i] : ':')) * 1099511628211ull;
+    }
+    return h;
+}
+
+static void dir_identity(const path_dir* d, snap_dir* out)
+{
+    struct stat st;
+    memset(out, 0, sizeof(*out));
+    if (d->fd != -1 && fstat(d->fd, &st) == 0) {
+        out->dev = st.st_dev;
+        out->ino = st.st_ino;
+        out->sec = st.st_mtim.tv_sec;
+        out->nsec = st.st_mtim.tv_nsec;
+    }
+}
+
+/* Use the last session's lookups if they were made with this PATH and
+   every directory on it is as it was. Costs one fstat per directory. */
+static void snapshot_adopt(void)
+{
+    size_t size;
+    const snap_header* h = state_section(STATE_COMMANDS, &size);
+    if (!h || size < sizeof(*h) || h->path_hash != path_hash() || h->dirs != path_count) return;
+    if (h->slots == 0 || (h->slots & (h->slots - 1)) ||
+        size - sizeof(*h) < (size_t)h->dirs * sizeof(snap_dir) + (size_t)h->slots * sizeof(snap_slot) + h->names) {
+        return;
+    }
+    const snap_dir* dirs = (const snap_dir*)(h + 1);
+    for (size_t i = 0; i < path_count; i++) {
+        snap_dir now;
+        dir_identity(&path_dirs[i], &now);
+        if (memcmp(&now, &dirs[i], sizeof(now)) != 0) return;
+    }
+    snap_slots = (const snap_slot*)(dirs + h->dirs);
+    snap_mask = h->slots - 1;
+    snap_names = (const char*)(snap_slots + h->slots);
+    snap_names_size = h->names;
+}
+
+/* Slot holding name in the last session's table, or NULL. */
+static const snap_slot* snapshot_find(const char* name)
+{
+    if (!snap_slots) return NULL;
+    size_t len = my_strlen(name);
+    for (uint32_t i = name_hash(name) & snap_mask, n = 0; n <= snap_mask; i = (i + 1) & snap_mask, n++) {
+        const snap_slot* s = &snap_slots[i];
+        if (s->name == SNAP_EMPTY) return NULL;
+        /* the image is trusted only as far as these bounds */
+        if (s->name < snap_names_size && len < snap_names_size - s->name &&
+            memcmp(snap_names + s->name, name, len + 1) == 0) {
+            return s->dir >= -1 && s->dir < (int32_t)path_count ? s : NULL;
+        }
+    }
+    return NULL;
+}
+
+static int path_cache_build(const char* path)
+{
+    path_cache_clear();
+    path_built = 1;
+    if (!path) return 0;
+
+    path_len = my_strlen(path);
+    path_buf = malloc(path_len + 1);
+    /* at most one directory per separator, plus one */
+    size_t max_dirs = 1;
+    for (size_t i = 0; i < path_len; i++) max_dirs += path[i] == ':';
+    path_dirs = malloc(max_dirs * sizeof(path_dir));
+    if (!path_buf || !path_dirs) {
+        perror("malloc");
+        path_cache_clear();
+        return -1;
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i <= path_len; i++) {
+        if (i < path_len && path[i] != ':') {
+            path_buf[i] = path[i];
+            continue;
+        }
+        path_buf[i] = '\0';
+        /* empty entries are skipped */
+        if (i > start) {
+            path_dir* d = &path_dirs[path_count++];
+            d->offset = start;
+            d->len = i - start;
+            d->fd = -1;
+            d->watch = -1;
+            if (path_buf[start] == '/') {
+                d->fd = open(&path_buf[start], O_PATH | O_DIRECTORY | O_CLOEXEC);
+                d->watch = d->fd != -1 ? watch_add(&path_buf[start], path_dir_changed, NULL)
+                                       : watch_missing_dir(path_count - 1);
+            }
+        }
+        start = i + 1;
+    }
+    snapshot_adopt();
+    return 0;
+}
+
+/* Make sure the cache describes env's PATH. Returns 0 or -1. */
+int path_cache_update(char** env)
+{
+    watch_dispatch();
+    const char* path = env_lookup("PATH", 4, env);
+    if (path_matches(path)) return 0;
+    return path_cache_build(path);
+}
+
+/* Write dir/command into out. Returns 0, or -1 if it does not fit. */
+static int format_path(const path_dir* d, const char* command, char* out, size_t out_size)
+{
+    const char* dir = &path_buf[d->offset];
+    const char* sep = dir[d->len - 1] == '/' ? "" : "/";
+    int n = snprintf(out, out_size, "%s%s%s", dir, sep, command);
+    return n < 0 || (size_t)n >= out_size ? -1 : 0;
+}
+
+/* Is command an executable file in directory d? */
+static int dir_has_executable(const path_dir* d, const char* command)
+{
+    if (d->fd != -1) {
+        return faccessat(d->fd, command, X_OK, 0) == 0;
+    }
+    /* relative entries follow the cwd, so they are resolved each time */
+    char full_path[PATH_MAX];
+    return path_buf[d->offset] != '/' &&
+           format_path(d, command, full_path, sizeof(full_path)) == 0 &&
+           access(full_path, X_OK) == 0;
+}
+
+/* Locate command on PATH and write its full path into out.
+   Returns 0 if found, -1 otherwise. */
+int path_cache_resolve(const char* command, char** env, char* out, size_t out_size)
+{
+    if (!command || !*command || path_cache_update(env) == -1) return -1;
+
+    command_entry* known = find_command(command);
+    if (known) {
+        return known->dir == -1 ? -1 : format_path(&path_dirs[known->dir], command, out, out_size);
+    }
+    const snap_slot* kept = snapshot_find(command);
+    if (kept) {
+        return kept->dir == -1 ? -1 : format_path(&path_dirs[kept->dir], command, out, out_size);
+    }
+
+    int watched = 1;
+    for (size_t i = 0; i < path_count; i++) {
+        if (path_dirs[i].watch == -1) watched = 0;
+        if (dir_has_executable(&path_dirs[i], command)) {
+            if (watched) remember_command(command, (int)i);
+            return format_path(&path_dirs[i], command, out, out_size);
+        }
+    }
+    if (watched) remember_command(command, -1);
+    return -1;
+}
+
+typedef struct snap_pick {
+    const char* name;
+    int dir;
+} snap_pick;
+
+static int add_pick(snap_pick** picks, size_t* n, size_t* cap, const char* name, int dir)
+{
+    if (*n == *cap) {
+        size_t grown = *cap ? *cap * 2 : 64;
+        snap_pick* p = realloc(*picks, grown * sizeof(snap_pick));
+        if (!p) return -1;
+        *picks = p;
+        *cap = grown;
+    }
+    (*picks)[(*n)++] = (snap_pick){ name, dir };
+    return 0;
+}
+
+/* Append the STATE_COMMANDS section for the state image: every lookup
+   remembered now, and those still in use from the last session.
+   Returns 0 or -1. */
+int path_cache_snapshot(strbuf* out)
+{
+    watch_dispatch();
+    if (!path_built || !path_buf) return 0;
+
+    snap_pick* picks = NULL;
+    size_t count = 0, cap = 0, names = 0;
+    int r = 0;
+    for (int b = 0; r == 0 && b < COMMAND_BUCKETS; b++) {
+        for (command_entry* e = commands[b]; r == 0 && e; e = e->next) {
+            r = add_pick(&picks, &count, &cap, e->name, e->dir);
+            names += my_strlen(e->name) + 1;
+        }
+    }
+    for (uint32_t i = 0; r == 0 && snap_slots && i <= snap_mask; i++) {
+        const snap_slot* s = &snap_slots[i];
+        if (s->name == SNAP_EMPTY || s->name >= snap_names_size) continue;
+        const char* name = snap_names + s->name;
+        if (!memchr(name, '\0', snap_names_size - s->name) || find_command(name) || snapshot_find(name) != s) continue;
+        r = add_pick(&picks, &count, &cap, name, s->dir);
+        names += my_strlen(name) + 1;
+    }
+
+    uint32_t slots = 16;
+    while (slots < count * 2) slots *= 2;
+    snap_header h = { path_hash(), path_count, slots, names, 0 };
+    size_t size = sizeof(h) + path_count * sizeof(snap_dir) + slots * sizeof(snap_slot) + names;
+    if (r == 0) r = sb_reserve(out, size);
+    if (r == 0) {
+        char* base = out->data + out->len;
+        memset(base, 0, size);
+        memcpy(base, &h, sizeof(h));
+        snap_dir* dirs = (snap_dir*)(base + sizeof(h));
+        for (size_t i = 0; i < path_count; i++) dir_identity(&path_dirs[i], &dirs[i]);
+        snap_slot* table = (snap_slot*)(dirs + path_count);
+        char* name_buf = (char*)(table + slots);
+        for (uint32_t i = 0; i < slots; i++) table[i].name = SNAP_EMPTY;
+        uint32_t off = 0;
+        for (size_t k = 0; k < count; k++) {
+            uint32_t i = name_hash(picks[k].name) & (slots - 1);
+            while (table[i].name != SNAP_EMPTY) i = (i + 1) & (slots - 1);
+            size_t len = my_strlen(picks[k].name) + 1;
+            memcpy(name_buf + off, picks[k].name, len);
+            table[i].name = off;
+            table[i].dir = picks[k].dir;
+            off += len;
+        }
+        out->len += size;
+    }
+    free(picks);
+    return r;
+}
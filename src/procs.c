@@ -0,0 +1,520 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <termios.h>
+#include <time.h>
+
+/* procs: a ps/top style process list.
+
+   Every /proc/<pid>/stat file is opened once and kept open. A refresh is
+   a getdents64 of the already open /proc directory to notice new and
+   vanished pids, then one pread() per process that is shown. A kept fd
+   can never be reused for another process: once its process is gone,
+   pread fails and the slot is dropped. The stat line is parsed in place
+   without allocating.
+
+   procs -w only re-reads the processes that fit on the screen, and only
+   rewrites the rows whose text changed since the last refresh, on the
+   alternate screen. */
+
+#define PROCS_HASH 16384        /* pid -> slot buckets, a power of two */
+#define STAT_BUF 1024
+
+struct linux_dirent64 {
+    ino64_t        d_ino;
+    off64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+typedef struct proc_slot {
+    pid_t pid;
+    int fd;                     /* /proc/<pid>/stat, or -1 when free */
+    int next;                   /* hash chain, or free list */
+    pid_t ppid;
+    char state;
+    char comm[32];
+    unsigned seen;              /* scan that last listed the pid */
+    unsigned long long ticks;   /* utime + stime */
+    unsigned long long prev_ticks;
+    unsigned long long start;   /* clock ticks after boot */
+    long rss_pages;
+    double at, prev_at;         /* uptime of the last two samples; 0 for none */
+} proc_slot;
+
+typedef struct proc_table {
+    int proc_fd;
+    proc_slot* slots;
+    int count;                  /* live processes */
+    int used, cap;              /* slots ever handed out, allocated */
+    int free_list;              /* chained through next */
+    unsigned scan;
+    double scanned_at;          /* uptime of the last scan */
+    int* buckets;
+    struct rlimit saved_nofile;
+} proc_table;
+
+/* ---- the stat parser ---- */
+
+static const char* skip_field(const char* p, const char* end)
+{
+    while (p < end && *p != ' ') p++;
+    return p < end ? p + 1 : end;
+}
+
+static unsigned long long parse_num(const char** pp, const char* end)
+{
+    const char* p = *pp;
+    int neg = p < end && *p == '-';
+    if (neg) p++;
+    unsigned long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+    *pp = p < end ? p + 1 : end;
+    return neg ? (unsigned long long)-(long long)v : v;
+}
+
+/* Fill s from the text of /proc/<pid>/stat. The command name sits in
+   parentheses and may itself contain spaces and parentheses, so the fields
+   after it are found from the last ')'. Returns 0, or -1 if malformed. */
+static int parse_stat(const char* buf, size_t len, proc_slot* s)
+{
+    const char* end = buf + len;
+    const char* open = memchr(buf, '(', len);
+    const char* close = NULL;
+    for (const char* p = end; p > buf; p--) {
+        if (p[-1] == ')') {
+            close = p - 1;
+            break;
+        }
+    }
+    if (!open || !close || close < open || close + 2 >= end) return -1;
+
+    size_t n = close - open - 1;
+    if (n >= sizeof(s->comm)) n = sizeof(s->comm) - 1;
+    memcpy(s->comm, open + 1, n);
+    s->comm[n] = '\0';
+
+    const char* p = close + 2;              /* field 3, state */
+    s->state = *p;
+    p = skip_field(p, end);
+    s->ppid = (pid_t)parse_num(&p, end);    /* 4 */
+    for (int field = 5; field < 14; field++) p = skip_field(p, end);
+    unsigned long long utime = parse_num(&p, end);  /* 14 */
+    unsigned long long stime = parse_num(&p, end);  /* 15 */
+    for (int field = 16; field < 22; field++) p = skip_field(p, end);
+    s->start = parse_num(&p, end);          /* 22 */
+    p = skip_field(p, end);                 /* 23, vsize */
+    s->rss_pages = (long)parse_num(&p, end);  /* 24 */
+    s->ticks = utime + stime;
+    return 0;
+}
+
+/* ---- the table ---- */
+
+static int table_find(proc_table* t, pid_t pid)
+{
+    for (int i = t->buckets[pid & (PROCS_HASH - 1)]; i != -1; i = t->slots[i].next) {
+        if (t->slots[i].pid == pid) return i;
+    }
+    return -1;
+}
+
+static void table_drop(proc_table* t, int i)
+{
+    proc_slot* s = &t->slots[i];
+    int* link = &t->buckets[s->pid & (PROCS_HASH - 1)];
+    while (*link != i) link = &t->slots[*link].next;
+    *link = s->next;
+    close(s->fd);
+    s->fd = -1;
+    s->next = t->free_list;
+    t->free_list = i;
+    t->count--;
+}
+
+static int table_add(proc_table* t, pid_t pid, const char* name)
+{
+    int fd;
+    char path[64];
+    snprintf(path, sizeof(path), "%s/stat", name);
+    fd = openat(t->proc_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+
+    int i = t->free_list;
+    if (i != -1) {
+        t->free_list = t->slots[i].next;
+    } else {
+        if (t->used == t->cap) {
+            int cap = t->cap ? t->cap * 2 : 512;
+            proc_slot* grown = mem_realloc(MEM_EXECUTOR, t->slots, cap * sizeof(proc_slot));
+            if (!grown) {
+                close(fd);
+                return -1;
+            }
+            t->slots = grown;
+            t->cap = cap;
+        }
+        i = t->used++;
+    }
+    proc_slot* s = &t->slots[i];
+    memset(s, 0, sizeof(*s));
+    s->pid = pid;
+    s->fd = fd;
+    s->next = t->buckets[pid & (PROCS_HASH - 1)];
+    t->buckets[pid & (PROCS_HASH - 1)] = i;
+    t->count++;
+    return i;
+}
+
+static int table_open(proc_table* t)
+{
+    memset(t, 0, sizeof(*t));
+    t->free_list = -1;
+    t->proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    t->buckets = mem_alloc(MEM_EXECUTOR, PROCS_HASH * sizeof(int));
+    if (t->proc_fd == -1 || !t->buckets) {
+        perror("procs: /proc");
+        if (t->proc_fd != -1) close(t->proc_fd);
+        mem_free(t->buckets);
+        return -1;
+    }
+    for (int i = 0; i < PROCS_HASH; i++) t->buckets[i] = -1;
+
+    /* one fd per process: lift the soft limit for as long as procs runs */
+    if (getrlimit(RLIMIT_NOFILE, &t->saved_nofile) == 0) {
+        struct rlimit raised = t->saved_nofile;
+        raised.rlim_cur = raised.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &raised);
+    }
+    return 0;
+}
+
+static void table_close(proc_table* t)
+{
+    for (int i = 0; i < t->used; i++) {
+        if (t->slots[i].fd != -1) close(t->slots[i].fd);
+    }
+    close(t->proc_fd);
+    setrlimit(RLIMIT_NOFILE, &t->saved_nofile);
+    mem_free(t->slots);
+    mem_free(t->buckets);
+}
+
+static double uptime_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Re-read slot i's stat file. Returns 0, or -1 if the process is gone and
+   the slot was dropped. */
+static int table_sample(proc_table* t, int i, double now)
+{
+    proc_slot* s = &t->slots[i];
+    char stat[STAT_BUF];
+    unsigned long long before = s->ticks;
+    ssize_t len = pread(s->fd, stat, sizeof(stat), 0);
+    if (len <= 0 || parse_stat(stat, len, s) == -1) {
+        table_drop(t, i);
+        return -1;
+    }
+    s->prev_ticks = s->at > 0 ? before : s->ticks;
+    s->prev_at = s->at;
+    s->at = now;
+    return 0;
+}
+
+/* Bring the table in line with /proc: open and read the stat file of each
+   new pid, drop the slots of pids no longer listed. The others keep their
+   last sample. */
+static void table_scan(proc_table* t)
+{
+    unsigned scan = ++t->scan;
+    double now = t->scanned_at = uptime_seconds();
+    lseek(t->proc_fd, 0, SEEK_SET);
+    char buf[32768];
+    long n;
+    while ((n = syscall(SYS_getdents64, t->proc_fd, buf, sizeof(buf))) > 0) {
+        for (long off = 0; off < n; ) {
+            struct linux_dirent64* d = (struct linux_dirent64*)(buf + off);
+            off += d->d_reclen;
+            if (d->d_name[0] < '1' || d->d_name[0] > '9') continue;
+            pid_t pid = 0;
+            for (const char* p = d->d_name; *p >= '0' && *p <= '9'; p++) pid = pid * 10 + (*p - '0');
+            int i = table_find(t, pid);
+            if (i == -1 && (i = table_add(t, pid, d->d_name)) != -1 &&
+                table_sample(t, i, now) == -1) {
+                continue;
+            }
+            if (i != -1) t->slots[i].seen = scan;
+        }
+    }
+    for (int i = 0; i < t->used; i++) {
+        if (t->slots[i].fd != -1 && t->slots[i].seen != scan) table_drop(t, i);
+    }
+}
+
+/* ---- display ---- */
+
+typedef struct procs_opts {
+    int watch;
+    int mine;                   /* -s: only this shell's descendants */
+    double interval;
+} procs_opts;
+
+static int is_descendant(proc_table* t, const proc_slot* s, pid_t ancestor)
+{
+    pid_t pid = s->ppid;
+    for (int depth = 0; depth < 64 && pid > 1; depth++) {
+        if (pid == ancestor) return 1;
+        int i = table_find(t, pid);
+        if (i == -1) return 0;
+        pid = t->slots[i].ppid;
+    }
+    return pid == ancestor;
+}
+
+static int compare_pids(const void* a, const void* b)
+{
+    pid_t x = (*(proc_slot* const*)a)->pid, y = (*(proc_slot* const*)b)->pid;
+    return x < y ? -1 : x > y;
+}
+
+/* The rows to show, in pid order; returns how many. */
+static int select_rows(proc_table* t, const procs_opts* o, proc_slot** rows)
+{
+    pid_t self = getpid();
+    int n = 0;
+    for (int i = 0; i < t->used; i++) {
+        proc_slot* s = &t->slots[i];
+        if (s->fd == -1) continue;
+        if (o->mine && s->pid != self && !is_descendant(t, s, self)) continue;
+        rows[n++] = s;
+    }
+    qsort(rows, n, sizeof(proc_slot*), compare_pids);
+    return n;
+}
+
+/* One row of text into line. cpu is a percentage of one CPU: between the
+   last two samples when there are two, over the process's life before. */
+static int format_row(char* line, size_t size, const proc_slot* s,
+                      long hz, long page_kb, int width)
+{
+    double cpu;
+    if (s->prev_at > 0 && s->at > s->prev_at) {
+        cpu = (s->ticks - s->prev_ticks) * 100.0 / ((s->at - s->prev_at) * hz);
+    } else {
+        double life = s->at - (double)s->start / hz;
+        cpu = life > 0 ? s->ticks * 100.0 / (life * hz) : 0;
+    }
+    unsigned long long secs = s->ticks / hz;
+    int n = snprintf(line, size, "%7d %7d %c %5.1f %9ld %4llu:%02llu %s",
+                     s->pid, s->ppid, s->state, cpu, s->rss_pages * page_kb,
+                     secs / 60, secs % 60, s->comm);
+    if (n < 0) n = 0;
+    if ((size_t)n >= size) n = size - 1;
+    if (width > 0 && n > width) n = width;
+    line[n] = '\0';
+    return n;
+}
+
+#define HEADER "    PID    PPID S  %CPU   RSS(kB)     TIME COMMAND"
+
+static int list_once(proc_table* t, const procs_opts* o)
+{
+    table_scan(t);
+    proc_slot** rows = mem_alloc(MEM_EXECUTOR, (t->count ? t->count : 1) * sizeof(proc_slot*));
+    if (!rows) return 1;
+    int n = select_rows(t, o, rows);
+    long hz = sysconf(_SC_CLK_TCK), page_kb = sysconf(_SC_PAGESIZE) / 1024;
+
+    strbuf out = {0};
+    sb_append(&out, HEADER "\n", sizeof(HEADER));
+    char line[128];
+    for (int i = 0; i < n; i++) {
+        int len = format_row(line, sizeof(line), rows[i], hz, page_kb, 0);
+        sb_append(&out, line, len);
+        sb_putc(&out, '\n');
+    }
+    fflush(stdout);
+    ssize_t w = write(STDOUT_FILENO, out.data, out.len);
+    (void)w;
+    sb_free(&out);
+    mem_free(rows);
+    return 0;
+}
+
+/* The screen as last drawn: one line of text per row. */
+typedef struct screen {
+    char* text;                 /* rows * stride bytes */
+    int rows, cols, stride;
+    int drawn;                  /* rows holding text */
+} screen;
+
+static int screen_size(screen* sc)
+{
+    struct winsize ws;
+    int rows = 24, cols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row && ws.ws_col) {
+        rows = ws.ws_row;
+        cols = ws.ws_col;
+    }
+    mem_free(sc->text);
+    sc->rows = rows;
+    sc->cols = cols;
+    sc->stride = cols + 1;
+    sc->drawn = 0;
+    sc->text = mem_alloc(MEM_EXECUTOR, (size_t)rows * sc->stride);
+    if (!sc->text) return -1;
+    memset(sc->text, 0, (size_t)rows * sc->stride);
+    return 0;
+}
+
+/* Move to row and write line over it, unless it already shows line. */
+static void put_row(screen* sc, strbuf* out, int row, const char* line)
+{
+    char* old = sc->text + (size_t)row * sc->stride;
+    if (row < sc->drawn && strcmp(old, line) == 0) return;
+    char move[24];
+    int n = snprintf(move, sizeof(move), "\x1b[%d;1H", row + 1);
+    sb_append(out, move, n);
+    sb_append(out, line, my_strlen(line));
+    sb_append(out, "\x1b[K", 3);
+    snprintf(old, sc->stride, "%s", line);
+}
+
+/* Rows are re-read as they are drawn: a process that ended since the scan
+   is dropped and the next one takes its row. */
+static void draw(proc_table* t, const procs_opts* o, screen* sc, proc_slot** rows)
+{
+    long hz = sysconf(_SC_CLK_TCK), page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    double now = uptime_seconds();
+    int n = select_rows(t, o, rows);
+
+    strbuf out = {0};
+    char line[512];
+    snprintf(line, sizeof(line), "%d processes%s, every %.1fs; q to quit", n,
+             o->mine ? " started from this shell" : "", o->interval);
+    line[sc->cols < (int)sizeof(line) ? sc->cols : (int)sizeof(line) - 1] = '\0';
+    put_row(sc, &out, 0, line);
+    snprintf(line, sizeof(line), "%s", HEADER);
+    line[sc->cols < (int)sizeof(line) ? sc->cols : (int)sizeof(line) - 1] = '\0';
+    put_row(sc, &out, 1, line);
+
+    int row = 2;
+    for (int i = 0; i < n && row < sc->rows; i++) {
+        if (rows[i]->at < t->scanned_at && table_sample(t, (int)(rows[i] - t->slots), now) == -1) continue;
+        format_row(line, sizeof(line), rows[i], hz, page_kb, sc->cols);
+        put_row(sc, &out, row++, line);
+    }
+    for (int r = row; r < sc->drawn; r++) put_row(sc, &out, r, "");
+    if (row > sc->drawn) sc->drawn = row;
+
+    if (out.len) {
+        ssize_t w = write(STDOUT_FILENO, out.data, out.len);
+        (void)w;
+    }
+    sb_free(&out);
+}
+
+static int watch(proc_table* t, const procs_opts* o)
+{
+    /* keys without Enter; Ctrl-C and resizes through a signalfd of our own,
+       since the shell keeps those signals blocked */
+    struct termios saved, raw;
+    int tty = tcgetattr(STDIN_FILENO, &saved) == 0;
+    if (tty) {
+        raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGWINCH);
+    int sfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    screen sc = {0};
+    proc_slot** rows = NULL;
+    int rows_cap = 0;
+    int status = 0;
+    fflush(stdout);
+    const char* enter = "\x1b[?1049h\x1b[?25l\x1b[H\x1b[2J";
+    ssize_t w = write(STDOUT_FILENO, enter, my_strlen(enter));
+    (void)w;
+
+    int running = screen_size(&sc) == 0;
+    while (running) {
+        table_scan(t);
+        if (t->count > rows_cap) {
+            mem_free(rows);
+            rows_cap = t->count * 2;
+            rows = mem_alloc(MEM_EXECUTOR, rows_cap * sizeof(proc_slot*));
+            if (!rows) {
+                status = 1;
+                break;
+            }
+        }
+        draw(t, o, &sc, rows);
+
+        struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { sfd, POLLIN, 0 } };
+        int timeout = (int)(o->interval * 1000);
+        if (poll(fds, sfd == -1 ? 1 : 2, timeout) <= 0) continue;
+        if (fds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(sfd, &info, sizeof(info)) == sizeof(info)) {
+                if (info.ssi_signo == SIGINT) running = 0;
+                else if (screen_size(&sc) == -1) running = 0;
+                else w = write(STDOUT_FILENO, "\x1b[2J", 4);
+            }
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            char c;
+            if (read(STDIN_FILENO, &c, 1) != 1 || c == 'q' || c == 'Q') running = 0;
+        }
+    }
+
+    const char* leave = "\x1b[?25h\x1b[?1049l";
+    w = write(STDOUT_FILENO, leave, my_strlen(leave));
+    if (sfd != -1) close(sfd);
+    if (tty) tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    mem_free(rows);
+    mem_free(sc.text);
+    return status;
+}
+
+// procs [-s] [-w [seconds]]
+int command_procs(char** args)
+{
+    procs_opts o = { .watch = 0, .mine = 0, .interval = 2.0 };
+    for (int i = 1; args[i]; i++) {
+        if (my_strcmp(args[i], "-s") == 0) {
+            o.mine = 1;
+        } else if (my_strcmp(args[i], "-w") == 0) {
+            o.watch = 1;
+            if (args[i + 1] && args[i + 1][0] >= '0' && args[i + 1][0] <= '9') {
+                o.interval = strtod(args[++i], NULL);
+                if (o.interval < 0.1) o.interval = 0.1;
+            }
+        } else {
+            fprintf(stderr, "usage: procs [-s] [-w [seconds]]\n");
+            return 2;
+        }
+    }
+
+    proc_table t;
+    if (table_open(&t) == -1) return 1;
+    int r = o.watch ? watch(&t, &o) : list_once(&t, &o);
+    table_close(&t);
+    return r;
+}
@@ -0,0 +1,349 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* Prompt segments: cwd, git branch with a dirty flag, last exit status and
+   how long the last command took. The git segment is slow (it runs
+   git status), so a worker thread computes it while the prompt is drawn
+   right away from the cached result for the directory. When the worker
+   finds something new it signals prompt_fd() and the input loop redraws
+   the line. Branch results are reused until .git/HEAD or .git/index
+   changes mtime; the dirty flag is rechecked after every command, since
+   any command may edit files. */
+
+#define PROMPT_CACHE_SIZE 16
+#define SLOW_COMMAND_NS 1000000000LL    /* show durations of 1s or more */
+
+typedef struct prompt_entry {
+    char* dir;                  /* cwd the entry describes, NULL if unused */
+    int in_repo;
+    char branch[128];
+    int dirty;
+    struct timespec head_mtime;
+    struct timespec index_mtime;
+    unsigned long used;         /* for least-recently-used replacement */
+} prompt_entry;
+
+static pthread_mutex_t prompt_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prompt_wake = PTHREAD_COND_INITIALIZER;
+static prompt_entry cache[PROMPT_CACHE_SIZE];
+static unsigned long use_clock = 0;
+
+/* the single pending request for the worker; a newer one replaces it */
+static char* request_dir = NULL;
+static int request_force = 0;
+
+static int event_fd = -1;
+static int worker_started = 0;
+
+/* written and read by the input thread only */
+static long long last_duration_ns = 0;
+
+extern char** environ;
+
+/* Entry for dir, or NULL. Caller holds prompt_lock. */
+static prompt_entry* find_entry(const char* dir)
+{
+    for (int i = 0; i < PROMPT_CACHE_SIZE; i++) {
+        if (cache[i].dir && strcmp(cache[i].dir, dir) == 0) {
+            cache[i].used = ++use_clock;
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+/* Entry for dir, reusing the least recently used one. Caller holds prompt_lock. */
+static prompt_entry* claim_entry(const char* dir)
+{
+    prompt_entry* e = find_entry(dir);
+    if (e) return e;
+
+    e = &cache[0];
+    for (int i = 1; i < PROMPT_CACHE_SIZE; i++) {
+        if (cache[i].used < e->used) e = &cache[i];
+    }
+    char* copy = my_strdup(dir);
+    if (!copy) return NULL;
+    free(e->dir);
+    memset(e, 0, sizeof(*e));
+    e->dir = copy;
+    e->used = ++use_clock;
+    return e;
+}
+
+static int same_time(struct timespec a, struct timespec b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+/* Find the .git directory for dir. Fills gitdir and worktree; returns 0 or
+   -1. A path too long for PATH_MAX counts as not being in a repository. */
+static int find_git_dir(const char* dir, char* gitdir, char* worktree)
+{
+    char path[PATH_MAX];
+    if (snprintf(worktree, PATH_MAX, "%s", dir) >= PATH_MAX) return -1;
+
+    while (1) {
+        struct stat st;
+        if (snprintf(path, sizeof(path), "%s/.git", worktree[1] ? worktree : "") >= (int)sizeof(path)) return -1;
+        if (stat(path, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                memcpy(gitdir, path, sizeof(path));
+                return 0;
+            }
+            /* a .git file points elsewhere: "gitdir: <path>" */
+            FILE* f = fopen(path, "r");
+            if (!f) return -1;
+            char line[PATH_MAX];
+            int ok = fgets(line, sizeof(line), f) && strncmp(line, "gitdir: ", 8) == 0;
+            fclose(f);
+            if (!ok) return -1;
+            line[strcspn(line, "\n")] = '\0';
+            int n = line[8] == '/' ? snprintf(gitdir, PATH_MAX, "%s", line + 8)
+                                   : snprintf(gitdir, PATH_MAX, "%s/%s", worktree, line + 8);
+            return n < PATH_MAX ? 0 : -1;
+        }
+        char* slash = strrchr(worktree, '/');
+        if (!slash || worktree[1] == '\0') return -1;
+        if (slash == worktree) slash[1] = '\0';
+        else *slash = '\0';
+    }
+}
+
+/* Branch name from HEAD, or a short hash when detached. */
+static void read_branch(const char* gitdir, char* branch, size_t size)
+{
+    char path[PATH_MAX];
+    branch[0] = '\0';
+    if (snprintf(path, sizeof(path), "%s/HEAD", gitdir) >= (int)sizeof(path)) return;
+
+    FILE* f = fopen(path, "r");
+    if (!f) return;
+    char line[256];
+    if (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        int n = strncmp(line, "ref: refs/heads/", 16) == 0 ? snprintf(branch, size, "%s", line + 16)
+                                                           : snprintf(branch, size, "%.7s", line);
+        /* a name too long to show whole is not shown at all */
+        if (n >= (int)size) branch[0] = '\0';
+    }
+    fclose(f);
+}
+
+static struct timespec file_mtime(const char* gitdir, const char* name)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    struct timespec none = {0, 0};
+    if (snprintf(path, sizeof(path), "%s/%s", gitdir, name) >= (int)sizeof(path)) return none;
+    return stat(path, &st) == 0 ? st.st_mtim : none;
+}
+
+/* Does the work tree have uncommitted changes to tracked files? */
+static int git_dirty(const char* worktree)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) return 0;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+    /* --no-optional-locks keeps this from fighting the user's own git commands */
+    char* argv[] = { "git", "--no-optional-locks", "-C", (char*)worktree, "status",
+                     "--porcelain", "--untracked-files=no", NULL };
+    /* own process group, so Ctrl-C at the prompt does not reach it */
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setsigmask(&attr, event_child_mask());
+    posix_spawnattr_setpgroup(&attr, 0);
+
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, "git", &actions, &attr, argv, environ) == 0;
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(fds[1]);
+
+    int dirty = 0;
+    char buf[256];
+    ssize_t n;
+    while (spawned && (n = read(fds[0], buf, sizeof(buf))) != 0) {
+        if (n > 0) dirty = 1;
+        else if (errno != EINTR) break;
+    }
+    close(fds[0]);
+    if (spawned) {
+        while (waitpid(pid, NULL, 0) == -1 && errno == EINTR) {}
+    }
+    return dirty;
+}
+
+static void notify_input_thread(void)
+{
+    uint64_t one = 1;
+    ssize_t r = write(event_fd, &one, sizeof(one));
+    (void)r;
+}
+
+/* Compute the git segment for dir and update its cache entry. */
+static void refresh_entry(const char* dir, int force)
+{
+    char gitdir[PATH_MAX];
+    char worktree[PATH_MAX];
+    int in_repo = find_git_dir(dir, gitdir, worktree) == 0;
+
+    char branch[128] = "";
+    struct timespec head = {0, 0}, index = {0, 0};
+    if (in_repo) {
+        head = file_mtime(gitdir, "HEAD");
+        index = file_mtime(gitdir, "index");
+    }
+
+    pthread_mutex_lock(&prompt_lock);
+    prompt_entry* e = find_entry(dir);
+    int unchanged = e && e->in_repo == in_repo &&
+                    same_time(e->head_mtime, head) && same_time(e->index_mtime, index);
+    pthread_mutex_unlock(&prompt_lock);
+    if (unchanged && !force) return;
+
+    int dirty = 0;
+    if (in_repo) {
+        read_branch(gitdir, branch, sizeof(branch));
+        dirty = git_dirty(worktree);
+    }
+
+    pthread_mutex_lock(&prompt_lock);
+    e = claim_entry(dir);
+    int changed = e && (e->in_repo != in_repo || e->dirty != dirty || strcmp(e->branch, branch) != 0);
+    if (e) {
+        e->in_repo = in_repo;
+        e->dirty = dirty;
+        snprintf(e->branch, sizeof(e->branch), "%s", branch);
+        e->head_mtime = head;
+        e->index_mtime = index;
+    }
+    pthread_mutex_unlock(&prompt_lock);
+
+    if (changed) notify_input_thread();
+}
+
+static void* prompt_worker(void* arg)
+{
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&prompt_lock);
+        while (!request_dir) pthread_cond_wait(&prompt_wake, &prompt_lock);
+        char* dir = request_dir;
+        int force = request_force;
+        request_dir = NULL;
+        request_force = 0;
+        pthread_mutex_unlock(&prompt_lock);
+
+        refresh_entry(dir, force);
+        free(dir);
+    }
+    return NULL;
+}
+
+/* Descriptor that becomes readable when the prompt should be redrawn,
+   or -1 if background updates are unavailable. */
+int prompt_fd(void)
+{
+    return event_fd;
+}
+
+/* Consume a wakeup from prompt_fd(). */
+void prompt_ack(void)
+{
+    uint64_t count;
+    ssize_t r = read(event_fd, &count, sizeof(count));
+    (void)r;
+}
+
+/* Record how long the last command took. */
+void prompt_set_duration(long long ns)
+{
+    last_duration_ns = ns;
+}
+
+/* Ask the worker to refresh the segments for the cwd. after_command says a
+   command just ran, so the dirty flag must be rechecked. */
+void prompt_request(int after_command)
+{
+    if (!worker_started) {
+        event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        pthread_t thread;
+        if (event_fd == -1) return;
+        if (pthread_create(&thread, NULL, prompt_worker, NULL) != 0) {
+            close(event_fd);
+            event_fd = -1;
+            return;
+        }
+        pthread_detach(thread);
+        worker_started = 1;
+    }
+
+    char* cwd = my_strdup(dirs_pwd());
+    if (!cwd) return;
+    pthread_mutex_lock(&prompt_lock);
+    free(request_dir);
+    request_dir = cwd;
+    request_force |= after_command;
+    pthread_cond_signal(&prompt_wake);
+    pthread_mutex_unlock(&prompt_lock);
+}
+
+/* snprintf at line + *n that leaves *n inside line[0..size) even when the
+   text is cut short. */
+static void append(char* line, size_t size, int* n, const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int r = vsnprintf(line + *n, size - *n, fmt, ap);
+    va_end(ap);
+    if (r > 0) *n = (size_t)*n + r < size ? *n + r : (int)size - 1;
+}
+
+/* Print the prompt from whatever is cached right now. Never blocks on git.
+   Returns the number of columns it takes. */
+int prompt_render(void)
+{
+    const char* cwd = dirs_pwd();
+    if (!cwd) return printf("[unknown]> ");
+
+    /* the directory has no length limit (getcwd can exceed PATH_MAX), so
+       it goes out on its own; the rest is short but clamped all the same */
+    size_t cwd_len = my_strlen(cwd);
+    char line[256];
+    int n = 0;
+    pthread_mutex_lock(&prompt_lock);
+    prompt_entry* e = find_entry(cwd);
+    if (e && e->in_repo && e->branch[0]) {
+        append(line, sizeof(line), &n, " (%s%s)", e->branch, e->dirty ? "*" : "");
+    }
+    pthread_mutex_unlock(&prompt_lock);
+
+    int status = last_exit_status();
+    if (status != 0) append(line, sizeof(line), &n, " [%d]", status);
+    if (last_duration_ns >= SLOW_COMMAND_NS) {
+        append(line, sizeof(line), &n, " %.1fs", last_duration_ns / 1e9);
+    }
+    append(line, sizeof(line), &n, " > ");
+    fwrite(cwd, 1, cwd_len, stdout);
+    fwrite(line, 1, n, stdout);
+    /* columns, not bytes: the directory may have non-ASCII names */
+    return utf8_string_width(cwd, cwd_len) + utf8_string_width(line, n);
+}
@@ -0,0 +1,378 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Python fork server for `run file.py`, on with setenv EDOSH_PYSERVER=1.
+
+   The first run starts one python3 that imports the modules listed in
+   $EDOSH_PYSERVER_PRELOAD (blank or comma separated) and then waits on a
+   Unix socket in a directory only this user can enter. Each run connects,
+   passes the shell's stdin, stdout and stderr with SCM_RIGHTS together
+   with the working directory, argv and environment, and reads back the
+   wait status. The server forks a child per request that takes over
+   those descriptors and runs the file as __main__, so a script starts
+   with the interpreter and the preloaded modules already initialised.
+
+   The child is in the shell's process group, so Ctrl-C reaches it as it
+   would reach a python3 started by the executor. What the interpreter
+   reads only at startup (PYTHONPATH, -X options) is fixed by the
+   environment the server started with. The server goes away with the
+   shell, and is restarted if it dies or the preload list changes. With
+   EDOSH_CAPTURE on, under limit (whose cgroup the server is not in), or
+   with a [py] runner other than the default, run uses the executor as
+   before. */
+
+static const char server_code[] =
+    "import os, sys, socket, struct, signal, runpy, atexit, traceback\n"
+    "import pkgutil  # run_path imports it on first use; do it once, here\n"
+    "path, ready = sys.argv[1], int(sys.argv[2])\n"
+    "for name in sys.argv[3:]:\n"
+    "    try:\n"
+    "        __import__(name)\n"
+    "    except Exception:\n"
+    "        pass\n"
+    "signal.signal(signal.SIGINT, signal.SIG_IGN)\n"
+    "srv = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)\n"
+    "try:\n"
+    "    os.unlink(path)\n"
+    "except OSError:\n"
+    "    pass\n"
+    "srv.bind(path)\n"
+    "srv.listen(4)\n"
+    "os.write(ready, b'r')\n"
+    "os.close(ready)\n"
+    "\n"
+    "def report(e):\n"
+    "    # start at the script, as python3 FILE would, not in this code or runpy\n"
+    "    tb = e.__traceback__\n"
+    "    while tb and tb.tb_frame.f_code.co_filename != sys.argv[0]:\n"
+    "        tb = tb.tb_next\n"
+    "    traceback.print_exception(type(e), e, tb or e.__traceback__)\n"
+    "\n"
+    "def child(conn, fds, cwd, argv, env):\n"
+    "    srv.close()\n"
+    "    conn.close()\n"
+    "    for i, fd in enumerate(fds):\n"
+    "        os.dup2(fd, i)\n"
+    "        os.close(fd)\n"
+    "    signal.signal(signal.SIGINT, signal.default_int_handler)\n"
+    "    sys.stdin = open(0, 'r', closefd=False)\n"
+    "    sys.stdout = open(1, 'w', buffering=1 if os.isatty(1) else -1, closefd=False)\n"
+    "    sys.stderr = open(2, 'w', buffering=1, closefd=False)\n"
+    "    os.environb.clear()\n"
+    "    for e in env:\n"
+    "        k, _, v = e.partition(b'=')\n"
+    "        os.environb[k] = v\n"
+    "    code = 1\n"
+    "    try:\n"
+    "        os.chdir(cwd)\n"
+    "        sys.argv = [os.fsdecode(a) for a in argv]\n"
+    "        sys.path[0] = os.path.dirname(os.path.abspath(sys.argv[0]))\n"
+    "        runpy.run_path(sys.argv[0], run_name='__main__')\n"
+    "        code = 0\n"
+    "    except SystemExit as e:\n"
+    "        if e.code is None:\n"
+    "            code = 0\n"
+    "        elif isinstance(e.code, int):\n"
+    "            code = e.code\n"
+    "        else:\n"
+    "            print(e.code, file=sys.stderr)\n"
+    "    except KeyboardInterrupt as e:\n"
+    "        report(e)\n"
+    "        code = -signal.SIGINT\n"
+    "    except BaseException as e:\n"
+    "        report(e)\n"
+    "    try:\n"
+    "        atexit._run_exitfuncs()\n"
+    "        sys.stdout.flush()\n"
+    "        sys.stderr.flush()\n"
+    "    except BaseException:\n"
+    "        pass\n"
+    "    if code < 0:\n"
+    "        signal.signal(-code, signal.SIG_DFL)\n"
+    "        os.kill(os.getpid(), -code)\n"
+    "    os._exit(code & 0xff)\n"
+    "\n"
+    "def serve(conn):\n"
+    "    cred = conn.getsockopt(socket.SOL_SOCKET, socket.SO_PEERCRED, struct.calcsize('3i'))\n"
+    "    if struct.unpack('3i', cred)[1] != os.getuid():\n"
+    "        return\n"
+    "    data, fds, _, _ = socket.recv_fds(conn, 65536, 3)\n"
+    "    if len(fds) != 3 or len(data) < 12:\n"
+    "        for fd in fds:\n"
+    "            os.close(fd)\n"
+    "        return\n"
+    "    total, argc, envc = struct.unpack('3I', data[:12])\n"
+    "    while len(data) < total:\n"
+    "        more = conn.recv(total - len(data))\n"
+    "        if not more:\n"
+    "            break\n"
+    "        data += more\n"
+    "    parts = data[12:total].split(b'\\0')\n"
+    "    if len(data) < total or len(parts) < 2 + argc + envc:\n"
+    "        for fd in fds:\n"
+    "            os.close(fd)\n"
+    "        return\n"
+    "    pid = os.fork()\n"
+    "    if pid == 0:\n"
+    "        child(conn, fds, parts[0], parts[1:1 + argc], parts[1 + argc:1 + argc + envc])\n"
+    "    for fd in fds:\n"
+    "        os.close(fd)\n"
+    "    _, status = os.waitpid(pid, 0)\n"
+    "    conn.sendall(struct.pack('i', status))\n"
+    "\n"
+    "while True:\n"
+    "    conn, _ = srv.accept()\n"
+    "    try:\n"
+    "        serve(conn)\n"
+    "    except OSError:\n"
+    "        pass\n"
+    "    conn.close()\n";
+
+static pid_t server_pid = -1;
+static char socket_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static char* server_preload = NULL;     /* the list it was started with (MEM_RUN) */
+
+int pyserver_enabled(char** env)
+{
+    const char* v = env_lookup("EDOSH_PYSERVER", 14, env);
+    return v && *v && my_strcmp(v, "0") != 0;
+}
+
+/* A directory for the socket that only this user can enter. */
+static int socket_dir(char** env, char* out, size_t size)
+{
+    const char* runtime = env_lookup("XDG_RUNTIME_DIR", 15, env);
+    if (runtime && *runtime) {
+        snprintf(out, size, "%s", runtime);
+    } else {
+        snprintf(out, size, "/tmp/edosh-%d", (int)getuid());
+        if (mkdir(out, 0700) == -1 && errno != EEXIST) return -1;
+    }
+    struct stat st;
+    if (lstat(out, &st) == -1 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077)) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Stop the server, if there is one. */
+void pyserver_release(void)
+{
+    if (server_pid != -1) {
+        kill(server_pid, SIGTERM);
+        waitpid(server_pid, NULL, 0);
+        unlink(socket_path);
+        server_pid = -1;
+    }
+    mem_free(server_preload);
+    server_preload = NULL;
+}
+
+/* Start python3 on the server code and wait until it listens. */
+static int start_server(char** env, const char* preload)
+{
+    char dir[PATH_MAX];
+    char python[PATH_MAX];
+    if (socket_dir(env, dir, sizeof(dir)) == -1 ||
+        path_cache_resolve("python3", env, python, sizeof(python)) == -1) {
+        return -1;
+    }
+    int n = snprintf(socket_path, sizeof(socket_path), "%s/edosh-py-%d.sock", dir, (int)getpid());
+    if (n < 0 || (size_t)n >= sizeof(socket_path)) return -1;
+
+    /* python3 -c CODE SOCKET READY-FD MODULE... */
+    char* list = mem_strdup(MEM_RUN, preload);
+    size_t len = my_strlen(preload);
+    char** argv = mem_alloc(MEM_RUN, (len / 2 + 8) * sizeof(char*));
+    if (!list || !argv) {
+        mem_free(list);
+        mem_free(argv);
+        return -1;
+    }
+    size_t argc = 0;
+    argv[argc++] = "python3";
+    argv[argc++] = "-c";
+    argv[argc++] = (char*)server_code;
+    argv[argc++] = socket_path;
+    argv[argc++] = "3";
+    for (char* p = list; *p; ) {
+        while (*p == ' ' || *p == '\t' || *p == ',') *p++ = '\0';
+        if (!*p) break;
+        argv[argc++] = p;
+        while (*p && *p != ' ' && *p != '\t' && *p != ',') p++;
+    }
+    argv[argc] = NULL;
+
+    int ready[2];
+    pid_t parent = getpid();
+    pid_t pid = pipe2(ready, O_CLOEXEC) == 0 ? fork() : -1;
+    if (pid == 0) {
+        event_child_setup();
+        /* the server must not outlive the shell */
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != parent) _exit(1);
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        dup2(ready[1], 3);
+        execve(python, argv, env);
+        _exit(127);
+    }
+    mem_free(argv);
+    mem_free(list);
+    if (pid == -1) return -1;
+    close(ready[1]);
+
+    char c;
+    ssize_t r;
+    while ((r = read(ready[0], &c, 1)) == -1 && errno == EINTR) {}
+    close(ready[0]);
+    if (r != 1) {
+        /* no recv_fds (before 3.9), or it failed to start */
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+    server_pid = pid;
+    server_preload = mem_strdup(MEM_RUN, preload);
+    return 0;
+}
+
+/* Whether the server is up with this preload list, starting it if not. */
+static int ensure_server(char** env)
+{
+    const char* preload = env_lookup("EDOSH_PYSERVER_PRELOAD", 22, env);
+    if (!preload) preload = "";
+    if (server_pid != -1 && (waitpid(server_pid, NULL, WNOHANG) != 0 ||
+                             !server_preload || my_strcmp(server_preload, preload) != 0)) {
+        pyserver_release();
+    }
+    return server_pid != -1 ? 0 : start_server(env, preload);
+}
+
+static int append_string(strbuf* sb, const char* s)
+{
+    return sb_append(sb, s, my_strlen(s) + 1);
+}
+
+/* Build a request: total length, argc, envc, then the NUL-terminated
+   working directory, argv and environment. */
+static int build_request(strbuf* req, const char* file, char** args, char** env)
+{
+    uint32_t head[3] = { 0, 1, 0 };
+    for (size_t i = 0; args[i]; i++) head[1]++;
+    for (size_t i = 0; env[i]; i++) head[2]++;
+    const char* cwd = dirs_pwd();
+    int r = sb_append(req, (const char*)head, sizeof(head));
+    if (r == 0) r = append_string(req, cwd ? cwd : ".");
+    if (r == 0) r = append_string(req, file);
+    for (size_t i = 0; r == 0 && args[i]; i++) r = append_string(req, args[i]);
+    for (size_t i = 0; r == 0 && env[i]; i++) r = append_string(req, env[i]);
+    if (r == 0) {
+        head[0] = req->len;
+        memcpy(req->data, head, sizeof(head));
+    }
+    return r;
+}
+
+/* Connect and send the request, with the shell's stdin, stdout and stderr
+   riding along on the first part. Returns the connected socket or -1. */
+static int send_request(const strbuf* req)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, socket_path, sizeof(socket_path));
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { req->data, req->len };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    size_t done = sent > 0 ? (size_t)sent : 0;
+    while (sent > 0 && done < req->len) {
+        sent = send(fd, req->data + done, req->len - done, MSG_NOSIGNAL);
+        if (sent > 0) done += sent;
+    }
+    if (done < req->len) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Run file with args through the server and store its exit status, as
+   executor() reports it. Returns 0 if it ran, or -1 if the server could
+   not take it and the caller should run it the usual way. */
+int pyserver_run(const char* file, char** args, char** env, int* status)
+{
+    if (capture_enabled(env) || limit_active() || ensure_server(env) == -1) return -1;
+
+    /* the script writes to the shell's own stdout and stderr, so what the
+       shell has buffered must go out first */
+    fflush(stdout);
+    fflush(stderr);
+    strbuf req = {0};
+    int fd = build_request(&req, file, args, env) == 0 ? send_request(&req) : -1;
+    sb_free(&req);
+    if (fd == -1) {
+        /* most likely a server that died; the next run starts another */
+        pyserver_release();
+        return -1;
+    }
+
+    /* from here the script may be running, so never fall back */
+    int wstatus;
+    size_t got = 0;
+    if (event_wait_readable(fd) == 0) {
+        ssize_t r;
+        while (got < sizeof(wstatus) &&
+               ((r = read(fd, (char*)&wstatus + got, sizeof(wstatus) - got)) > 0 || (r == -1 && errno == EINTR))) {
+            if (r > 0) got += r;
+        }
+    }
+    close(fd);
+    if (got < sizeof(wstatus)) {
+        fprintf(stderr, "run: the python server went away\n");
+        pyserver_release();
+        *status = 1;
+        return 0;
+    }
+    if (WIFSIGNALED(wstatus)) {
+        printf("Process terminated by signal: %d\n", WTERMSIG(wstatus));
+        *status = 128 + WTERMSIG(wstatus);
+    } else {
+        *status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 1;
+    }
+    return 0;
+}
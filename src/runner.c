@@ -0,0 +1,506 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* The `run` builtin. What to do with each file extension comes from a
+   registry of runners: an optional compile template, a run template and a
+   cacheable flag. The built-in defaults below and the user's file
+   ($EDOSH_RUNNERS, else ~/.edosh_runners) use the same format, and user
+   entries replace defaults for the same extension:
+
+       [rs]
+       compile = rustc -O {src} -o {out}
+       run = {out} {args}
+       cache = yes
+
+   A section may name several extensions ([cpp cc cxx]). Templates are
+   split into words on blanks. Placeholders are {src} (the source file),
+   {out} (the build output, a file or a directory), {name} (the source
+   file name without directory or extension) and {args}, which must be a
+   whole word and becomes the remaining arguments.
+
+   Cacheable runners build into a shared cache directory under a key
+   hashed from the source contents and the compile template, so an
+   unchanged file is only compiled once. Other runners build into a
+   temporary path that is removed afterwards. Every runner goes through
+   the same compile and run path, so `run -t` timing works for all. The
+   registry is reloaded when the config file's mtime changes. */
+
+#define RUNNER_BUCKETS 64
+
+typedef struct runner {
+    char* ext;
+    char** compile;             /* template words, NULL if nothing to build */
+    char** run;
+    int cacheable;
+    struct runner* next;        /* hash chain */
+} runner;
+
+static runner* runners[RUNNER_BUCKETS];
+static char* config_path = NULL;
+static struct timespec config_mtime;
+
+static const char default_runners[] =
+    "[c]\n"
+    "compile = gcc {src} -o {out}\n"
+    "run = {out} {args}\n"
+    "cache = yes\n"
+    "[cpp cc cxx]\n"
+    "compile = g++ {src} -o {out}\n"
+    "run = {out} {args}\n"
+    "cache = yes\n"
+    "[py]\n"
+    "run = python3 {src} {args}\n"
+    "[java]\n"
+    "compile = javac -d {out} {src}\n"
+    "run = java -cp {out} {name} {args}\n"
+    "cache = yes\n";
+
+static unsigned ext_hash(const char* ext)
+{
+    uint32_t h = 2166136261u;
+    while (*ext) h = (h ^ (unsigned char)*ext++) * 16777619u;
+    return h & (RUNNER_BUCKETS - 1);
+}
+
+static runner* find_runner(const char* ext)
+{
+    for (runner* r = runners[ext_hash(ext)]; r; r = r->next) {
+        if (my_strcmp(r->ext, ext) == 0) return r;
+    }
+    return NULL;
+}
+
+static void free_runner(runner* r)
+{
+    mem_free(r->ext);
+    mem_free(r->compile);
+    mem_free(r->run);
+    mem_free(r);
+}
+
+/* Forget every runner (at exit, and before a reload). */
+void runner_release(void)
+{
+    for (int i = 0; i < RUNNER_BUCKETS; i++) {
+        while (runners[i]) {
+            runner* r = runners[i];
+            runners[i] = r->next;
+            free_runner(r);
+        }
+    }
+    mem_free(config_path);
+    config_path = NULL;
+}
+
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/* Split text into a NULL-terminated word array held in one allocation. */
+static char** split_words(const char* text)
+{
+    size_t words = 0, len = my_strlen(text);
+    for (size_t i = 0; i < len; i++) {
+        if (!is_blank(text[i]) && (i == 0 || is_blank(text[i - 1]))) words++;
+    }
+    size_t table = (words + 1) * sizeof(char*);
+    char** argv = mem_alloc(MEM_RUN, table + len + 1);
+    if (!argv) return NULL;
+
+    char* strings = (char*)argv + table;
+    memcpy(strings, text, len + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (is_blank(strings[i])) strings[i] = '\0';
+        else if (i == 0 || strings[i - 1] == '\0') argv[n++] = &strings[i];
+    }
+    argv[n] = NULL;
+    return argv;
+}
+
+static char* trim(char* s)
+{
+    while (is_blank(*s)) s++;
+    char* end = s + my_strlen(s);
+    while (end > s && (is_blank(end[-1]) || end[-1] == '\r')) end--;
+    *end = '\0';
+    return s;
+}
+
+/* Register one runner per extension in the section. */
+static void add_runners(char* exts, const char* compile, const char* run, int cacheable,
+                        const char* source, int line)
+{
+    if (!run) {
+        fprintf(stderr, "edosh: %s:%d: [%s] has no run template\n", source, line, exts);
+        return;
+    }
+    char** names = split_words(exts);
+    if (!names) return;
+    for (size_t i = 0; names[i]; i++) {
+        runner* r = mem_alloc(MEM_RUN, sizeof(runner));
+        if (!r) break;
+        r->ext = mem_strdup(MEM_RUN, names[i]);
+        r->compile = compile ? split_words(compile) : NULL;
+        r->run = split_words(run);
+        r->cacheable = cacheable;
+        if (!r->ext || !r->run || (compile && !r->compile)) {
+            free_runner(r);
+            break;
+        }
+
+        /* a later definition replaces an earlier one */
+        runner** link = &runners[ext_hash(r->ext)];
+        while (*link && my_strcmp((*link)->ext, r->ext) != 0) link = &(*link)->next;
+        if (*link) {
+            runner* old = *link;
+            r->next = old->next;
+            free_runner(old);
+        } else {
+            r->next = NULL;
+        }
+        *link = r;
+    }
+    mem_free(names);
+}
+
+/* Parse config text (modified in place). source names it in messages. */
+static void parse_config(char* text, const char* source)
+{
+    char* section = NULL;
+    char* compile = NULL;
+    char* run = NULL;
+    int cacheable = 0;
+    int section_line = 0;
+    int line_no = 0;
+
+    char* line = text;
+    while (line) {
+        char* next = my_strchr(line, '\n');
+        if (next) *next++ = '\0';
+        line_no++;
+
+        char* s = trim(line);
+        if (*s == '\0' || *s == '#') {
+            line = next;
+            continue;
+        }
+        if (*s == '[') {
+            char* close = my_strchr(s, ']');
+            if (!close) {
+                fprintf(stderr, "edosh: %s:%d: missing ']'\n", source, line_no);
+                line = next;
+                continue;
+            }
+            if (section) add_runners(section, compile, run, cacheable, source, section_line);
+            *close = '\0';
+            section = s + 1;
+            compile = run = NULL;
+            cacheable = 0;
+            section_line = line_no;
+        } else {
+            char* eq = my_strchr(s, '=');
+            if (!eq || !section) {
+                fprintf(stderr, "edosh: %s:%d: expected [ext] or key = value\n", source, line_no);
+                line = next;
+                continue;
+            }
+            *eq = '\0';
+            char* key = trim(s);
+            char* value = trim(eq + 1);
+            if (my_strcmp(key, "compile") == 0) compile = *value ? value : NULL;
+            else if (my_strcmp(key, "run") == 0) run = value;
+            else if (my_strcmp(key, "cache") == 0) cacheable = my_strcmp(value, "yes") == 0;
+            else fprintf(stderr, "edosh: %s:%d: unknown key '%s'\n", source, line_no, key);
+        }
+        line = next;
+    }
+    if (section) add_runners(section, compile, run, cacheable, source, section_line);
+}
+
+static char* read_file(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+    strbuf sb = {0};
+    ssize_t n;
+    while (sb_reserve(&sb, 4096) == 0 && (n = read(fd, sb.data + sb.len, sb.cap - sb.len - 1)) > 0) {
+        sb.len += n;
+    }
+    close(fd);
+    if (sb.data) sb.data[sb.len] = '\0';
+    return sb.data;
+}
+
+/* Load the registry, again whenever the config file changes. */
+static void load_runners(char** env)
+{
+    char path[PATH_MAX] = "";
+    const char* custom = env_lookup("EDOSH_RUNNERS", 13, env);
+    const char* home = env_lookup("HOME", 4, env);
+    if (custom && *custom) snprintf(path, sizeof(path), "%s", custom);
+    else if (home) snprintf(path, sizeof(path), "%s/.edosh_runners", home);
+
+    struct stat st;
+    struct timespec mtime = {0, 0};
+    if (*path && stat(path, &st) == 0) mtime = st.st_mtim;
+    if (config_path && my_strcmp(config_path, path) == 0 &&
+        config_mtime.tv_sec == mtime.tv_sec && config_mtime.tv_nsec == mtime.tv_nsec) {
+        return;
+    }
+
+    runner_release();
+    char defaults[sizeof(default_runners)];
+    memcpy(defaults, default_runners, sizeof(defaults));
+    parse_config(defaults, "defaults");
+
+    char* text = mtime.tv_sec || mtime.tv_nsec ? read_file(path) : NULL;
+    if (text) {
+        parse_config(text, path);
+        free(text);
+    }
+    config_path = mem_strdup(MEM_RUN, path);
+    config_mtime = mtime;
+}
+
+/* Directory for cached builds, created on demand. */
+static int cache_dir(char** env, char* out, size_t size)
+{
+    const char* xdg = env_lookup("XDG_CACHE_HOME", 14, env);
+    const char* home = env_lookup("HOME", 4, env);
+    char base[PATH_MAX];
+    int n;
+    if (xdg && *xdg) n = snprintf(base, sizeof(base), "%s", xdg);
+    else if (home && *home) n = snprintf(base, sizeof(base), "%s/.cache", home);
+    else n = snprintf(base, sizeof(base), "/tmp/edosh-cache-%d", (int)getuid());
+    /* a path cut short would name some other directory */
+    if (n >= (int)sizeof(base) || snprintf(out, size, "%s/edosh", base) >= (int)size) return -1;
+
+    mkdir(base, 0700);
+    mkdir(out, 0700);
+    if (snprintf(out, size, "%s/edosh/run", base) >= (int)size) return -1;
+    if (mkdir(out, 0700) == -1 && errno != EEXIST) return -1;
+    return 0;
+}
+
+/* Cache key: FNV-1a over the source contents and the compile template. */
+static int build_key(const char* src, char** compile, uint64_t* key)
+{
+    int fd = open(src, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    uint64_t h = 14695981039346656037ull;
+    char buf[16384];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) h = (h ^ (unsigned char)buf[i]) * 1099511628211ull;
+    }
+    close(fd);
+    if (n == -1) return -1;
+    for (size_t w = 0; compile[w]; w++) {
+        for (const char* p = compile[w]; ; p++) {
+            h = (h ^ (unsigned char)*p) * 1099511628211ull;
+            if (!*p) break;
+        }
+    }
+    *key = h;
+    return 0;
+}
+
+typedef struct run_vars {
+    const char* src;
+    const char* out;
+    const char* name;
+    char** args;
+} run_vars;
+
+/* Expand template into a single-allocation argv (tagged MEM_RUN). */
+static char** expand_template(char** tmpl, const run_vars* v)
+{
+    strbuf buf = {0};
+    size_t argc = 0;
+    for (size_t w = 0; tmpl[w]; w++) {
+        if (my_strcmp(tmpl[w], "{args}") == 0) {
+            for (size_t i = 0; v->args[i]; i++, argc++) {
+                sb_append(&buf, v->args[i], my_strlen(v->args[i]));
+                sb_putc(&buf, '\0');
+            }
+            continue;
+        }
+        for (const char* p = tmpl[w]; *p; ) {
+            const char* value = NULL;
+            size_t skip = 0;
+            if (my_strncmp(p, "{src}", 5) == 0) { value = v->src; skip = 5; }
+            else if (my_strncmp(p, "{out}", 5) == 0) { value = v->out; skip = 5; }
+            else if (my_strncmp(p, "{name}", 6) == 0) { value = v->name; skip = 6; }
+            if (value) {
+                sb_append(&buf, value, my_strlen(value));
+                p += skip;
+            } else {
+                sb_putc(&buf, *p++);
+            }
+        }
+        if (sb_putc(&buf, '\0') == -1) break;
+        argc++;
+    }
+
+    size_t table = (argc + 1) * sizeof(char*);
+    char** argv = buf.data ? mem_alloc(MEM_RUN, table + buf.len) : NULL;
+    if (argv) {
+        char* strings = (char*)argv + table;
+        memcpy(strings, buf.data, buf.len);
+        for (size_t i = 0, off = 0; i < argc; i++) {
+            argv[i] = strings + off;
+            off += my_strlen(argv[i]) + 1;
+        }
+        argv[argc] = NULL;
+    } else {
+        perror("malloc");
+    }
+    sb_free(&buf);
+    return argv;
+}
+
+/* Remove a build output: a file, or a directory one level deep. */
+static void remove_output(const char* path)
+{
+    if (unlink(path) == 0 || errno == ENOENT) return;
+    DIR* d = opendir(path);
+    if (!d) return;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (my_strcmp(e->d_name, ".") != 0 && my_strcmp(e->d_name, "..") != 0) {
+            unlinkat(dirfd(d), e->d_name, 0);
+        }
+    }
+    closedir(d);
+    rmdir(path);
+}
+
+static int run_template(char** tmpl, const run_vars* v, char** env)
+{
+    char** argv = expand_template(tmpl, v);
+    if (!argv) return 1;
+    int status = argv[0] ? executor(argv, env) : 0;
+    mem_free(argv);
+    return status;
+}
+
+/* Whether r is the default [py] runner, which the fork server
+   (pyserver.c) can stand in for. */
+static int runs_plain_python(const runner* r)
+{
+    return !r->compile && r->run[0] && my_strcmp(r->run[0], "python3") == 0 &&
+           r->run[1] && my_strcmp(r->run[1], "{src}") == 0 &&
+           r->run[2] && my_strcmp(r->run[2], "{args}") == 0 && !r->run[3];
+}
+
+static double since_ms(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// run [-t] <file> [args...]
+int command_run(char** args, char** env)
+{
+    int timing = args[1] && my_strcmp(args[1], "-t") == 0;
+    char** rest = args + 1 + timing;
+    if (!rest[0]) {
+        printf("Usage: run [-t] <file> [args...]\n");
+        return 1;
+    }
+
+    const char* file = rest[0];
+    const char* base = strrchr(file, '/');
+    base = base ? base + 1 : file;
+    const char* extp = strrchr(base, '.');
+    if (!extp || extp[1] == '\0') {
+        printf("run: unknown file type for '%s'\n", file);
+        return 1;
+    }
+
+    load_runners(env);
+    runner* r = find_runner(extp + 1);
+    if (!r) {
+        printf("run: unsupported extension '%s'\n", extp);
+        return 1;
+    }
+    if (access(file, R_OK) != 0) {
+        perror(file);
+        return 1;
+    }
+
+    char name[NAME_MAX + 1];
+    snprintf(name, sizeof(name), "%.*s", (int)(extp - base), base);
+    char out[PATH_MAX] = "";
+    run_vars v = { file, out, name, rest + 1 };
+    int temporary = 0;
+    const char* compiled = "nothing to compile";
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    double compile_ms = 0;
+
+    if (r->compile) {
+        char dir[PATH_MAX];
+        uint64_t key = 0;
+        int cached = 0;
+        if (r->cacheable && cache_dir(env, dir, sizeof(dir)) == 0 &&
+            build_key(file, r->compile, &key) == 0 &&
+            snprintf(out, sizeof(out), "%s/%016llx", dir, (unsigned long long)key) < (int)sizeof(out) - 16) {
+            cached = access(out, F_OK) == 0;
+        } else {
+            snprintf(out, sizeof(out), "/tmp/edox_run_%d", (int)getpid());
+            temporary = 1;
+        }
+
+        if (cached) {
+            compiled = "compile cached";
+        } else {
+            /* build under a temporary name so a failed build is never cached */
+            char final[PATH_MAX];
+            snprintf(final, sizeof(final), "%s", out);
+            /* the cache path was checked to leave room for this suffix */
+            if (!temporary && snprintf(out, sizeof(out), "%s.tmp%d", final, (int)getpid()) < 0) return 1;
+
+            int status = run_template(r->compile, &v, env);
+            if (status != 0 || access(out, F_OK) != 0) {
+                printf("run: compilation failed for '%s'\n", file);
+                remove_output(out);
+                return status ? status : 1;
+            }
+            if (!temporary && rename(out, final) == -1) {
+                /* another shell may have cached the same build meanwhile */
+                remove_output(out);
+            }
+            snprintf(out, sizeof(out), "%s", final);
+            compiled = "compiled";
+        }
+        compile_ms = since_ms(&started);
+        clock_gettime(CLOCK_MONOTONIC, &started);
+    }
+
+    int status;
+    const char* via = "";
+    if (pyserver_enabled(env) && runs_plain_python(r) && pyserver_run(file, rest + 1, env, &status) == 0) {
+        via = " in the python server";
+    } else {
+        status = run_template(r->run, &v, env);
+    }
+    double run_ms = since_ms(&started);
+    if (temporary) remove_output(out);
+
+    if (timing) {
+        fprintf(stderr, "run: %s %.1f ms, ran%s %.1f ms, status %d\n",
+                compiled, compile_ms, via, run_ms, status);
+    }
+    return status;
+}
@@ -0,0 +1,367 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Script files: edosh FILE and source FILE.
+
+   A script is compiled once into a flat image: every command of every
+   line in order with the operator that joins it to the one before, its
+   words already split, and a mark on each word that needs expansion
+   ($, quotes, backslashes, a leading ~ or a pattern). Commands whose
+   words need none run without going through expand_args at all.
+
+   The image is kept in $XDG_CACHE_HOME/edosh/scripts (~/.cache/...)
+   under the FNV-1a hash of the script's contents, and later runs map it
+   and run from the mapping: the only work left is hashing the source.
+
+   Lines are run as the interactive shell would run them: a line ending
+   in an open quote, $( or a backslash continues on the next one, and a
+   line starting with # (such as #!) is a comment. A syntax error
+   anywhere, or a quote still open at the end, stops the script before
+   anything runs.
+
+   Each distinct word is stored once; a command costs 8 bytes and a word
+   4 more. */
+
+#define SCRIPT_MAGIC 0x31537365u    /* "esS1" */
+#define SCRIPT_VERSION 2
+
+typedef struct script_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;              /* of the source */
+    uint64_t source_size;
+    uint32_t commands;
+    uint32_t words;
+    uint32_t strings;           /* bytes; the last one is always '\0' */
+    uint32_t max_words;         /* most words in one command */
+} script_header;
+
+typedef struct script_command {
+    uint32_t word;              /* first word */
+    uint16_t count;
+    uint8_t op;                 /* list_op joining it to the command before */
+    uint8_t literal;            /* no word needs expansion */
+} script_command;
+
+/* A word is the offset of its text in the strings, with this bit set
+   when it needs expansion. */
+typedef uint32_t script_word;
+#define WORD_EXPAND 0x80000000u
+
+typedef struct compiler {
+    strbuf commands, words, strings;
+    uint32_t ncommands, nwords, max_words;
+    uint32_t* interned;         /* open-addressing set of string offsets + 1 */
+    uint32_t interned_mask, interned_count;
+} compiler;
+
+static uint64_t hash_source(const char* s, size_t n)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+    return h;
+}
+
+static int needs_expansion(const char* word)
+{
+    if (word[0] == '~') return 1;
+    for (const char* p = word; *p; p++) {
+        if (my_strchr("$'\"\\*?[", *p)) return 1;
+    }
+    return 0;
+}
+
+/* Offset of word in the strings, adding it if it is not there yet. */
+static int64_t intern(compiler* c, const char* word)
+{
+    if (c->interned_count * 2 >= c->interned_mask) {
+        uint32_t size = c->interned_mask ? (c->interned_mask + 1) * 2 : 1024;
+        uint32_t* table = calloc(size, sizeof(uint32_t));
+        if (!table) return -1;
+        for (uint32_t i = 0; c->interned && i <= c->interned_mask; i++) {
+            if (!c->interned[i]) continue;
+            uint32_t h = (uint32_t)hash_source(c->strings.data + c->interned[i] - 1,
+                                               my_strlen(c->strings.data + c->interned[i] - 1)) & (size - 1);
+            while (table[h]) h = (h + 1) & (size - 1);
+            table[h] = c->interned[i];
+        }
+        free(c->interned);
+        c->interned = table;
+        c->interned_mask = size - 1;
+    }
+    size_t len = my_strlen(word);
+    uint32_t h = (uint32_t)hash_source(word, len) & c->interned_mask;
+    for (; c->interned[h]; h = (h + 1) & c->interned_mask) {
+        const char* known = c->strings.data + c->interned[h] - 1;
+        if (memcmp(known, word, len + 1) == 0) return c->interned[h] - 1;
+    }
+    uint32_t off = c->strings.len;
+    if (sb_append(&c->strings, word, len + 1) == -1) return -1;
+    c->interned[h] = off + 1;
+    c->interned_count++;
+    return off;
+}
+
+static int add_command(compiler* c, const command_node* node)
+{
+    script_command cmd = { c->nwords, 0, (uint8_t)node->op, 1 };
+    for (size_t i = 0; node->args[i]; i++) {
+        int64_t off = intern(c, node->args[i]);
+        if (off == -1 || cmd.count == UINT16_MAX) return -1;
+        script_word w = (script_word)off;
+        if (needs_expansion(node->args[i])) {
+            w |= WORD_EXPAND;
+            cmd.literal = 0;
+        }
+        if (sb_append(&c->words, (const char*)&w, sizeof(w)) == -1) return -1;
+        cmd.count++;
+        c->nwords++;
+    }
+    if (cmd.count > c->max_words) c->max_words = cmd.count;
+    c->ncommands++;
+    return sb_append(&c->commands, (const char*)&cmd, sizeof(cmd));
+}
+
+/* Compile one logical line. Returns 0, or -1 on a syntax error. */
+static int compile_line(compiler* c, char* text, size_t len, uint32_t line, const char* path)
+{
+    len = editor_join_lines(text, len);
+    size_t i = 0;
+    while (i < len && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n')) i++;
+    if (i == len) return 0;
+
+    command_node* list = parse_command_list(text);
+    if (!list) {
+        fprintf(stderr, "edosh: %s: line %u\n", path, line);
+        return -1;
+    }
+    int r = 0;
+    for (command_node* node = list; r == 0 && node; node = node->next) {
+        if (node->args && node->args[0]) r = add_command(c, node);
+    }
+    free_command_list(list);
+    return r;
+}
+
+/* Compile src[0..n) into an image (malloc'd, as strbuf data is). */
+static char* compile(const char* src, size_t n, uint64_t hash, const char* path, size_t* size)
+{
+    compiler c;
+    memset(&c, 0, sizeof(c));
+    strbuf text = {0};
+    uint32_t line = 1, first = 1;
+    int r = 0;
+    for (size_t i = 0; r == 0 && i <= n; ) {
+        size_t end = i;
+        while (end < n && src[end] != '\n') end++;
+        /* a comment line is dropped before the quote scan sees it, so an
+           apostrophe in it does not carry on into the lines after; inside
+           an open quote a line starting with # is just text */
+        size_t k = i;
+        while (k < end && (src[k] == ' ' || src[k] == '\t')) k++;
+        if (!text.len && k < end && src[k] == '#') {
+            first = ++line;
+            i = end + 1;
+            continue;
+        }
+        if (text.len) r = sb_putc(&text, '\n');
+        if (r == 0) r = sb_append(&text, src + i, end - i);
+        if (r == 0) r = sb_putc(&text, '\0');
+        if (r == -1) break;
+        text.len--;
+        /* an open quote or trailing backslash carries on to the next line */
+        int complete = editor_complete(text.data);
+        if (end >= n && !complete) {
+            fprintf(stderr, "edosh: %s: line %u: unexpected end of file\n", path, first);
+            r = -1;
+            break;
+        }
+        if (complete) {
+            r = compile_line(&c, text.data, text.len, first, path);
+            text.len = 0;
+            first = line + 1;
+        }
+        line++;
+        i = end + 1;
+    }
+    sb_free(&text);
+    if (r == 0) r = sb_putc(&c.strings, '\0');
+
+    strbuf image = {0};
+    script_header h = { SCRIPT_MAGIC, SCRIPT_VERSION, hash, n, c.ncommands, c.nwords,
+                        (uint32_t)c.strings.len, c.max_words };
+    if (r == 0) r = sb_append(&image, (const char*)&h, sizeof(h));
+    if (r == 0 && c.commands.len) r = sb_append(&image, c.commands.data, c.commands.len);
+    if (r == 0 && c.words.len) r = sb_append(&image, c.words.data, c.words.len);
+    if (r == 0) r = sb_append(&image, c.strings.data, c.strings.len);
+    sb_free(&c.commands);
+    sb_free(&c.words);
+    sb_free(&c.strings);
+    free(c.interned);
+    if (r == -1) {
+        sb_free(&image);
+        return NULL;
+    }
+    *size = image.len;
+    return image.data;
+}
+
+/* Whether image[0..size) is a whole image of the source with this hash
+   and size. Offsets inside it are checked as they are used. */
+static int image_valid(const char* image, size_t size, uint64_t hash, size_t source_size)
+{
+    const script_header* h = (const script_header*)image;
+    return size >= sizeof(*h) && h->magic == SCRIPT_MAGIC && h->version == SCRIPT_VERSION &&
+           h->hash == hash && h->source_size == source_size && h->strings > 0 &&
+           size == sizeof(*h) + (size_t)h->commands * sizeof(script_command) +
+                   (size_t)h->words * sizeof(script_word) + h->strings &&
+           image[size - 1] == '\0';
+}
+
+/* Run a compiled image. Returns the status of the last command, or -1
+   if the script ran exit. */
+static int run_image(const char* image, char*** env)
+{
+    const script_header* h = (const script_header*)image;
+    const script_command* commands = (const script_command*)(h + 1);
+    const script_word* words = (const script_word*)(commands + h->commands);
+    const char* strings = (const char*)(words + h->words);
+
+    char** argv = mem_alloc(MEM_PARSER, (h->max_words + 1) * sizeof(char*));
+    if (!argv) {
+        perror("malloc");
+        return 1;
+    }
+    int status = last_exit_status();
+    for (uint32_t i = 0; i < h->commands; i++) {
+        const script_command* c = &commands[i];
+        if (c->count > h->max_words || c->word > h->words || c->count > h->words - c->word) break;
+        uint32_t k = 0;
+        for (; k < c->count && (words[c->word + k] & ~WORD_EXPAND) < h->strings; k++) {
+            /* words are never written to, but argv is not const */
+            argv[k] = (char*)strings + (words[c->word + k] & ~WORD_EXPAND);
+        }
+        if (k < c->count) break;
+        argv[k] = NULL;
+        status = run_command(argv, (list_op)c->op, c->literal, env);
+        if (status == -1) break;
+    }
+    mem_free(argv);
+    return status;
+}
+
+/* Where the image for hash is kept; creates the directories. */
+static int cache_path(char** env, uint64_t hash, char* out, size_t size)
+{
+    const char* xdg = env_lookup("XDG_CACHE_HOME", 14, env);
+    const char* home = env_lookup("HOME", 4, env);
+    char base[PATH_MAX];
+    int n;
+    if (xdg && *xdg) n = snprintf(base, sizeof(base), "%s", xdg);
+    else if (home && *home) n = snprintf(base, sizeof(base), "%s/.cache", home);
+    else return -1;
+    /* a path cut short would name some other file */
+    if (n >= (int)sizeof(base) || snprintf(out, size, "%s/edosh", base) >= (int)size) return -1;
+
+    mkdir(base, 0700);
+    mkdir(out, 0700);
+    if (snprintf(out, size, "%s/edosh/scripts", base) >= (int)size) return -1;
+    if (mkdir(out, 0700) == -1 && errno != EEXIST) return -1;
+    n = snprintf(out, size, "%s/edosh/scripts/%016llx", base, (unsigned long long)hash);
+    return n < (int)size ? 0 : -1;
+}
+
+static void save_image(const char* file, const char* image, size_t size)
+{
+    char tmp[PATH_MAX + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", file, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) return;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t w = write(fd, image + done, size - done);
+        if (w <= 0) break;
+        done += w;
+    }
+    close(fd);
+    if (done != size || rename(tmp, file) == -1) unlink(tmp);
+}
+
+static char* read_source(const char* path, size_t* n)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+    strbuf sb = {0};
+    ssize_t r = 0;
+    while (sb_reserve(&sb, 65536) == 0 && (r = read(fd, sb.data + sb.len, sb.cap - sb.len)) > 0) {
+        sb.len += r;
+    }
+    int err = errno;
+    close(fd);
+    if (r != 0) {
+        sb_free(&sb);
+        errno = err;
+        return NULL;
+    }
+    *n = sb.len;
+    return sb.data ? sb.data : strdup("");
+}
+
+/* Run the script at path. Returns the status of its last command, -1 if
+   it ran exit, 127 if it cannot be read and 2 if it does not parse. */
+int script_run(const char* path, char*** env)
+{
+    size_t n;
+    char* src = read_source(path, &n);
+    if (!src) {
+        fprintf(stderr, "edosh: %s: %s\n", path, strerror(errno));
+        return 127;
+    }
+    uint64_t hash = hash_source(src, n);
+
+    char file[PATH_MAX];
+    int cached = cache_path(*env, hash, file, sizeof(file)) == 0;
+    if (cached) {
+        int fd = open(file, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd != -1 && fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (map != MAP_FAILED) {
+                if (image_valid(map, st.st_size, hash, n)) {
+                    free(src);
+                    int status = run_image(map, env);
+                    munmap(map, st.st_size);
+                    return status;
+                }
+                munmap(map, st.st_size);
+            }
+        } else if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    size_t size;
+    char* image = compile(src, n, hash, path, &size);
+    free(src);
+    if (!image) return 2;
+    if (cached) save_image(file, image, size);
+    int status = run_image(image, env);
+    free(image);
+    return status;
+}
+
+int command_source(char** args, char*** env)
+{
+    if (!args[1]) {
+        printf("Usage: source <file>\n");
+        return 1;
+    }
+    return script_run(args[1], env);
+}
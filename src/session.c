@@ -0,0 +1,299 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <poll.h>
+#include <pty.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+/* Session recording and replay.
+
+   edosh --record FILE logs every byte the line editor reads, one
+   "<ns since start> <hex byte>" line each, timed with CLOCK_MONOTONIC.
+
+   edosh --replay FILE [--realtime] runs a fresh shell on a pseudo-terminal
+   and types the log back into it, either as fast as the shell accepts
+   input or with the recorded gaps. The child shell is started with
+   EDOSH_REPLAY_MARKS set, which makes it print READY_MARK each time it is
+   about to wait for a key. The time from writing a key to the next mark is
+   that key's latency: for ordinary keys this is the redraw, for Enter it is
+   the whole command up to the next prompt. */
+
+#define LOG_HEADER "edosh-keys 1\n"
+#define READY_MARK "\x1b]777;edosh-ready\x07"
+#define READY_MARK_LEN (sizeof(READY_MARK) - 1)
+#define REPLAY_TIMEOUT_MS 10000     /* a key that gets no mark (e.g. read by a command) */
+
+static FILE* record_file = NULL;
+static struct timespec record_start;
+static int marks_enabled = -1;
+
+static long long now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void record_close(void)
+{
+    if (record_file) fclose(record_file);
+    record_file = NULL;
+}
+
+/* Start logging keystrokes to path. Returns 0 or -1. */
+int session_record_open(const char* path)
+{
+    record_file = fopen(path, "we");
+    if (!record_file) {
+        perror(path);
+        return -1;
+    }
+    fputs(LOG_HEADER, record_file);
+    clock_gettime(CLOCK_MONOTONIC, &record_start);
+    atexit(record_close);
+    return 0;
+}
+
+void session_record_key(char c)
+{
+    if (!record_file) return;
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    long long ns = (t.tv_sec - record_start.tv_sec) * 1000000000LL + (t.tv_nsec - record_start.tv_nsec);
+    fprintf(record_file, "%lld %02x\n", ns, (unsigned char)c);
+    /* a finished line is a good place to make the log durable */
+    if (c == '\r' || c == '\n') fflush(record_file);
+}
+
+/* Called when the editor is about to wait for a key. */
+void session_mark_ready(void)
+{
+    if (marks_enabled == -1) {
+        const char* v = getenv("EDOSH_REPLAY_MARKS");
+        marks_enabled = v && *v;
+    }
+    if (!marks_enabled) return;
+    fflush(stdout);
+    ssize_t r = write(STDOUT_FILENO, READY_MARK, READY_MARK_LEN);
+    (void)r;
+}
+
+typedef struct key_event {
+    long long at;               /* ns since the recording started */
+    unsigned char c;
+} key_event;
+
+static key_event* load_log(const char* path, size_t* count)
+{
+    FILE* f = fopen(path, "re");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    char line[64];
+    if (!fgets(line, sizeof(line), f) || strcmp(line, LOG_HEADER) != 0) {
+        fprintf(stderr, "replay: %s is not a keystroke log\n", path);
+        fclose(f);
+        return NULL;
+    }
+
+    key_event* keys = NULL;
+    size_t n = 0, cap = 0;
+    long long at;
+    unsigned c;
+    while (fscanf(f, "%lld %x", &at, &c) == 2) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            key_event* grown = realloc(keys, cap * sizeof(key_event));
+            if (!grown) {
+                perror("realloc");
+                free(keys);
+                fclose(f);
+                return NULL;
+            }
+            keys = grown;
+        }
+        keys[n].at = at;
+        keys[n].c = (unsigned char)c;
+        n++;
+    }
+    fclose(f);
+    *count = n;
+    return keys;
+}
+
+/* Scans pty output for READY_MARK across read boundaries. */
+typedef struct mark_scanner {
+    size_t matched;             /* bytes of READY_MARK seen so far */
+} mark_scanner;
+
+/* Read what is available from fd; returns the number of marks seen,
+   or -1 once the child side is gone. */
+static int drain_output(int fd, mark_scanner* s)
+{
+    char buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) return n == -1 && errno == EINTR ? 0 : -1;
+
+    int marks = 0;
+    for (ssize_t i = 0; i < n; i++) {
+        if (buf[i] == READY_MARK[s->matched]) {
+            if (++s->matched == READY_MARK_LEN) {
+                marks++;
+                s->matched = 0;
+            }
+        } else {
+            s->matched = buf[i] == READY_MARK[0] ? 1 : 0;
+        }
+    }
+    return marks;
+}
+
+/* Wait until the shell prints a mark, up to timeout_ms. Returns 1 on a
+   mark, 0 on timeout, -1 when the shell has gone away. */
+static int wait_ready(int fd, mark_scanner* s, int timeout_ms)
+{
+    long long end = now_ns() + timeout_ms * 1000000LL;
+    while (1) {
+        long long left = (end - now_ns()) / 1000000;
+        if (left < 0) return 0;
+        struct pollfd p = { fd, POLLIN, 0 };
+        int r = poll(&p, 1, (int)left);
+        if (r == 0) return 0;
+        if (r == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        int marks = drain_output(fd, s);
+        if (marks < 0) return -1;
+        if (marks > 0) return 1;
+    }
+}
+
+static int compare_ll(const void* a, const void* b)
+{
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report_keys(long long* lat, size_t n)
+{
+    if (n == 0) return;
+    qsort(lat, n, sizeof(long long), compare_ll);
+    printf("keystroke redraw latency (us): min %lld  median %lld  p99 %lld  max %lld  (%zu keys)\n",
+           lat[0] / 1000, lat[n / 2] / 1000, lat[(n * 99) / 100] / 1000, lat[n - 1] / 1000, n);
+}
+
+/* Start the shell on a new pty with ready marks turned on. */
+static pid_t spawn_shell(int* master)
+{
+    struct winsize ws = { 24, 80, 0, 0 };
+    int slave;
+    if (openpty(master, &slave, NULL, NULL, &ws) == -1) {
+        perror("openpty");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(*master);
+        close(slave);
+        return -1;
+    }
+    if (pid == 0) {
+        close(*master);
+        setsid();
+        ioctl(slave, TIOCSCTTY, 0);
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        if (slave > STDERR_FILENO) close(slave);
+        setenv("EDOSH_REPLAY_MARKS", "1", 1);
+        execl("/proc/self/exe", "edosh", (char*)NULL);
+        _exit(127);
+    }
+    close(slave);
+    return pid;
+}
+
+/* Replay the log at path and print latency figures. Returns an exit status. */
+int session_replay(const char* path, int realtime)
+{
+    size_t count = 0;
+    key_event* keys = load_log(path, &count);
+    if (!keys) return 1;
+
+    int master;
+    pid_t pid = spawn_shell(&master);
+    if (pid == -1) {
+        free(keys);
+        return 1;
+    }
+
+    long long* key_lat = malloc((count ? count : 1) * sizeof(long long));
+    if (!key_lat) {
+        perror("malloc");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(master);
+        free(keys);
+        return 1;
+    }
+    strbuf line = {0};
+    mark_scanner scan = {0};
+    size_t key_n = 0, commands = 0, stalls = 0;
+
+    printf("replay: %zu keystrokes from %s, %s\n", count, path, realtime ? "real time" : "full speed");
+    int alive = wait_ready(master, &scan, REPLAY_TIMEOUT_MS) >= 0;
+    long long start = now_ns();
+
+    for (size_t i = 0; i < count && alive; i++) {
+        if (realtime) {
+            long long wait = keys[i].at - (now_ns() - start);
+            if (wait > 0) {
+                struct timespec ts = { wait / 1000000000LL, wait % 1000000000LL };
+                nanosleep(&ts, NULL);
+            }
+        }
+
+        char c = (char)keys[i].c;
+        long long sent = now_ns();
+        if (write(master, &c, 1) != 1) break;
+        int r = wait_ready(master, &scan, REPLAY_TIMEOUT_MS);
+        long long took = now_ns() - sent;
+        if (r == -1) {
+            /* the shell exited, normally because the log ends with exit */
+            alive = 0;
+            break;
+        }
+        if (r == 0) {
+            stalls++;
+            continue;
+        }
+
+        if (c == '\r' || c == '\n') {
+            sb_putc(&line, '\0');
+            printf("command %4zu: %10.3f ms  %s\n", ++commands, took / 1e6, line.data);
+            line.len = 0;
+        } else {
+            if ((unsigned char)c >= 32 && (unsigned char)c <= 126) sb_putc(&line, c);
+            else if ((c == 127 || c == 8) && line.len > 0) line.len--;
+            key_lat[key_n++] = took;
+        }
+    }
+
+    report_keys(key_lat, key_n);
+    if (stalls) printf("%zu keys got no ready mark within %d ms\n", stalls, REPLAY_TIMEOUT_MS);
+
+    /* give the shell a moment to exit on its own, then make sure it does */
+    struct pollfd p = { master, POLLIN, 0 };
+    while (alive && poll(&p, 1, 2000) > 0 && drain_output(master, &scan) >= 0) {}
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    close(master);
+    sb_free(&line);
+    free(key_lat);
+    free(keys);
+    return 0;
+}
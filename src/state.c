@@ -0,0 +1,319 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* State image: what one session learned, handed to the next.
+
+   The image is a header followed by sections, each owned by the
+   subsystem that writes it: the history, and the command lookups of the
+   PATH cache (path_cache.c). It is mapped read-only at startup and each
+   subsystem uses its section in place. Every offset inside a section is
+   relative to the section, so nothing is parsed or fixed up on load, and
+   startup costs the same however much the image holds. The environment
+   is not kept here (it comes from the parent), and the cd frecency
+   database has a file of its own (dirs.c).
+
+   A new image is written to a temporary file and renamed over the old
+   one at exit, and every few minutes after a command, so a reader only
+   ever sees a whole file. The header holds the size, checked at load, and
+   an FNV-1a checksum of each section, checked the first time the section
+   is used: load itself reads only the header, and each subsystem pays
+   for the section it reads, whose size it bounds. An image cut short is
+   ignored, and a damaged section is treated as absent. Sections also
+   check their own validity: the PATH section is dropped when PATH or the
+   mtime of a directory on it no longer matches.
+
+   Several shells share the image. A save takes a lock, rereads the
+   history of the image on disk, which other shells may have saved to
+   since this one started, and appends only this session's new entries,
+   so no shell's exit throws away another's history. */
+
+#define STATE_MAGIC 0x31537465u     /* "etS1" */
+#define STATE_VERSION 3             /* bump on any change to a section layout */
+#define STATE_SAVE_INTERVAL 300     /* seconds between saves after commands */
+#define STATE_ALIGN 8
+#define STATE_HISTORY_MAX 1000      /* entries kept in the image */
+
+typedef struct state_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;              /* of the whole file */
+    struct {
+        uint32_t offset;        /* from the start of the file; 0 if absent */
+        uint32_t size;
+        uint64_t checksum;      /* FNV-1a of the section */
+    } sections[STATE_SECTION_COUNT];
+} state_header;
+
+/* History section: count, then the offset of each entry from the start
+   of the section, oldest first, then the NUL-terminated entries. */
+typedef struct history_section {
+    uint32_t count;
+    uint32_t entries[];
+} history_section;
+
+static char state_file[PATH_MAX];
+static const char* map = NULL;
+static size_t map_size = 0;
+static time_t saved_at = 0;
+static int unsaved = 0;         /* history entries added since the last save */
+static signed char checked[STATE_SECTION_COUNT];   /* of map: 1 good, -1 damaged */
+
+static uint64_t checksum(const char* p, size_t n)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)p[i]) * 1099511628211ull;
+    return h;
+}
+
+/* Whether image holds a whole image of this version. Only the layout is
+   checked here; section checksums are checked as the sections are used. */
+static int image_ok(const char* image, size_t size)
+{
+    if (size < sizeof(state_header)) return 0;
+    const state_header* h = (const state_header*)image;
+    int ok = h->magic == STATE_MAGIC && h->version == STATE_VERSION && h->size == size;
+    for (int i = 0; ok && i < STATE_SECTION_COUNT; i++) {
+        ok = h->sections[i].offset % STATE_ALIGN == 0 &&
+             h->sections[i].offset <= size &&
+             h->sections[i].size <= size - h->sections[i].offset;
+    }
+    return ok;
+}
+
+/* Map the image at fd read-only; NULL if it is not a valid one. */
+static const char* map_image(int fd, size_t* size)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(state_header)) return NULL;
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) return NULL;
+    if (!image_ok(p, st.st_size)) {
+        munmap(p, st.st_size);
+        return NULL;
+    }
+    *size = st.st_size;
+    return p;
+}
+
+/* Map the image of the last session, if there is one. */
+void state_load(char** env)
+{
+    const char* xdg = env_lookup("XDG_STATE_HOME", 14, env);
+    const char* home = env_lookup("HOME", 4, env);
+    if (xdg && *xdg) snprintf(state_file, sizeof(state_file), "%s/edosh/state", xdg);
+    else if (home && *home) snprintf(state_file, sizeof(state_file), "%s/.local/state/edosh/state", home);
+    else return;
+    saved_at = time(NULL);
+
+    int fd = open(state_file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+    map = map_image(fd, &map_size);
+    close(fd);
+    memset(checked, 0, sizeof(checked));
+}
+
+/* Section id of image, or NULL if it is absent or, when check is set,
+   damaged. */
+static const void* section_of(const char* image, int id, size_t* size, int check)
+{
+    const state_header* h = (const state_header*)image;
+    if (!h->sections[id].offset || !h->sections[id].size) return NULL;
+    const char* s = image + h->sections[id].offset;
+    if (check && checksum(s, h->sections[id].size) != h->sections[id].checksum) return NULL;
+    *size = h->sections[id].size;
+    return s;
+}
+
+/* Section id of the loaded image, or NULL if it has none. Its checksum is
+   checked the first time it is asked for. */
+const void* state_section(int id, size_t* size)
+{
+    if (!map || checked[id] == -1) return NULL;
+    const void* s = section_of(map, id, size, 0);
+    if (s && !checked[id]) {
+        const state_header* h = (const state_header*)map;
+        checked[id] = checksum(s, *size) == h->sections[id].checksum ? 1 : -1;
+    }
+    return checked[id] == 1 ? s : NULL;
+}
+
+/* Whether p points into the image, and so must not be freed. */
+int state_contains(const void* p)
+{
+    return map && (const char*)p >= map && (const char*)p < map + map_size;
+}
+
+/* The newest max entries of history section s, oldest first, into history. */
+static int history_entries(const history_section* s, size_t size, char** history, int max)
+{
+    if (!s || size < sizeof(*s) || s->count > (size - sizeof(*s)) / sizeof(uint32_t)) return 0;
+
+    uint32_t first = s->count > (uint32_t)max ? s->count - max : 0;
+    int n = 0;
+    for (uint32_t i = first; i < s->count; i++) {
+        uint32_t off = s->entries[i];
+        /* an entry has to end inside the section */
+        if (off >= size || !memchr((const char*)s + off, '\0', size - off)) continue;
+        history[n++] = (char*)s + off;
+    }
+    return n;
+}
+
+/* Fill history with up to max entries from the image, oldest first.
+   The entries point into the read-only mapping. */
+int state_history(char** history, int max)
+{
+    size_t size = 0;
+    const history_section* s = state_section(STATE_HISTORY, &size);
+    return history_entries(s, size, history, max);
+}
+
+/* A line was added at the end of the history the shell will save. */
+void state_history_added(void)
+{
+    unsaved++;
+}
+
+static int history_snapshot(char** history, int count, strbuf* out)
+{
+    uint32_t header = sizeof(history_section) + count * sizeof(uint32_t);
+    if (sb_reserve(out, header) == -1) return -1;
+    out->len = header;
+    history_section* s = (history_section*)out->data;
+    s->count = count;
+    for (int i = 0; i < count; i++) {
+        /* out->data may move as entries are added */
+        uint32_t off = out->len;
+        if (sb_append(out, history[i], my_strlen(history[i]) + 1) == -1) return -1;
+        ((history_section*)out->data)->entries[i] = off;
+    }
+    return 0;
+}
+
+/* Create the directories leading to the image. */
+static void make_parents(const char* file)
+{
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", file);
+    for (char* p = dir + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(dir, 0700);
+        *p = '/';
+    }
+}
+
+/* The history to save: the image on disk now, then the last added of
+   the count entries of history, which this session has not saved yet.
+   Without a valid image or history section on disk the rest of history
+   stands in for it. */
+static int merged_history(char** history, int count, int added, strbuf* out)
+{
+    if (added > count) added = count;
+    char** list = mem_alloc(MEM_HISTORY, (STATE_HISTORY_MAX + count) * sizeof(char*));
+    if (!list) return -1;
+    int n = 0;
+    size_t disk_size = 0;
+    const char* disk = NULL;
+    int fd = open(state_file, O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        disk = map_image(fd, &disk_size);
+        close(fd);
+    }
+    size_t size = 0;
+    const history_section* s = disk ? section_of(disk, STATE_HISTORY, &size, 1) : NULL;
+    if (s || (disk && !section_of(disk, STATE_HISTORY, &size, 0))) {
+        /* a good section, or none at all */
+        n = history_entries(s, size, list, STATE_HISTORY_MAX);
+    } else {
+        for (int i = 0; i < count - added; i++) list[n++] = history[i];
+    }
+    for (int i = count - added; i < count; i++) list[n++] = history[i];
+
+    int first = n > STATE_HISTORY_MAX ? n - STATE_HISTORY_MAX : 0;
+    int r = history_snapshot(list + first, n - first, out);
+    if (disk) munmap((void*)disk, disk_size);
+    mem_free(list);
+    return r;
+}
+
+/* Write a new image from the current state and rename it into place.
+   The old mapping stays in use until exit. Returns 0 or -1. */
+int state_save(char** history, int count)
+{
+    if (!state_file[0]) return -1;
+    saved_at = time(NULL);
+
+    /* one save at a time, so two shells do not both merge the same old
+       image and drop each other's lines */
+    char lock[PATH_MAX + 8];
+    snprintf(lock, sizeof(lock), "%s.lock", state_file);
+    make_parents(state_file);
+    int lock_fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lock_fd != -1) flock(lock_fd, LOCK_EX);
+
+    strbuf sections[STATE_SECTION_COUNT];
+    memset(sections, 0, sizeof(sections));
+    int r = merged_history(history, count, unsaved, &sections[STATE_HISTORY]);
+    if (r == 0) r = path_cache_snapshot(&sections[STATE_COMMANDS]);
+
+    strbuf image = {0};
+    state_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = STATE_MAGIC;
+    h.version = STATE_VERSION;
+    if (r == 0) r = sb_append(&image, (const char*)&h, sizeof(h));
+    for (int i = 0; r == 0 && i < STATE_SECTION_COUNT; i++) {
+        while (r == 0 && image.len % STATE_ALIGN) r = sb_putc(&image, '\0');
+        if (r == 0 && sections[i].len) {
+            h.sections[i].offset = image.len;
+            h.sections[i].size = sections[i].len;
+            h.sections[i].checksum = checksum(sections[i].data, sections[i].len);
+            r = sb_append(&image, sections[i].data, sections[i].len);
+        }
+    }
+    for (int i = 0; i < STATE_SECTION_COUNT; i++) sb_free(&sections[i]);
+    if (r == 0) {
+        h.size = image.len;
+        memcpy(image.data, &h, sizeof(h));
+
+        char tmp[PATH_MAX + 32];
+        snprintf(tmp, sizeof(tmp), "%s.%d.tmp", state_file, (int)getpid());
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        size_t done = 0;
+        while (fd != -1 && done < image.len) {
+            ssize_t w = write(fd, image.data + done, image.len - done);
+            if (w <= 0) break;
+            done += w;
+        }
+        if (fd != -1) close(fd);
+        r = fd != -1 && done == image.len && rename(tmp, state_file) == 0 ? 0 : -1;
+        if (r == -1 && fd != -1) unlink(tmp);
+    }
+    sb_free(&image);
+    if (lock_fd != -1) close(lock_fd);
+    if (r == 0) unsaved = 0;
+    return r;
+}
+
+/* Save after a command if the last save was a while ago. */
+void state_save_periodic(char** history, int count)
+{
+    if (state_file[0] && time(NULL) - saved_at >= STATE_SAVE_INTERVAL) state_save(history, count);
+}
+
+/* Unmap the image; nothing may point into it any more. */
+void state_release(void)
+{
+    if (map) munmap((void*)map, map_size);
+    map = NULL;
+    map_size = 0;
+}
@@ -0,0 +1,124 @@
+#include "my_shell.h"
+#include <string.h>
+
+/* Command substitution: $(...) is replaced by the output of the commands
+   inside, minus trailing newlines. A single capturable builtin such as
+   $(pwd) or $(echo ...) runs in-process with its output written straight
+   into the result. Anything else runs in a forked copy of the shell whose
+   stdout is a pipe, read in large chunks into a growing buffer. A single
+   command is expanded before the fork and not again in the child.
+   The status of the last substitution is kept for a command that has no
+   words left after expansion, whose status it becomes, as in sh. */
+
+static int subst_status = 0;
+
+/* Forget the last substitution's status before a command is expanded. */
+void subst_status_reset(void)
+{
+    subst_status = 0;
+}
+
+/* Status of the last substitution since subst_status_reset, or 0. */
+int subst_last_status(void)
+{
+    return subst_status;
+}
+
+/* Read everything from fd into result. Returns 0 or -1. */
+static int read_all(int fd, strbuf* result)
+{
+    while (1) {
+        if (sb_reserve(result, 4096) == -1) return -1;
+        ssize_t n = read(fd, result->data + result->len, result->cap - result->len);
+        if (n == 0) return 0;
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("read");
+            return -1;
+        }
+        result->len += n;
+    }
+}
+
+/* Run list in a child whose stdout goes into result; or, when argv is
+   not NULL, just that one command, whose words are already expanded. */
+static int capture_forked(command_node* list, char** argv, char** env, strbuf* result)
+{
+    int fds[2];
+    if (pipe(fds) == -1) {
+        perror("pipe");
+        return -1;
+    }
+
+    /* anything still buffered would otherwise be written twice */
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        event_child_setup();
+
+        close(fds[0]);
+        if (dup2(fds[1], STDOUT_FILENO) == -1) _exit(127);
+        close(fds[1]);
+
+        int status = argv ? run_command(argv, LIST_SEQ, 1, &env) : run_command_list(list, &env);
+        fflush(stdout);
+        _exit(status == -1 ? last_exit_status() : status);
+    }
+
+    close(fds[1]);
+    int r = read_all(fds[0], result);
+    close(fds[0]);
+
+    int status;
+    if (event_wait_child(pid, &status) == -1) {
+        perror("waitpid");
+        subst_status = 1;
+    } else {
+        subst_status = WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                     : WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
+    return r;
+}
+
+/* Run text[0..len) and store its output in result with trailing newlines
+   removed. Returns 0 or -1. */
+int command_substitute(const char* text, size_t len, char** env, strbuf* result)
+{
+    char* command = mem_alloc(MEM_PARSER, len + 1);
+    if (!command) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(command, text, len);
+    command[len] = '\0';
+
+    command_node* list = parse_command_list(command);
+    mem_free(command);
+    if (!list) return 0;
+
+    /* a single command is expanded once, here, and then either captured
+       in-process or run as it is in the child: expanding it again there
+       would run any $(...) inside it twice */
+    int r = 0;
+    if (!list->next) {
+        char** argv = expand_args(list->args, env);
+        if (!argv) r = -1;
+        else if (argv[0] && !builtin_capture(argv, result, &subst_status)) {
+            r = capture_forked(list, argv, env, result);
+        }
+        mem_free(argv);
+    } else {
+        r = capture_forked(list, NULL, env, result);
+    }
+    free_command_list(list);
+
+    while (result->len > 0 && result->data[result->len - 1] == '\n') result->len--;
+    return r;
+}
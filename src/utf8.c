@@ -0,0 +1,84 @@
+#include "my_shell.h"
+#include "width_table.h"
+
+/* UTF-8 decoding and terminal display widths.
+
+   Widths come from a two-stage table generated at build time from the C
+   library's wcwidth (tools/gen_width_table.c): two array lookups and a
+   shift per code point, with no locale and no call into libc. */
+
+/* Bytes in the sequence that starts with lead, or 0 if lead cannot start
+   one. */
+int utf8_seq_len(unsigned char lead)
+{
+    if (lead < 0x80) return 1;
+    if (lead < 0xc2) return 0;      /* continuation byte, or overlong */
+    if (lead < 0xe0) return 2;
+    if (lead < 0xf0) return 3;
+    if (lead < 0xf5) return 4;
+    return 0;
+}
+
+/* Decode the code point at s[0..n). *len gets the bytes it took; an
+   invalid or cut-short sequence decodes as U+FFFD, one byte long. */
+unsigned utf8_decode(const char* s, size_t n, size_t* len)
+{
+    const unsigned char* p = (const unsigned char*)s;
+    int want = n ? utf8_seq_len(p[0]) : 0;
+    *len = 1;
+    if (want == 1) return p[0];
+    if (want == 0 || (size_t)want > n) return 0xfffd;
+
+    unsigned cp = p[0] & (0x7f >> want);
+    for (int i = 1; i < want; i++) {
+        if ((p[i] & 0xc0) != 0x80) return 0xfffd;
+        cp = cp << 6 | (p[i] & 0x3f);
+    }
+    /* overlong forms, surrogates and past U+10FFFF */
+    static const unsigned min[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (cp < min[want] || (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff) return 0xfffd;
+    *len = want;
+    return cp;
+}
+
+/* Columns the terminal gives cp: 0, 1 or 2. */
+int utf8_width(unsigned cp)
+{
+    if (cp >= 0x110000) return 1;
+    const unsigned char* block = width_stage2[width_stage1[cp >> WIDTH_BLOCK_BITS]];
+    unsigned i = cp & ((1u << WIDTH_BLOCK_BITS) - 1);
+    return block[i / 4] >> (i % 4 * 2) & 3;
+}
+
+/* Whether cp belongs to the grapheme before it rather than starting its
+   own: combining marks and other zero-width code points (which include
+   the zero width joiner and variation selectors), and emoji skin tones. */
+int utf8_extends(unsigned cp)
+{
+    if (cp < 0x300) return 0;
+    if (cp >= 0x1f3fb && cp <= 0x1f3ff) return 1;
+    return utf8_width(cp) == 0;
+}
+
+int utf8_is_regional(unsigned cp)
+{
+    return cp >= 0x1f1e6 && cp <= 0x1f1ff;
+}
+
+/* Columns taken by the n bytes at s. */
+size_t utf8_string_width(const char* s, size_t n)
+{
+    size_t cols = 0;
+    while (n) {
+        size_t len;
+        if ((unsigned char)*s < 0x80) {
+            cols++;
+            len = 1;
+        } else {
+            cols += utf8_width(utf8_decode(s, n, &len));
+        }
+        s += len;
+        n -= len;
+    }
+    return cols;
+}
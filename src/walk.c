@@ -0,0 +1,343 @@
+#define _GNU_SOURCE
+#include "my_shell.h"
+#include "walk.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/* Parallel tree walk. Each thread owns a deque of directories still to be
+   read: it pushes the subdirectories it finds and pops from the same end,
+   so it goes depth first and its queue stays short, while idle threads
+   steal from the other end, which holds the oldest and usually largest
+   subtrees. A directory is finished when its own scan and all of its
+   subdirectories are; the last of those to finish calls leave() and
+   passes its total up to the parent.
+
+   Directory fds are kept open while a directory is live, so children are
+   opened with openat() relative to their parent, up to a budget set from
+   RLIMIT_NOFILE. Past that budget a directory is closed after its scan and
+   its children are opened by path. */
+
+#define WALK_MAX_THREADS 32
+
+struct linux_dirent64 {
+    ino64_t        d_ino;
+    off64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+typedef struct walk_deque {
+    pthread_mutex_t lock;
+    walk_dir** items;
+    size_t head, tail, cap;     /* steal at head, push and pop at tail */
+    char pad[64];               /* keep neighbouring deques off one line */
+} walk_deque;
+
+typedef struct walk_state {
+    const walk_ops* ops;
+    int threads;
+    walk_deque* deques;
+    atomic_long queued;         /* directories sitting in some deque */
+    atomic_int kept_fds;
+    int fd_budget;
+    atomic_int done;
+    atomic_int interrupted;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    atomic_int idle;
+} walk_state;
+
+typedef struct walk_worker {
+    walk_state* s;
+    int id;
+} walk_worker;
+
+static void push(walk_state* s, int id, walk_dir* dir)
+{
+    walk_deque* q = &s->deques[id];
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->cap) {
+        /* slide down what thieves have left, or grow */
+        size_t live = q->tail - q->head;
+        if (q->head > q->cap / 2) {
+            memmove(q->items, q->items + q->head, live * sizeof(walk_dir*));
+        } else {
+            size_t cap = q->cap ? q->cap * 2 : 64;
+            walk_dir** grown = realloc(q->items, cap * sizeof(walk_dir*));
+            if (!grown) abort();
+            q->items = grown;
+            q->cap = cap;
+            memmove(q->items, q->items + q->head, live * sizeof(walk_dir*));
+        }
+        q->head = 0;
+        q->tail = live;
+    }
+    q->items[q->tail++] = dir;
+    pthread_mutex_unlock(&q->lock);
+
+    atomic_fetch_add(&s->queued, 1);
+    if (atomic_load(&s->idle) > 0) {
+        pthread_mutex_lock(&s->idle_lock);
+        pthread_cond_signal(&s->idle_cond);
+        pthread_mutex_unlock(&s->idle_lock);
+    }
+}
+
+static walk_dir* take(walk_state* s, int id, int steal)
+{
+    walk_deque* q = &s->deques[id];
+    walk_dir* dir = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) dir = steal ? q->items[q->head++] : q->items[--q->tail];
+    pthread_mutex_unlock(&q->lock);
+    if (dir) atomic_fetch_sub(&s->queued, 1);
+    return dir;
+}
+
+static walk_dir* next_dir(walk_state* s, int id)
+{
+    while (1) {
+        walk_dir* dir = take(s, id, 0);
+        for (int i = 1; !dir && i < s->threads; i++) dir = take(s, (id + i) % s->threads, 1);
+        if (dir) return dir;
+
+        pthread_mutex_lock(&s->idle_lock);
+        atomic_fetch_add(&s->idle, 1);
+        while (atomic_load(&s->queued) == 0 && !atomic_load(&s->done)) {
+            pthread_cond_wait(&s->idle_cond, &s->idle_lock);
+        }
+        atomic_fetch_sub(&s->idle, 1);
+        pthread_mutex_unlock(&s->idle_lock);
+        if (atomic_load(&s->done)) return NULL;
+    }
+}
+
+static walk_dir* new_dir(walk_dir* parent, const char* name, size_t name_len)
+{
+    size_t plen = parent ? my_strlen(parent->path) : 0;
+    int slash = parent && plen > 0 && parent->path[plen - 1] != '/';
+    walk_dir* dir = malloc(sizeof(walk_dir) + plen + slash + name_len + 1);
+    if (!dir) return NULL;
+    dir->parent = parent;
+    dir->fd = -1;
+    dir->depth = parent ? parent->depth + 1 : 0;
+    atomic_init(&dir->pending, 1);
+    atomic_init(&dir->total, 0);
+    if (parent) memcpy(dir->path, parent->path, plen);
+    if (slash) dir->path[plen] = '/';
+    memcpy(dir->path + plen + slash, name, name_len);
+    dir->path[plen + slash + name_len] = '\0';
+    dir->name = dir->path + plen + slash;
+    return dir;
+}
+
+int walk_dir_at(const walk_dir* dir, const char** name)
+{
+    if (dir->parent && dir->parent->fd >= 0) {
+        *name = dir->name;
+        return dir->parent->fd;
+    }
+    *name = dir->path;
+    return AT_FDCWD;
+}
+
+/* One unit of dir is done (its scan or a subdirectory). The last one
+   finishes dir and, through it, possibly its parents. */
+static void finish(walk_state* s, walk_dir* dir)
+{
+    while (dir && atomic_fetch_sub(&dir->pending, 1) == 1) {
+        walk_dir* parent = dir->parent;
+        if (s->ops->leave && !atomic_load(&s->interrupted)) s->ops->leave(s->ops->data, dir);
+        if (dir->fd >= 0) {
+            close(dir->fd);
+            atomic_fetch_sub(&s->kept_fds, 1);
+        }
+        if (parent) {
+            atomic_fetch_add(&parent->total, atomic_load(&dir->total));
+            free(dir);
+        } else {
+            /* the root is freed by walk_tree; everything is done */
+            pthread_mutex_lock(&s->idle_lock);
+            atomic_store(&s->done, 1);
+            pthread_cond_broadcast(&s->idle_cond);
+            pthread_mutex_unlock(&s->idle_lock);
+        }
+        dir = parent;
+    }
+}
+
+static void fill_type(struct statx* st, unsigned char type)
+{
+    static const mode_t modes[] = {
+        [DT_FIFO] = S_IFIFO, [DT_CHR] = S_IFCHR, [DT_DIR] = S_IFDIR, [DT_BLK] = S_IFBLK,
+        [DT_REG] = S_IFREG, [DT_LNK] = S_IFLNK, [DT_SOCK] = S_IFSOCK,
+    };
+    memset(st, 0, sizeof(*st));
+    st->stx_mask = STATX_TYPE;
+    st->stx_mode = type < sizeof(modes) / sizeof(modes[0]) ? modes[type] : 0;
+}
+
+static void scan(walk_state* s, int id, walk_dir* dir)
+{
+    /* Ctrl-C arrives as a blocked, pending SIGINT (see event.c) */
+    sigset_t pending;
+    if (sigpending(&pending) == 0 && sigismember(&pending, SIGINT)) atomic_store(&s->interrupted, 1);
+    if (atomic_load(&s->interrupted)) return;
+
+    const char* name;
+    int at = walk_dir_at(dir, &name);
+    int fd = openat(at, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+        s->ops->error(s->ops->data, dir->path, errno);
+        return;
+    }
+    /* Keep the fd, if the budget allows, before any child is pushed: the
+       push publishes dir->fd to whichever thread scans the child, and it
+       is not written again until finish() closes it. */
+    if (atomic_fetch_add(&s->kept_fds, 1) < s->fd_budget) {
+        dir->fd = fd;
+    } else {
+        atomic_fetch_sub(&s->kept_fds, 1);
+    }
+
+    char buf[32768];
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+        for (long off = 0; off < n; ) {
+            struct linux_dirent64* d = (struct linux_dirent64*)(buf + off);
+            off += d->d_reclen;
+            const char* entry = d->d_name;
+            if (entry[0] == '.' && (!entry[1] || (entry[1] == '.' && !entry[2]))) continue;
+
+            struct statx st;
+            unsigned char type = d->d_type;
+            if (s->ops->mask || type == DT_UNKNOWN) {
+                if (statx(fd, entry, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                          s->ops->mask | STATX_TYPE, &st) == -1) {
+                    size_t plen = my_strlen(dir->path);
+                    char path[PATH_MAX];
+                    snprintf(path, sizeof(path), "%s%s%s", dir->path,
+                             plen && dir->path[plen - 1] == '/' ? "" : "/", entry);
+                    s->ops->error(s->ops->data, path, errno);
+                    continue;
+                }
+                type = IFTODT(st.stx_mode);
+            } else {
+                fill_type(&st, type);
+            }
+
+            walk_dir* child = NULL;
+            if (type == DT_DIR) {
+                child = new_dir(dir, entry, my_strlen(entry));
+                if (!child) s->ops->error(s->ops->data, dir->path, ENOMEM);
+            }
+            s->ops->entry(s->ops->data, dir, fd, entry, &st, child);
+            if (child) {
+                atomic_fetch_add(&dir->pending, 1);
+                push(s, id, child);
+            }
+        }
+    }
+    if (n == -1) s->ops->error(s->ops->data, dir->path, errno);
+    if (dir->fd != fd) close(fd);
+}
+
+static void* worker_main(void* arg)
+{
+    walk_worker* w = arg;
+    walk_dir* dir;
+    while ((dir = next_dir(w->s, w->id)) != NULL) {
+        scan(w->s, w->id, dir);
+        finish(w->s, dir);
+    }
+    return NULL;
+}
+
+static int default_threads(void)
+{
+    /* the work is mostly waiting on the filesystem, so run more threads
+       than CPUs */
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long n = cpus > 0 ? cpus * 2 : 4;
+    if (n < 4) n = 4;
+    return n > WALK_MAX_THREADS ? WALK_MAX_THREADS : (int)n;
+}
+
+int walk_tree(const char* root, const walk_ops* ops, int threads)
+{
+    walk_state s;
+    memset(&s, 0, sizeof(s));
+    s.ops = ops;
+    s.threads = threads > 0 ? (threads > WALK_MAX_THREADS ? WALK_MAX_THREADS : threads) : default_threads();
+    struct rlimit rl;
+    s.fd_budget = getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+                  ? (int)(rl.rlim_cur / 2) : 512;
+    if (s.fd_budget > 4096) s.fd_budget = 4096;
+    pthread_mutex_init(&s.idle_lock, NULL);
+    pthread_cond_init(&s.idle_cond, NULL);
+
+    walk_dir* top = new_dir(NULL, root, my_strlen(root));
+    walk_deque* deques = calloc(s.threads, sizeof(walk_deque));
+    walk_worker* workers = calloc(s.threads, sizeof(walk_worker));
+    pthread_t* tids = calloc(s.threads, sizeof(pthread_t));
+    if (!top || !deques || !workers || !tids) {
+        ops->error(ops->data, root, ENOMEM);
+        free(top);
+        free(deques);
+        free(workers);
+        free(tids);
+        return 0;
+    }
+    s.deques = deques;
+    for (int i = 0; i < s.threads; i++) pthread_mutex_init(&deques[i].lock, NULL);
+
+    struct statx st;
+    if (statx(AT_FDCWD, root, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, ops->mask | STATX_TYPE, &st) == -1) {
+        ops->error(ops->data, root, errno);
+    } else {
+        int is_dir = S_ISDIR(st.stx_mode);
+        ops->entry(ops->data, NULL, AT_FDCWD, root, &st, is_dir ? top : NULL);
+        if (is_dir) push(&s, 0, top);
+
+        int started = 0;
+        for (; is_dir && started < s.threads; started++) {
+            workers[started].s = &s;
+            workers[started].id = started;
+            if (pthread_create(&tids[started], NULL, worker_main, &workers[started]) != 0) break;
+        }
+        if (is_dir && started == 0) {
+            /* no threads to be had: walk on this one */
+            workers[0].s = &s;
+            worker_main(&workers[0]);
+        }
+        for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+    }
+
+    int interrupted = atomic_load(&s.interrupted);
+    if (interrupted) {
+        /* take the Ctrl-C so the prompt does not see it again */
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGINT);
+        struct timespec zero = {0, 0};
+        sigtimedwait(&set, NULL, &zero);
+    }
+
+    for (int i = 0; i < s.threads; i++) {
+        pthread_mutex_destroy(&deques[i].lock);
+        free(deques[i].items);
+    }
+    pthread_mutex_destroy(&s.idle_lock);
+    pthread_cond_destroy(&s.idle_cond);
+    free(top);
+    free(deques);
+    free(workers);
+    free(tids);
+    return interrupted ? -1 : 0;
+}
@@ -0,0 +1,43 @@
+/* Parallel directory tree walker (walk.c), shared by du and rm -r.
+   Callbacks run on the walker's threads, several at once: they must only
+   touch shared state atomically or under their own lock, and must not
+   use mem_alloc, whose counters belong to the input thread. Include it
+   after defining _GNU_SOURCE, for struct statx. */
+#ifndef WALK_H
+#define WALK_H
+
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+typedef struct walk_dir {
+    struct walk_dir* parent;    /* NULL for the root */
+    int fd;                     /* open until leave() returns, or -1 */
+    int depth;                  /* 0 for the root */
+    atomic_long pending;        /* own scan plus unfinished subdirectories */
+    atomic_ullong total;        /* added to the parent's once this one is done */
+    const char* name;           /* last component of path */
+    char path[];
+} walk_dir;
+
+typedef struct walk_ops {
+    unsigned mask;              /* statx fields entry() needs; 0 for the type only */
+    /* Every entry of every directory, and the root itself with in == NULL.
+       For a directory that will be walked, child is its node. */
+    void (*entry)(void* data, walk_dir* in, int dirfd, const char* name,
+                  const struct statx* st, walk_dir* child);
+    /* A directory and everything below it are done; may be NULL. */
+    void (*leave)(void* data, walk_dir* dir);
+    void (*error)(void* data, const char* path, int err);
+    void* data;
+} walk_ops;
+
+/* Walk the tree at root without following symlinks. threads == 0 picks a
+   count from the number of CPUs. Returns 0, or -1 if Ctrl-C stopped the
+   walk (leave() is then not called for unfinished directories). */
+int walk_tree(const char* root, const walk_ops* ops, int threads);
+
+/* The directory fd and name that refer to dir from its parent, for
+   unlinkat() and friends in leave(). */
+int walk_dir_at(const walk_dir* dir, const char** name);
+
+#endif
@@ -0,0 +1,130 @@
+#include "my_shell.h"
+#include <limits.h>
+#include <string.h>
+#include <sys/inotify.h>
+
+/* Directory watches on one non-blocking inotify descriptor. Caches register
+   a callback per directory and are told the name of each entry that was
+   created, removed, renamed or had its mode changed, so they can drop just
+   that entry. When the directory itself goes away, or the kernel queue
+   overflows, callbacks get a NULL name and must forget everything about it.
+   Between events, checking for news is a single read() that fails with
+   EAGAIN: no stat calls and no polling of the directories. */
+
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                      IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct watch_entry {
+    int wd;                     /* inotify watch descriptor, -1 if unused */
+    watch_fn fn;
+    void* data;
+} watch_entry;
+
+static int inotify_fd = -1;
+static watch_entry* watches = NULL;
+static size_t watch_count = 0;
+
+/* callbacks run when the shell changes directory */
+static watch_entry cwd_listeners[8];
+static size_t cwd_listener_count = 0;
+
+/* The inotify descriptor, created on first use; -1 if unavailable. */
+int watch_fd(void)
+{
+    if (inotify_fd == -1) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    return inotify_fd;
+}
+
+/* Watch directory path; fn(data, name, mask) runs for each change.
+   Returns a watch id for watch_remove, or -1. */
+int watch_add(const char* path, watch_fn fn, void* data)
+{
+    if (watch_fd() == -1) return -1;
+
+    int wd = inotify_add_watch(inotify_fd, path, WATCH_EVENTS | IN_ONLYDIR);
+    if (wd == -1) return -1;
+
+    size_t id = 0;
+    while (id < watch_count && watches[id].wd != -1) id++;
+    if (id == watch_count) {
+        watch_entry* grown = realloc(watches, (watch_count + 1) * sizeof(watch_entry));
+        if (!grown) {
+            perror("realloc");
+            return -1;
+        }
+        watches = grown;
+        watch_count++;
+    }
+    watches[id].wd = wd;
+    watches[id].fn = fn;
+    watches[id].data = data;
+    return (int)id;
+}
+
+void watch_remove(int id)
+{
+    if (id < 0 || (size_t)id >= watch_count || watches[id].wd == -1) return;
+
+    int wd = watches[id].wd;
+    watches[id].wd = -1;
+    /* the same directory may be watched on behalf of several caches */
+    for (size_t i = 0; i < watch_count; i++) {
+        if (watches[i].wd == wd) return;
+    }
+    inotify_rm_watch(inotify_fd, wd);
+}
+
+static void notify_all(void)
+{
+    for (size_t i = 0; i < watch_count; i++) {
+        if (watches[i].wd != -1) watches[i].fn(watches[i].data, NULL, IN_Q_OVERFLOW);
+    }
+}
+
+/* Read all pending events and run their callbacks. Never blocks. */
+void watch_dispatch(void)
+{
+    if (inotify_fd == -1) return;
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1) {
+        ssize_t n = read(inotify_fd, buf, sizeof(buf));
+        if (n <= 0) return;
+
+        for (char* p = buf; p < buf + n; ) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                notify_all();
+                continue;
+            }
+            int gone = (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0;
+            const char* name = ev->len && !gone ? ev->name : NULL;
+            for (size_t i = 0; i < watch_count; i++) {
+                if (watches[i].wd == ev->wd) watches[i].fn(watches[i].data, name, ev->mask);
+            }
+        }
+    }
+}
+
+/* Register fn to run (with a NULL name) whenever the shell changes directory. */
+int watch_cwd_listen(watch_fn fn, void* data)
+{
+    if (cwd_listener_count == sizeof(cwd_listeners) / sizeof(cwd_listeners[0])) return -1;
+    cwd_listeners[cwd_listener_count].wd = -1;
+    cwd_listeners[cwd_listener_count].fn = fn;
+    cwd_listeners[cwd_listener_count].data = data;
+    cwd_listener_count++;
+    return 0;
+}
+
+/* Called by cd after a successful chdir. */
+void watch_chdir(void)
+{
+    for (size_t i = 0; i < cwd_listener_count; i++) {
+        cwd_listeners[i].fn(cwd_listeners[i].data, NULL, 0);
+    }
+}
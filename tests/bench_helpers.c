@@ -0,0 +1,104 @@
+/* Microbenchmark for the string kernels in src/helpers.c.
+
+   Times strlen, strchrnul and strncmp at each dispatch level, and libc
+   for reference, on strings of the lengths the shell sees: short words,
+   PATH-sized values and long lines. Built with -O2, as a release build
+   would be. Prints nanoseconds per call.
+
+   Build and run with: make bench */
+
+#define _GNU_SOURCE
+#include "../src/helpers.c"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define TARGET_NS 20000000.0    /* aim each measurement at about 20 ms */
+
+char* env_lookup(const char* name, size_t len, char** env)
+{
+    (void)name;
+    (void)len;
+    (void)env;
+    return NULL;
+}
+
+typedef struct level {
+    const char* name;
+    size_t (*strlen)(const char*);
+    const char* (*strchrnul)(const char*, char);
+    int (*strncmp)(const char*, const char*, size_t);
+} level;
+
+static size_t libc_strlen(const char* s) { return strlen(s); }
+static const char* libc_strchrnul(const char* s, char c) { return strchrnul(s, c); }
+static int libc_strncmp(const char* a, const char* b, size_t n) { return strncmp(a, b, n); }
+
+static volatile size_t sink;
+
+static double now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+enum { OP_STRLEN, OP_STRCHRNUL, OP_STRNCMP };
+
+/* ns per call of op at level l over a and b, whose lengths are len */
+static double measure(const level* l, int op, const char* a, const char* b)
+{
+    long iterations = 1000;
+    while (1) {
+        double start = now_ns();
+        for (long i = 0; i < iterations; i++) {
+            switch (op) {
+            case OP_STRLEN: sink += l->strlen(a); break;
+            case OP_STRCHRNUL: sink += (size_t)l->strchrnul(a, ':'); break;
+            default: sink += (size_t)l->strncmp(a, b, SIZE_MAX); break;
+            }
+        }
+        double spent = now_ns() - start;
+        if (spent >= TARGET_NS || iterations > (1L << 30)) return spent / iterations;
+        iterations *= spent > 0 && TARGET_NS / spent < 100 ? (long)(TARGET_NS / spent) + 1 : 100;
+    }
+}
+
+int main(void)
+{
+    level levels[4];
+    int count = 0;
+    levels[count++] = (level){ "libc", libc_strlen, libc_strchrnul, libc_strncmp };
+    levels[count++] = (level){ "scalar", strlen_scalar, strchrnul_scalar, strncmp_scalar };
+#if defined(__x86_64__) && defined(__GNUC__)
+    levels[count++] = (level){ "sse2", strlen_sse2, strchrnul_sse2, strncmp_sse2 };
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        levels[count++] = (level){ "avx2", strlen_avx2, strchrnul_avx2, strncmp_avx2 };
+    }
+#endif
+
+    static const size_t lengths[] = { 8, 32, 128, 1024, 16384 };
+    static const char* ops[] = { "strlen", "strchrnul", "strcmp" };
+    printf("%-10s %7s", "op", "len");
+    for (int l = 0; l < count; l++) printf(" %9s", levels[l].name);
+    printf("   (ns per call)\n");
+
+    for (int op = 0; op < 3; op++) {
+        for (size_t i = 0; i < sizeof(lengths) / sizeof(*lengths); i++) {
+            size_t len = lengths[i];
+            /* misaligned by one, as strings inside token arrays usually are;
+               no ':' so strchrnul scans to the end, and b equals a */
+            char* a = malloc(len + 2);
+            char* b = malloc(len + 3);
+            for (size_t k = 0; k < len; k++) a[k + 1] = b[k + 2] = 'a' + k % 26;
+            a[len + 1] = b[len + 2] = '\0';
+            printf("%-10s %7zu", ops[op], len);
+            for (int l = 0; l < count; l++) printf(" %9.1f", measure(&levels[l], op, a + 1, b + 2));
+            printf("\n");
+            free(a);
+            free(b);
+        }
+    }
+    return 0;
+}
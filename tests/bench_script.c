@@ -0,0 +1,161 @@
+/* Benchmark for compiled scripts (src/script.c).
+
+   Generates a script of builtins only (echo with literal and expanded
+   words, setenv, cd, pwd, && and || lists, comments and a quote that
+   spans lines), so what is timed is the shell and not fork and exec.
+   Then runs it in-process, with stdout thrown away:
+     cold      no image in the cache: read, compile, save the image, run
+     warm      the image from the first run, mapped and run
+     uncached  no cache directory at all: read, compile, run
+   Prints milliseconds per run, the best and the mean.
+
+   Build and run with: make bench
+   or: tests/bin/bench_script [lines] [runs]   (default 10000 lines, 20 runs) */
+
+#define _GNU_SOURCE
+#include "../src/my_shell.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* The shell's dispatcher lives in main.c, which benchmarks do not link. */
+int shell_builts(char** args, char*** env)
+{
+    if (!args || !args[0]) return 0;
+    const builtin* b = builtin_lookup(args[0]);
+    return b ? b->handler(args, env) : executor(args, *env);
+}
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void write_script(const char* path, long lines)
+{
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        exit(2);
+    }
+    fprintf(f, "#!/usr/bin/env edosh\n");
+    for (long i = 1; i < lines; i++) {
+        switch (i % 8) {
+        case 0: fprintf(f, "# step %ld: nothing here is run\n", i); break;
+        case 1: fprintf(f, "echo building part %ld of the project with plain words\n", i); break;
+        case 2: fprintf(f, "setenv BENCH_STEP %ld\n", i); break;
+        case 3: fprintf(f, "echo step $BENCH_STEP in \"$HOME\" and ~\n"); break;
+        case 4: fprintf(f, "cd / && echo in root || echo not in root\n"); break;
+        case 5: fprintf(f, "pwd; echo 'single quoted $not expanded' %ld\n", i); break;
+        case 6:
+            fprintf(f, "echo \"a quote that\nspans two lines\"\n");
+            i++;
+            break;
+        default: fprintf(f, "echo done with %ld; echo next\n", i); break;
+        }
+    }
+    fclose(f);
+}
+
+/* Run the script once with its output thrown away; seconds taken. */
+static double run_once(const char* script, char** env)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+
+    char** run_env = env;
+    double start = now();
+    int status = script_run(script, &run_env);
+    double spent = now() - start;
+    env_release(run_env);
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    if (status != 0) {
+        fprintf(stderr, "bench_script: the script exited %d\n", status);
+        exit(1);
+    }
+    return spent;
+}
+
+static void clear_cache(const char* dir)
+{
+    char* args[] = { "rm", "-rf", (char*)dir, NULL };
+    char* env[] = { NULL };
+    command_rm(args, env);
+}
+
+static void report(const char* what, double best, double total, int runs)
+{
+    printf("%-10s %10.3f %10.3f\n", what, best * 1e3, total / runs * 1e3);
+}
+
+int main(int argc, char** argv)
+{
+    long lines = argc > 1 ? atol(argv[1]) : 10000;
+    int runs = argc > 2 ? atoi(argv[2]) : 20;
+    if (lines <= 0 || runs <= 0) {
+        fprintf(stderr, "usage: bench_script [lines] [runs]\n");
+        return 2;
+    }
+    char scratch[] = "/tmp/edosh-bench-script.XXXXXX";
+    if (!mkdtemp(scratch)) {
+        perror("mkdtemp");
+        return 2;
+    }
+    char script[PATH_MAX], cache[PATH_MAX], cache_var[PATH_MAX + 16];
+    snprintf(script, sizeof(script), "%s/bench.esh", scratch);
+    snprintf(cache, sizeof(cache), "%s/cache", scratch);
+    snprintf(cache_var, sizeof(cache_var), "XDG_CACHE_HOME=%s", cache);
+    write_script(script, lines);
+
+    char* cached_env[] = { "PATH=/usr/bin:/bin", "HOME=/nonexistent", cache_var, NULL };
+    char* uncached_env[] = { "PATH=/usr/bin:/bin", NULL };
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) snprintf(cwd, sizeof(cwd), "/");
+
+    printf("bench_script: %ld lines, %d runs each\n", lines, runs);
+    printf("%-10s %10s %10s   (ms per run)\n", "", "best", "mean");
+
+    double best = 1e9, total = 0;
+    for (int i = 0; i < runs; i++) {
+        clear_cache(cache);
+        double t = run_once(script, cached_env);
+        total += t;
+        if (t < best) best = t;
+    }
+    report("cold", best, total, runs);
+
+    best = 1e9;
+    total = 0;
+    for (int i = 0; i < runs; i++) {
+        double t = run_once(script, cached_env);
+        total += t;
+        if (t < best) best = t;
+    }
+    report("warm", best, total, runs);
+
+    best = 1e9;
+    total = 0;
+    for (int i = 0; i < runs; i++) {
+        double t = run_once(script, uncached_env);
+        total += t;
+        if (t < best) best = t;
+    }
+    report("uncached", best, total, runs);
+
+    /* the script cds to / */
+    if (chdir(cwd) == -1) perror(cwd);
+    char* rm_scratch[] = { "rm", "-rf", scratch, NULL };
+    char* env[] = { NULL };
+    command_rm(rm_scratch, env);
+    return 0;
+}
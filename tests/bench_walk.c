@@ -0,0 +1,192 @@
+/* Benchmark for the parallel tree walker (src/walk.c) and the du and rm -r
+   built on it.
+
+   Builds a tree of empty files, a thousand to a directory, and times on
+   it, with a warm cache: the system du -s, the native du -s, a bare walk
+   that reads every entry's blocks on one thread and on the default
+   count, and then the system rm -r against the native one, each on its
+   own copy of the tree. Prints seconds per run.
+
+   Build and run with: make bench
+   or: tests/bin/bench_walk [files] [directory]   (default 1000000, $TMPDIR) */
+
+#define _GNU_SOURCE
+#include "../src/my_shell.h"
+#include "../src/walk.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#define PER_DIR 1000            /* files in each leaf directory */
+#define FAN_OUT 100             /* leaf directories under each top one */
+
+/* The shell's dispatcher lives in main.c, which benchmarks do not link. */
+int shell_builts(char** args, char*** env)
+{
+    return executor(args, *env);
+}
+
+static char* env[] = { "PATH=/usr/local/bin:/usr/bin:/bin", NULL };
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void make_dir(const char* path)
+{
+    if (mkdir(path, 0755) == -1) {
+        perror(path);
+        exit(2);
+    }
+}
+
+static void build_tree(const char* root, long files)
+{
+    char path[PATH_MAX];
+    make_dir(root);
+    long leaves = (files + PER_DIR - 1) / PER_DIR;
+    for (long leaf = 0; leaf < leaves; leaf++) {
+        if (leaf % FAN_OUT == 0) {
+            snprintf(path, sizeof(path), "%s/d%03ld", root, leaf / FAN_OUT);
+            make_dir(path);
+        }
+        snprintf(path, sizeof(path), "%s/d%03ld/%03ld", root, leaf / FAN_OUT, leaf % FAN_OUT);
+        make_dir(path);
+        int dir = open(path, O_RDONLY | O_DIRECTORY);
+        for (long f = 0; f < PER_DIR && leaf * PER_DIR + f < files; f++) {
+            char name[16];
+            snprintf(name, sizeof(name), "f%04ld", f);
+            int fd = openat(dir, name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (fd == -1) {
+                perror(name);
+                exit(2);
+            }
+            close(fd);
+        }
+        close(dir);
+    }
+}
+
+/* Run a native command with its output thrown away. */
+static int quietly(int (*command)(char**, char**), char** args)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+    int status = command(args, env);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return status;
+}
+
+static int system_command(char** args)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        execvp(args[0], args);
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+static atomic_ullong walked_entries;
+static atomic_ullong walked_blocks;
+
+static void count_entry(void* data, walk_dir* in, int dirfd, const char* name,
+                        const struct statx* st, walk_dir* child)
+{
+    (void)data;
+    (void)in;
+    (void)dirfd;
+    (void)name;
+    (void)child;
+    atomic_fetch_add(&walked_entries, 1);
+    atomic_fetch_add(&walked_blocks, st->stx_blocks);
+}
+
+static void count_error(void* data, const char* path, int err)
+{
+    (void)data;
+    fprintf(stderr, "bench_walk: %s: %s\n", path, strerror(err));
+}
+
+static double time_walk(const char* root, int threads)
+{
+    walk_ops ops = { .mask = STATX_BLOCKS, .entry = count_entry, .error = count_error };
+    atomic_store(&walked_entries, 0);
+    double start = now();
+    walk_tree(root, &ops, threads);
+    return now() - start;
+}
+
+static void report(const char* what, double seconds, int status)
+{
+    printf("%-28s %8.3f s%s\n", what, seconds, status ? "  (failed)" : "");
+}
+
+int main(int argc, char** argv)
+{
+    long files = argc > 1 ? atol(argv[1]) : 1000000;
+    const char* base = argc > 2 ? argv[2] : getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    if (files <= 0) {
+        fprintf(stderr, "usage: bench_walk [files] [directory]\n");
+        return 2;
+    }
+    char scratch[PATH_MAX], tree[PATH_MAX + 8];
+    snprintf(scratch, sizeof(scratch), "%s/edosh-bench-walk.XXXXXX", base);
+    if (!mkdtemp(scratch)) {
+        perror(scratch);
+        return 2;
+    }
+    snprintf(tree, sizeof(tree), "%s/tree", scratch);
+
+    printf("bench_walk: %ld files in %s\n", files, scratch);
+    double start = now();
+    build_tree(tree, files);
+    printf("%-28s %8.3f s\n", "(building the tree)", now() - start);
+
+    /* once untimed, so every run below sees a warm cache */
+    char* du_args[] = { "du", "-s", tree, NULL };
+    system_command(du_args);
+
+    start = now();
+    int status = system_command(du_args);
+    report("system du -s", now() - start, status);
+    start = now();
+    status = quietly(command_du, du_args);
+    report("native du -s", now() - start, status);
+
+    report("walk, 1 thread", time_walk(tree, 1), 0);
+    report("walk, default threads", time_walk(tree, 0), 0);
+    printf("%-28s %8llu\n", "(entries walked)", (unsigned long long)atomic_load(&walked_entries));
+
+    char* rm_args[] = { "rm", "-r", tree, NULL };
+    start = now();
+    status = system_command(rm_args);
+    report("system rm -r", now() - start, status);
+
+    start = now();
+    build_tree(tree, files);
+    printf("%-28s %8.3f s\n", "(building it again)", now() - start);
+    start = now();
+    status = quietly(command_rm, rm_args);
+    report("native rm -r", now() - start, status);
+
+    rmdir(scratch);
+    return 0;
+}
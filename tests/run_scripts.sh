@@ -0,0 +1,30 @@
+#!/bin/sh
+# Script tests. Runs each tests/scripts/NAME.esh with the shell given as
+# $1 and compares what it prints (stdout and stderr, both into a pipe)
+# and its exit status with NAME.out, whose last line is "exit N". Each
+# script runs twice: once compiled from source and once from the image
+# the first run cached.
+#
+# Run with: make test
+
+shell=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+dir=$(cd "$(dirname "$0")/scripts" && pwd)
+cache=$(mktemp -d /tmp/edosh-test-scripts.XXXXXX) || exit 2
+trap 'rm -rf "$cache"' EXIT
+
+count=0
+failed=0
+for script in "$dir"/*.esh; do
+    name=$(basename "$script" .esh)
+    for run in compiled cached; do
+        got=$(cd "$dir" && XDG_CACHE_HOME=$cache "$shell" "$name.esh" 2>&1; echo "exit $?")
+        count=$((count + 1))
+        if [ "$got" != "$(cat "$dir/$name.out")" ]; then
+            echo "run_scripts: $name ($run):"
+            printf '%s\n' "$got" | diff "$dir/$name.out" -
+            failed=$((failed + 1))
+        fi
+    done
+done
+echo "run_scripts: $count runs, $failed failed"
+[ "$failed" -eq 0 ]
@@ -0,0 +1,388 @@
+/* Property tests for the string kernels in src/helpers.c, and table
+   tests for UTF-8 decoding and widths (src/utf8.c) and for the line
+   editor's continuation rules (src/editor.c).
+
+   helpers.c is included whole so its static kernels can be called
+   directly. Every dispatch level (scalar, and on x86-64 SSE2 and, when
+   the CPU has it, AVX2) is run on random strings at every start offset
+   in a 64-byte window and compared with libc. Each string ends either
+   in the middle of a page or on the last byte of a page followed by an
+   inaccessible one, so a kernel that reads past the NUL into the next
+   page dies with SIGSEGV instead of passing. The ifunc resolvers are
+   checked to pick the level the CPU supports.
+
+   The rest of the shell but main.c is linked in for the tables.
+
+   Build and run with: make test */
+
+#define _GNU_SOURCE
+#include "../src/helpers.c"
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define WINDOW 64               /* start offsets tried for each length */
+#define MAX_LEN 300
+
+/* The shell's dispatcher lives in main.c, which tests do not link. */
+int shell_builts(char** args, char*** env)
+{
+    return executor(args, *env);
+}
+
+typedef struct level {
+    const char* name;
+    size_t (*strlen)(const char*);
+    const char* (*strchrnul)(const char*, char);
+    int (*strncmp)(const char*, const char*, size_t);
+} level;
+
+static level levels[3];
+static int level_count = 0;
+static long failures = 0;
+static long checks = 0;
+static size_t page;
+
+#define CHECK(cond, ...)                                                \
+    do {                                                                \
+        checks++;                                                       \
+        if (!(cond)) {                                                  \
+            if (failures++ < 20) fprintf(stderr, __VA_ARGS__);          \
+        }                                                               \
+    } while (0)
+
+static unsigned long long rng = 0x9e3779b97f4a7c15ull;
+
+static unsigned next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (unsigned)rng;
+}
+
+/* A non-NUL byte, with high bytes as likely as ASCII ones. */
+static char random_byte(void)
+{
+    return (char)(next_random() % 255 + 1);
+}
+
+static int sign(int v)
+{
+    return (v > 0) - (v < 0);
+}
+
+/* Two writable pages followed by an inaccessible one. */
+static char* guarded_pages(void)
+{
+    char* p = mmap(NULL, 3 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED || mprotect(p + 2 * page, page, PROT_NONE) == -1) {
+        perror("mmap");
+        exit(2);
+    }
+    return p;
+}
+
+/* Where a string of len bytes starts: at offset off of a page start
+   (mid-page end) or so that its NUL is off bytes before the guard page. */
+static char* place(char* pages, size_t len, size_t off, int at_page_end)
+{
+    char* guard = pages + 2 * page;
+    return at_page_end ? guard - 1 - len - off : pages + page + off;
+}
+
+static void fill(char* s, size_t len)
+{
+    for (size_t i = 0; i < len; i++) s[i] = random_byte();
+    s[len] = '\0';
+}
+
+static void test_strlen(char* pages)
+{
+    for (size_t len = 0; len <= MAX_LEN; len++) {
+        for (size_t off = 0; off < WINDOW; off++) {
+            for (int end = 0; end < 2; end++) {
+                char* s = place(pages, len, off, end);
+                fill(s, len);
+                for (int l = 0; l < level_count; l++) {
+                    size_t got = levels[l].strlen(s);
+                    CHECK(got == len, "%s strlen: len %zu off %zu end %d: got %zu\n",
+                          levels[l].name, len, off, end, got);
+                }
+            }
+        }
+    }
+}
+
+static void test_strchrnul(char* pages)
+{
+    for (size_t len = 0; len <= MAX_LEN; len++) {
+        for (size_t off = 0; off < WINDOW; off++) {
+            for (int end = 0; end < 2; end++) {
+                char* s = place(pages, len, off, end);
+                fill(s, len);
+                /* a needle that is in the string, one that may not be, and NUL */
+                char needles[3] = { len ? s[next_random() % len] : 'x', random_byte(), '\0' };
+                for (int k = 0; k < 3; k++) {
+                    const char* want = strchrnul(s, needles[k]);
+                    for (int l = 0; l < level_count; l++) {
+                        const char* got = levels[l].strchrnul(s, needles[k]);
+                        CHECK(got == want, "%s strchrnul: len %zu off %zu end %d needle %d: got %td want %td\n",
+                              levels[l].name, len, off, end, (unsigned char)needles[k], got - s, want - s);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void test_strncmp(char* pages_a, char* pages_b)
+{
+    for (size_t len = 0; len <= MAX_LEN; len += (len < 70 ? 1 : 7)) {
+        for (size_t off_a = 0; off_a < WINDOW; off_a += 3) {
+            size_t off_b = next_random() % WINDOW;
+            for (int end = 0; end < 2; end++) {
+                char* a = place(pages_a, len, off_a, end);
+                char* b = place(pages_b, len, off_b, end);
+                fill(a, len);
+                memcpy(b, a, len + 1);
+                /* equal, or differing at one place: a byte, or one string ending early */
+                size_t diff = len ? next_random() % len : 0;
+                int kind = next_random() % 3;
+                if (len && kind == 1) {
+                    while (b[diff] == a[diff]) b[diff] = random_byte();
+                } else if (len && kind == 2) {
+                    b[diff] = '\0';
+                }
+                size_t ns[] = { 0, diff, diff + 1, len, len + 1, (size_t)next_random() % (len + 2), SIZE_MAX };
+                for (size_t k = 0; k < sizeof(ns) / sizeof(*ns); k++) {
+                    int want = sign(strncmp(a, b, ns[k]));
+                    for (int l = 0; l < level_count; l++) {
+                        int got = sign(levels[l].strncmp(a, b, ns[k]));
+                        int back = sign(levels[l].strncmp(b, a, ns[k]));
+                        CHECK(got == want && back == -want,
+                              "%s strncmp: len %zu offs %zu/%zu end %d diff %zu n %zu: got %d/%d want %d\n",
+                              levels[l].name, len, off_a, off_b, end, diff, ns[k], got, back, want);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* The public wrappers go through the ifunc-resolved kernels. */
+static void test_dispatch(void)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+    int avx2 = __builtin_cpu_supports("avx2");
+    CHECK(resolve_strlen() == (avx2 ? strlen_avx2 : strlen_sse2), "resolve_strlen picked the wrong level\n");
+    CHECK(resolve_strchrnul() == (avx2 ? strchrnul_avx2 : strchrnul_sse2), "resolve_strchrnul picked the wrong level\n");
+    CHECK(resolve_strncmp() == (avx2 ? strncmp_avx2 : strncmp_sse2), "resolve_strncmp picked the wrong level\n");
+#endif
+    const char* words[] = { "", "a", "PATH", "/usr/local/bin:/usr/bin:/bin", "edosh-edosh-edosh-edosh-edosh-edosh" };
+    for (size_t i = 0; i < sizeof(words) / sizeof(*words); i++) {
+        CHECK(my_strlen(words[i]) == (int)strlen(words[i]), "my_strlen(\"%s\")\n", words[i]);
+        CHECK(sign(my_strcmp(words[i], "PATH")) == sign(strcmp(words[i], "PATH")), "my_strcmp(\"%s\")\n", words[i]);
+        CHECK(my_strchr(words[i], ':') == strchr(words[i], ':'), "my_strchr(\"%s\", ':')\n", words[i]);
+        CHECK(my_strchr(words[i], '\0') == NULL, "my_strchr(\"%s\", 0) should find nothing\n", words[i]);
+    }
+    CHECK(my_strlen(NULL) == -1, "my_strlen(NULL)\n");
+}
+
+static void test_utf8_decode(void)
+{
+    static const struct {
+        const char* s;
+        size_t n;
+        unsigned cp;
+        size_t len;
+    } cases[] = {
+        { "A", 1, 0x41, 1 },
+        { "\xc3\xa9", 2, 0xe9, 2 },
+        { "\xe2\x82\xac", 3, 0x20ac, 3 },
+        { "\xf0\x9f\x98\x80", 4, 0x1f600, 4 },
+        { "\xc2\x80", 2, 0x80, 2 },                 /* the shortest of each length */
+        { "\xe0\xa0\x80", 3, 0x800, 3 },
+        { "\xf0\x90\x80\x80", 4, 0x10000, 4 },
+        { "\xf4\x8f\xbf\xbf", 4, 0x10ffff, 4 },
+        { "\xed\x9f\xbf", 3, 0xd7ff, 3 },           /* either side of the surrogates */
+        { "\xee\x80\x80", 3, 0xe000, 3 },
+        /* overlong */
+        { "\xc0\xaf", 2, 0xfffd, 1 },
+        { "\xc1\xbf", 2, 0xfffd, 1 },
+        { "\xe0\x80\xaf", 3, 0xfffd, 1 },
+        { "\xe0\x9f\xbf", 3, 0xfffd, 1 },
+        { "\xf0\x80\x80\xaf", 4, 0xfffd, 1 },
+        { "\xf0\x8f\xbf\xbf", 4, 0xfffd, 1 },
+        /* surrogates */
+        { "\xed\xa0\x80", 3, 0xfffd, 1 },
+        { "\xed\xbf\xbf", 3, 0xfffd, 1 },
+        /* past U+10FFFF */
+        { "\xf4\x90\x80\x80", 4, 0xfffd, 1 },
+        { "\xf5\x80\x80\x80", 4, 0xfffd, 1 },
+        { "\xff", 1, 0xfffd, 1 },
+        /* cut short, by the bytes or by n */
+        { "\xc3", 1, 0xfffd, 1 },
+        { "\xe2\x82", 2, 0xfffd, 1 },
+        { "\xf0\x9f\x98", 3, 0xfffd, 1 },
+        { "\xc3\xa9", 1, 0xfffd, 1 },
+        { "\xf0\x9f\x98\x80", 3, 0xfffd, 1 },
+        { "", 0, 0xfffd, 1 },
+        /* a stray or missing continuation byte */
+        { "\x80", 1, 0xfffd, 1 },
+        { "\xe2\x28\xa1", 3, 0xfffd, 1 },
+        { "\xf0\x9f\x98\x41", 4, 0xfffd, 1 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+        size_t len = 0;
+        unsigned cp = utf8_decode(cases[i].s, cases[i].n, &len);
+        CHECK(cp == cases[i].cp && len == cases[i].len,
+              "utf8_decode case %zu: got U+%04X in %zu, want U+%04X in %zu\n",
+              i, cp, len, cases[i].cp, cases[i].len);
+    }
+}
+
+static void test_utf8_width(void)
+{
+    static const struct {
+        unsigned cp;
+        int width;
+    } cases[] = {
+        { 'a', 1 },
+        { 0xe9, 1 },                /* e acute */
+        { 0x301, 0 },               /* combining acute accent */
+        { 0x200d, 0 },              /* zero width joiner */
+        { 0xfe0f, 0 },              /* variation selector 16 */
+        { 0x4e2d, 2 },              /* CJK */
+        { 0xac00, 2 },              /* Hangul */
+        { 0xff21, 2 },              /* fullwidth A */
+        { 0x1f600, 2 },             /* emoji */
+        { 0xfffd, 1 },
+        { 0x110000, 1 },            /* past the table */
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+        int w = utf8_width(cases[i].cp);
+        CHECK(w == cases[i].width, "utf8_width(U+%04X): got %d, want %d\n", cases[i].cp, w, cases[i].width);
+    }
+
+    static const struct {
+        const char* s;
+        size_t width;
+    } strings[] = {
+        { "", 0 },
+        { "edosh", 5 },
+        { "caf\xc3\xa9", 4 },
+        { "cafe\xcc\x81", 4 },                      /* e and a combining accent */
+        { "\xe4\xb8\xad\xe6\x96\x87", 4 },          /* two CJK characters */
+        { "a\xf0\x9f\x98\x80z", 4 },
+        { "\xc0\xaf", 2 },                          /* two bytes, each U+FFFD */
+        { "\xe2\x82", 2 },
+    };
+    for (size_t i = 0; i < sizeof(strings) / sizeof(*strings); i++) {
+        size_t w = utf8_string_width(strings[i].s, strlen(strings[i].s));
+        CHECK(w == strings[i].width, "utf8_string_width case %zu: got %zu, want %zu\n",
+              i, w, strings[i].width);
+    }
+}
+
+static void test_editor_complete(void)
+{
+    static const struct {
+        const char* s;
+        int complete;
+    } cases[] = {
+        { "", 1 },
+        { "echo hi", 1 },
+        { "echo 'hi", 0 },
+        { "echo 'hi'", 1 },
+        { "echo \"hi", 0 },
+        { "echo \"a'b\"", 1 },
+        { "echo 'a\"b'", 1 },
+        { "echo 'a\"b", 0 },
+        /* backslashes */
+        { "echo hi\\", 0 },
+        { "echo hi\\\\", 1 },
+        { "echo \\'", 1 },
+        { "echo \"a\\\"", 0 },
+        { "echo \"a\\\"\"", 1 },
+        { "echo 'a\\'", 1 },                        /* no escapes in single quotes */
+        /* $( */
+        { "echo $(pwd", 0 },
+        { "echo $(pwd)", 1 },
+        { "echo $(echo $(pwd)", 0 },
+        { "echo $(echo $(pwd))", 1 },
+        { "echo \"$(pwd\"", 0 },
+        { "echo \"$(pwd)\"", 1 },
+        { "echo '$('", 1 },
+        { "echo \\$(", 1 },
+        /* continuation lines as the editor holds them */
+        { "echo 'a\nb'", 1 },
+        { "echo a\\\nb", 1 },
+        { "echo $(ls\n", 0 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+        int got = editor_complete(cases[i].s);
+        CHECK(!got == !cases[i].complete, "editor_complete(\"%s\"): got %d, want %d\n",
+              cases[i].s, got, cases[i].complete);
+    }
+}
+
+static void test_editor_join_lines(void)
+{
+    static const struct {
+        const char* in;
+        const char* out;
+    } cases[] = {
+        { "", "" },
+        { "echo hi", "echo hi" },
+        { "echo a\\\nb", "echo ab" },
+        { "echo a\\\n\\\nb", "echo ab" },
+        { "echo a\\\n", "echo a" },
+        { "echo \"a\\\nb\"", "echo \"ab\"" },
+        { "echo 'a\\\nb'", "echo 'a\\\nb'" },       /* kept inside single quotes */
+        { "echo 'a'\\\nb", "echo 'a'b" },
+        { "echo a\\\\\nb", "echo a\\\\\nb" },       /* an escaped backslash, then a newline */
+        { "echo a\\ b", "echo a\\ b" },
+        { "echo a\\", "echo a\\" },
+        { "echo \\'a\\\nb", "echo \\'ab" },          /* an escaped quote opens nothing */
+        { "echo $(ls \\\n-l)", "echo $(ls -l)" },
+        { "echo 'a\nb'", "echo 'a\nb'" },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s", cases[i].in);
+        size_t len = editor_join_lines(buf, strlen(buf));
+        CHECK(len == strlen(cases[i].out) && strcmp(buf, cases[i].out) == 0,
+              "editor_join_lines case %zu: got \"%s\"\n", i, buf);
+    }
+}
+
+int main(void)
+{
+    page = (size_t)sysconf(_SC_PAGESIZE);
+    levels[level_count++] = (level){ "scalar", strlen_scalar, strchrnul_scalar, strncmp_scalar };
+#if defined(__x86_64__) && defined(__GNUC__)
+    levels[level_count++] = (level){ "sse2", strlen_sse2, strchrnul_sse2, strncmp_sse2 };
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        levels[level_count++] = (level){ "avx2", strlen_avx2, strchrnul_avx2, strncmp_avx2 };
+    } else {
+        printf("test_helpers: no AVX2 on this CPU, skipping that level\n");
+    }
+#endif
+
+    char* a = guarded_pages();
+    char* b = guarded_pages();
+    test_strlen(a);
+    test_strchrnul(a);
+    test_strncmp(a, b);
+    test_dispatch();
+    test_utf8_decode();
+    test_utf8_width();
+    test_editor_complete();
+    test_editor_join_lines();
+
+    printf("test_helpers: %ld checks over %d levels, %ld failed\n", checks, level_count, failures);
+    return failures ? 1 : 0;
+}
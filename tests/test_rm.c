@@ -0,0 +1,127 @@
+/* rm -r must refuse the root directory however it is spelled.
+
+   The native rm (src/fileops.c) is called in a child that has chrooted
+   into a scratch directory, so "/" is that directory: if the guard ever
+   failed, only the scratch files would go. Without the privilege to
+   chroot (directly or in a new user namespace) the test is skipped
+   rather than run against the real root.
+
+   Build and run with: make test */
+
+#define _GNU_SOURCE
+#include "../src/my_shell.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define SKIPPED 77
+
+/* The shell's dispatcher lives in main.c, which tests do not link. */
+int shell_builts(char** args, char*** env)
+{
+    return executor(args, *env);
+}
+
+static int failures = 0;
+static FILE* report;            /* rm's own messages go to /dev/null */
+
+static int exists(const char* path)
+{
+    struct stat st;
+    return lstat(path, &st) == 0;
+}
+
+static int rm(const char* flags, const char* path)
+{
+    char* env[] = { NULL };
+    char* args[] = { "rm", (char*)flags, (char*)path, NULL };
+    return command_rm(args, env);
+}
+
+static void expect_refused(const char* flags, const char* path)
+{
+    int status = rm(flags, path);
+    if (status != 1 || !exists("/keep") || !exists("/dir/inner")) {
+        fprintf(report, "test_rm: rm %s '%s' was not refused (status %d)\n", flags, path, status);
+        failures++;
+    }
+}
+
+/* In the chroot: the root refused in every spelling, other removals done. */
+static int run_in_root(void)
+{
+    expect_refused("-r", "/");
+    expect_refused("-r", "//");
+    expect_refused("-rf", "///");
+    expect_refused("-r", "/dir/..");
+    expect_refused("-r", "/rootlink/");
+
+    /* the link itself, without a trailing slash, is an ordinary file */
+    if (rm("-r", "/rootlink") != 0 || exists("/rootlink") || !exists("/keep")) {
+        fprintf(report, "test_rm: rm -r /rootlink did not remove just the link\n");
+        failures++;
+    }
+    if (rm("-r", "/dir") != 0 || exists("/dir") || !exists("/keep")) {
+        fprintf(report, "test_rm: rm -r /dir did not remove just /dir\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
+
+static int enter_root(const char* dir)
+{
+    if (chroot(dir) == 0) return chdir("/");
+    /* unprivileged: a user namespace of our own may chroot */
+    if (unshare(CLONE_NEWUSER) == -1 || chroot(dir) == -1) return -1;
+    return chdir("/");
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/edosh-test-rm.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 2;
+    }
+    char path[sizeof(dir) + 32];
+    snprintf(path, sizeof(path), "%s/keep", dir);
+    int fd = open(path, O_WRONLY | O_CREAT, 0600);
+    if (fd != -1) close(fd);
+    snprintf(path, sizeof(path), "%s/dir", dir);
+    mkdir(path, 0700);
+    snprintf(path, sizeof(path), "%s/dir/inner", dir);
+    mkdir(path, 0700);
+    snprintf(path, sizeof(path), "%s/rootlink", dir);
+    if (symlink("/", path) == -1) perror("symlink");
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        /* there is no /dev/null in the scratch root */
+        report = fdopen(dup(STDERR_FILENO), "w");
+        int null = open("/dev/null", O_WRONLY);
+        if (!report || null == -1) _exit(2);
+        if (enter_root(dir) == -1) _exit(SKIPPED);
+        dup2(null, STDERR_FILENO);
+        int r = run_in_root();
+        fclose(report);
+        _exit(r);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    char* rm_scratch[] = { "rm", "-rf", dir, NULL };
+    char* env[] = { NULL };
+    command_rm(rm_scratch, env);
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == SKIPPED) {
+        printf("test_rm: cannot chroot here, skipped\n");
+        return 0;
+    }
+    int ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    printf("test_rm: rm -r of / refused in 5 spellings, %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+/* Build-time generator for the builtin registry's perfect hash.
+   Reads the names in src/builtins.def, searches for a seed under which
+   builtin_hash puts every name in its own slot, and prints the table as
+   src/builtin_hash_table.h (see the Makefile). */
+#include <stdio.h>
+#include <string.h>
+#include "../src/builtin_hash.h"
+
+static const char* names[] = {
+#define BUILTIN(name, handler, capture, flags, usage, summary, help) name,
+#include "../src/builtins.def"
+#undef BUILTIN
+};
+
+#define COUNT (sizeof(names) / sizeof(names[0]))
+#define MAX_BITS 12
+
+int main(void)
+{
+    static signed char slots[1 << MAX_BITS];
+
+    unsigned bits = 1;
+    while ((1u << bits) < 2 * COUNT) bits++;
+
+    for (; bits <= MAX_BITS; bits++) {
+        unsigned mask = (1u << bits) - 1;
+        for (unsigned seed = 1; seed < 1000000; seed++) {
+            memset(slots, -1, sizeof(slots));
+            size_t i;
+            for (i = 0; i < COUNT; i++) {
+                unsigned s = builtin_hash(names[i], seed) & mask;
+                if (slots[s] != -1) break;
+                slots[s] = (signed char)i;
+            }
+            if (i < COUNT) continue;
+
+            printf("/* Generated by tools/gen_builtin_hash.c from builtins.def; do not edit. */\n");
+            printf("#define BUILTIN_HASH_SEED %uu\n", seed);
+            printf("#define BUILTIN_HASH_BITS %u\n\n", bits);
+            printf("static const signed char builtin_hash_slots[%u] = {", 1u << bits);
+            for (unsigned s = 0; s <= mask; s++) {
+                printf("%s%d%s", s % 16 ? " " : "\n    ", slots[s], s < mask ? "," : "");
+            }
+            printf("\n};\n");
+            return 0;
+        }
+    }
+    fprintf(stderr, "gen_builtin_hash: no perfect hash found\n");
+    return 1;
+}
@@ -0,0 +1,69 @@
+/* Build-time generator for the display width table used by the line
+   editor. Asks the C library's wcwidth about every code point once, here,
+   and prints a two-stage table as src/width_table.h (see the Makefile):
+   stage 1 maps each block of 256 code points to a stage 2 block, and
+   identical stage 2 blocks are shared, which folds the mostly uniform
+   planes down to a few dozen blocks of 2-bit widths. */
+#define _XOPEN_SOURCE 700
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+#define CODE_POINTS 0x110000
+#define BLOCK_BITS 8
+#define BLOCK (1 << BLOCK_BITS)
+#define BLOCKS (CODE_POINTS / BLOCK)
+#define BLOCK_BYTES (BLOCK / 4)         /* four 2-bit widths per byte */
+#define MAX_UNIQUE 256
+
+int main(void)
+{
+    if (!setlocale(LC_CTYPE, "C.UTF-8") && !setlocale(LC_CTYPE, "en_US.UTF-8")) {
+        fprintf(stderr, "gen_width_table: no UTF-8 locale\n");
+        return 1;
+    }
+
+    static unsigned char unique[MAX_UNIQUE][BLOCK_BYTES];
+    static unsigned char stage1[BLOCKS];
+    int count = 0;
+
+    for (int b = 0; b < BLOCKS; b++) {
+        unsigned char block[BLOCK_BYTES];
+        memset(block, 0, sizeof(block));
+        for (int i = 0; i < BLOCK; i++) {
+            int w = wcwidth((wchar_t)(b * BLOCK + i));
+            /* unassigned and control code points take one column */
+            if (w < 0 || w > 2) w = 1;
+            block[i / 4] |= w << (i % 4 * 2);
+        }
+        int u = 0;
+        while (u < count && memcmp(unique[u], block, BLOCK_BYTES) != 0) u++;
+        if (u == count) {
+            if (count == MAX_UNIQUE) {
+                fprintf(stderr, "gen_width_table: more than %d distinct blocks\n", MAX_UNIQUE);
+                return 1;
+            }
+            memcpy(unique[count++], block, BLOCK_BYTES);
+        }
+        stage1[b] = (unsigned char)u;
+    }
+
+    printf("/* Generated by tools/gen_width_table.c from wcwidth; do not edit. */\n");
+    printf("#define WIDTH_BLOCK_BITS %d\n\n", BLOCK_BITS);
+    printf("static const unsigned char width_stage1[%d] = {", BLOCKS);
+    for (int b = 0; b < BLOCKS; b++) {
+        printf("%s%d%s", b % 16 ? " " : "\n    ", stage1[b], b < BLOCKS - 1 ? "," : "");
+    }
+    printf("\n};\n\n");
+    printf("static const unsigned char width_stage2[%d][%d] = {\n", count, BLOCK_BYTES);
+    for (int u = 0; u < count; u++) {
+        printf("    {");
+        for (int i = 0; i < BLOCK_BYTES; i++) {
+            printf("%s0x%02x%s", i % 16 ? " " : "\n        ", unique[u][i], i < BLOCK_BYTES - 1 ? "," : "");
+        }
+        printf("\n    },\n");
+    }
+    printf("};\n");
+    return 0;
+}